@@ -0,0 +1,126 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "detail/intrusive_list.hpp"
+#include "server_options.hpp"
+#include "server_session.hpp"
+
+#include <boost/asio/basic_socket_acceptor.hpp>
+#include <boost/asio/error.hpp>
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace mqtt5
+{
+/**
+ * @brief Accepts connections and runs a server_session for each of them.
+ *
+ * Stream must be constructible from an accepted socket. Streams that need a handshake
+ * of their own, like TLS, aren't handled and must be wrapped by the user.
+ *
+ * Sessions run on the executor of the acceptor and are destroyed by it once they
+ * are closed. Sessions still alive when the acceptor is destroyed are destroyed with
+ * it, so close() it and let the sessions finish first, or stop the executor.
+ */
+template <class Stream>
+class acceptor : private detail::session_owner
+{
+public:
+    using session_type = server_session<Stream>;
+    using executor_type = typename session_type::executor_type;
+
+private:
+    using socket_type = std::remove_reference_t<
+        decltype(std::declval<connection<Stream> &>().lowest_layer())>;
+    using protocol_type = typename socket_type::protocol_type;
+    using acceptor_type = boost::asio::basic_socket_acceptor<protocol_type, executor_type>;
+
+    acceptor_type acceptor_;
+    session_handler *handler_;
+    server_options options_;
+    detail::intrusive_list<server_session_base> sessions_;
+
+    void release(server_session_base &session) override {
+        sessions_.erase(session);
+        delete static_cast<session_type *>(&session);
+    }
+
+    void accept() {
+        acceptor_.async_accept([this](const boost::system::error_code &ec, socket_type socket) {
+            if (ec == boost::asio::error::operation_aborted || !acceptor_.is_open()) {
+                return;
+            }
+            if (!ec) {
+                auto *session =
+                    new session_type(Stream(std::move(socket)), *handler_, *this, options_);
+                sessions_.push_back(*session);
+                session->start();
+            }
+            accept();
+        });
+    }
+
+public:
+    /**
+     * @brief Listen on an endpoint.
+     *
+     * @param handler Receives the events of all sessions, must outlive the acceptor.
+     */
+    acceptor(executor_type executor, const typename protocol_type::endpoint &endpoint,
+             session_handler &handler, server_options options = {})
+        : acceptor_(executor, endpoint), handler_(&handler), options_(options) {
+    }
+
+    acceptor(const acceptor &) = delete;
+    acceptor &operator=(const acceptor &) = delete;
+
+    ~acceptor() {
+        // Only safe once the executor won't run any more session handlers
+        while (!sessions_.empty()) {
+            delete static_cast<session_type *>(&sessions_.pop_front());
+        }
+    }
+
+    [[nodiscard]] executor_type get_executor() {
+        return acceptor_.get_executor();
+    }
+
+    [[nodiscard]] typename protocol_type::endpoint local_endpoint() const {
+        return acceptor_.local_endpoint();
+    }
+
+    /**
+     * @brief Start accepting connections.
+     */
+    void start() {
+        accept();
+    }
+
+    /**
+     * @brief Stop accepting and close all sessions.
+     *
+     * Sessions are destroyed once their pending operations have completed.
+     */
+    void close() {
+        boost::system::error_code ec;
+        acceptor_.close(ec);
+        // Closing never releases a session, that happens when its operations complete
+        for (auto &session : sessions_) {
+            session.close();
+        }
+    }
+
+    /**
+     * @brief Number of sessions that haven't been destroyed yet.
+     */
+    [[nodiscard]] std::size_t session_count() const {
+        return sessions_.size();
+    }
+};
+} // namespace mqtt5
@@ -0,0 +1,33 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "mqtt5/protocol/publish.hpp"
+#include "mqtt5/quality_of_service.hpp"
+
+#include <cstdint>
+
+namespace mqtt5
+{
+/**
+ * @brief Identifies the acknowledgement of a received publish.
+ *
+ * Used with connect_options::manual_ack to acknowledge a publish once the
+ * application has processed it. QoS 1 publishes are acknowledged with PUBACK,
+ * QoS 2 publishes with PUBCOMP and QoS 0 publishes need no acknowledgement.
+ */
+struct ack_token
+{
+    std::uint16_t packet_identifier = 0;
+    mqtt5::quality_of_service qos = mqtt5::quality_of_service::qos0;
+
+    ack_token() = default;
+    explicit ack_token(const protocol::publish &publish)
+        : packet_identifier(publish.packet_identifier),
+          qos(publish.quality_of_service()) {
+    }
+};
+} // namespace mqtt5
@@ -0,0 +1,245 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "detail/subscription_index.hpp"
+#include "retained_store.hpp"
+#include "server_session.hpp"
+
+#include "mqtt5/protocol/publish.hpp"
+#include "mqtt5/protocol/publish_frame.hpp"
+#include "mqtt5/protocol/subscribe.hpp"
+#include "mqtt5/protocol/unsubscribe.hpp"
+#include "mqtt5/topic_filter.hpp"
+
+#include <boost/utility/string_view.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mqtt5
+{
+struct broker_options
+{
+    /**
+     * How a member of a shared subscription group is picked.
+     */
+    shared_subscription_policy shared_policy = shared_subscription_policy::round_robin;
+};
+
+namespace detail
+{
+// SUBSCRIBE options byte
+constexpr std::uint8_t subscription_qos_mask = 0x03, subscription_no_local_flag = 0x04,
+                       subscription_retain_as_published_flag = 0x08;
+
+/**
+ * @brief Check a SUBSCRIBE topic filter and its options.
+ */
+inline bool valid_subscription(const protocol::subscribe::topic_filter &topic,
+                               parsed_filter &parsed) {
+    // No local is a protocol error on shared subscriptions
+    return (topic.options & subscription_qos_mask) <= 2 && parse_filter(topic.topic, parsed) &&
+           (parsed.share_group.empty() || !(topic.options & subscription_no_local_flag));
+}
+
+/**
+ * @brief Check if a new or renewed subscription gets the retained messages.
+ */
+inline bool sends_retained(const parsed_filter &parsed, std::uint8_t options, bool existed) {
+    // Shared subscriptions never get retained messages
+    const auto handling = (options >> 4) & 0x03;
+    return parsed.share_group.empty() && (handling == 0 || (handling == 1 && !existed));
+}
+
+inline quality_of_service granted_qos(quality_of_service qos, std::uint8_t options) {
+    return std::min(qos, static_cast<quality_of_service>(options & subscription_qos_mask));
+}
+
+/**
+ * @brief Deliver a routed publish with the options and identifier of the matching
+ * subscription.
+ */
+inline void forward_frame(server_session_base &to, const protocol::publish_frame &frame,
+                          std::uint8_t options, std::uint32_t identifier) {
+    to.deliver(frame, granted_qos(frame.quality_of_service(), options),
+               frame.retain_flag() && (options & subscription_retain_as_published_flag),
+               identifier);
+}
+
+/**
+ * @brief Deliver a retained message because of a SUBSCRIBE, these always keep the flag.
+ */
+inline void forward_retained(server_session_base &to, const protocol::publish &publish,
+                             std::uint8_t options, std::uint32_t identifier) {
+    to.deliver(protocol::publish_frame(publish),
+               granted_qos(publish.quality_of_service(), options), true, identifier);
+}
+} // namespace detail
+
+/**
+ * @brief Routes publishes between the server sessions of one executor.
+ *
+ * Plugs into an acceptor as its session_handler. Publishes are routed through a
+ * subscription_index, shared subscriptions send each message to one member of the
+ * group and retained messages are delivered to new subscriptions. Every session queues
+ * what its client can't receive yet, up to server_options::max_queued_publishes.
+ *
+ * A client connecting with the client id of a connected client takes over, the old
+ * connection is closed.
+ *
+ * All functions must be called on the executor of the sessions.
+ */
+class broker : public session_handler
+{
+private:
+    broker_options options_;
+    detail::subscription_index<server_session_base *> index_;
+    std::unordered_map<server_session_base *, std::vector<std::string>> session_filters_;
+    std::unordered_map<std::string, server_session_base *> clients_;
+    retained_store retained_;
+    std::vector<boost::string_view> levels_;
+
+    void send_retained(server_session_base &to, boost::string_view filter,
+                       std::uint8_t options, std::uint32_t identifier) {
+        retained_.for_each_match(filter, [&](const retained_store::message_ptr &message) {
+            detail::forward_retained(to, *message, options, identifier);
+        });
+    }
+
+    void remove_session(server_session_base &session) {
+        if (auto iter = session_filters_.find(&session); iter != session_filters_.end()) {
+            for (auto &filter : iter->second) {
+                index_.erase(filter, &session);
+            }
+            session_filters_.erase(iter);
+        }
+        if (auto iter = clients_.find(session.client_id());
+            iter != clients_.end() && iter->second == &session) {
+            clients_.erase(iter);
+        }
+    }
+
+public:
+    explicit broker(broker_options options = {}) : options_(options) {
+    }
+
+    broker(const broker &) = delete;
+    broker &operator=(const broker &) = delete;
+
+    connect_reason_code on_connect(server_session_base &session,
+                                   const protocol::connect &) override {
+        auto &current = clients_[session.client_id()];
+        if (current && current != &session) {
+            // Closing calls on_close, which removes the old session
+            auto *old = current;
+            old->close();
+        }
+        clients_[session.client_id()] = &session;
+        return connect_reason_code::success;
+    }
+
+    void on_publish(server_session_base &session, const protocol::publish &publish) override {
+        if (publish.retain_flag()) {
+            retained_.store(publish);
+        }
+        route(publish, &session);
+    }
+
+    std::vector<std::uint8_t> on_subscribe(server_session_base &session,
+                                           const protocol::subscribe &subscribe) override {
+        std::vector<std::uint8_t> codes;
+        codes.reserve(subscribe.topics.size());
+        auto &filters = session_filters_[&session];
+        const auto identifier = subscribe.properties.subscription_identifier;
+        for (auto &topic : subscribe.topics) {
+            detail::parsed_filter parsed;
+            if (!detail::valid_subscription(topic, parsed)) {
+                codes.push_back(0x8f); // Topic filter invalid
+                continue;
+            }
+
+            bool existed = false;
+            index_.insert(topic.topic, &session, topic.options, &existed, identifier);
+            if (!existed) {
+                filters.push_back(topic.topic);
+            }
+            codes.push_back(topic.options & detail::subscription_qos_mask);
+            if (detail::sends_retained(parsed, topic.options, existed)) {
+                send_retained(session, parsed.filter, topic.options, identifier);
+            }
+        }
+        return codes;
+    }
+
+    std::vector<std::uint8_t> on_unsubscribe(server_session_base &session,
+                                             const protocol::unsubscribe &unsubscribe) override {
+        std::vector<std::uint8_t> codes;
+        codes.reserve(unsubscribe.topics.size());
+        auto &filters = session_filters_[&session];
+        for (auto &topic : unsubscribe.topics) {
+            if (index_.erase(topic, &session)) {
+                filters.erase(std::find(filters.begin(), filters.end(), topic));
+                codes.push_back(0x00);
+            }
+            else {
+                codes.push_back(0x11); // No subscription existed
+            }
+        }
+        return codes;
+    }
+
+    void on_close(server_session_base &session) override {
+        remove_session(session);
+    }
+
+    /**
+     * @brief Send a publish to all matching subscriptions.
+     *
+     * Can be used to publish from the application itself.
+     *
+     * @param from Session the publish came from, used for no local subscriptions.
+     */
+    void route(const protocol::publish &publish, server_session_base *from = nullptr) {
+        // Encoded once on the first match and shared by all receivers
+        protocol::publish_frame frame;
+        split_topic_levels(publish.topic, levels_);
+        index_.match(
+            levels_,
+            [&](const auto &subscription) {
+                if ((subscription.options & detail::subscription_no_local_flag) &&
+                    subscription.subscriber == from) {
+                    return;
+                }
+                if (frame.empty()) {
+                    frame = protocol::publish_frame(publish);
+                }
+                detail::forward_frame(*subscription.subscriber, frame, subscription.options,
+                                      subscription.identifier);
+            },
+            options_.shared_policy,
+            [](server_session_base *subscriber) { return subscriber->backlog(); });
+    }
+
+    /**
+     * @brief The retained messages, can be used to inspect or preload them.
+     */
+    [[nodiscard]] retained_store &retained() {
+        return retained_;
+    }
+
+    /**
+     * @brief Number of subscriptions, each member of a shared group counts as one.
+     */
+    [[nodiscard]] std::size_t subscription_count() const {
+        return index_.size();
+    }
+};
+} // namespace mqtt5
@@ -0,0 +1,118 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cassert>
+#include <functional>
+#include <memory>
+#include <utility>
+
+namespace mqtt5
+{
+class cancellation_slot;
+
+namespace detail
+{
+/**
+ * @brief Shared by a signal and its slots, so either may be destroyed first.
+ */
+struct cancellation_state
+{
+    std::function<void()> handler_;
+    // The slot that assigned handler_
+    const cancellation_slot *owner_ = nullptr;
+};
+} // namespace detail
+
+/**
+ * @brief Cancels the operation connected to one of its slots.
+ *
+ * Only one operation may be connected at a time, a signal can be reused once that
+ * operation has completed. The signal may be destroyed before the operation, it is
+ * then never cancelled. emit() must be called on the client executor.
+ */
+class cancellation_signal
+{
+private:
+    std::shared_ptr<detail::cancellation_state> state_ =
+        std::make_shared<detail::cancellation_state>();
+
+public:
+    cancellation_signal() = default;
+    cancellation_signal(const cancellation_signal &) = delete;
+    cancellation_signal &operator=(const cancellation_signal &) = delete;
+
+    /**
+     * @brief Cancel the connected operation, does nothing if it has already completed.
+     */
+    void emit() {
+        state_->owner_ = nullptr;
+        if (auto handler = std::exchange(state_->handler_, nullptr)) {
+            handler();
+        }
+    }
+
+    [[nodiscard]] inline cancellation_slot slot() noexcept;
+};
+
+/**
+ * @brief Where an operation installs the handler that cancels it.
+ *
+ * A default constructed slot is not connected to any signal. The handler is removed
+ * when the slot that assigned it is cleared or destroyed, so an operation destroyed
+ * before it completed is never cancelled. Copies share the signal but not the handler.
+ */
+class cancellation_slot
+{
+private:
+    std::shared_ptr<detail::cancellation_state> state_;
+
+public:
+    cancellation_slot() = default;
+    explicit cancellation_slot(std::shared_ptr<detail::cancellation_state> state) noexcept
+        : state_(std::move(state)) {
+    }
+
+    cancellation_slot(const cancellation_slot &) = default;
+    cancellation_slot &operator=(const cancellation_slot &rhs) {
+        if (this != &rhs) {
+            clear();
+            state_ = rhs.state_;
+        }
+        return *this;
+    }
+
+    ~cancellation_slot() {
+        clear();
+    }
+
+    [[nodiscard]] bool is_connected() const noexcept {
+        return state_ != nullptr;
+    }
+
+    template <class F>
+    void assign(F &&handler) {
+        // Only one operation may be connected to a signal at a time
+        assert(state_->handler_ == nullptr);
+        state_->handler_ = std::forward<F>(handler);
+        state_->owner_ = this;
+    }
+
+    /**
+     * @brief Remove the handler, called by an operation when it completes.
+     */
+    void clear() noexcept {
+        if (state_ && state_->owner_ == this) {
+            state_->owner_ = nullptr;
+            state_->handler_ = nullptr;
+        }
+    }
+};
+
+cancellation_slot cancellation_signal::slot() noexcept {
+    return cancellation_slot(state_);
+}
+} // namespace mqtt5
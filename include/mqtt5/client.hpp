@@ -7,15 +7,31 @@
 #pragma once
 
 #include "connection.hpp"
+#include "detail/awaiters.hpp"
+#include "detail/backoff.hpp"
 #include "detail/connect_sender.hpp"
+#include "detail/endpoint_cache.hpp"
 #include "detail/event_emitting_receiver.hpp"
 #include "detail/filter_subscribe_sender.hpp"
+#include "detail/held_ack.hpp"
+#include "detail/inbound_topic_aliases.hpp"
+#include "detail/keep_alive.hpp"
+#include "detail/mpsc_queue.hpp"
+#include "detail/outbound_topic_aliases.hpp"
 #include "detail/publish_sender.hpp"
 #include "detail/subscribe_sender.hpp"
+#include "detail/subscription_stream.hpp"
+#include "detail/timer_wheel.hpp"
+#include "detail/topic_intern_table.hpp"
 #include "detail/unsubscribe_sender.hpp"
+#include "detail/worker_channel.hpp"
 
+#include "mqtt5/ack_token.hpp"
+#include "mqtt5/cancellation.hpp"
 #include "mqtt5/connect_options.hpp"
+#include "mqtt5/connect_reason_code.hpp"
 #include "mqtt5/disconnect_reason.hpp"
+#include "mqtt5/keep_alive_manager.hpp"
 #include "mqtt5/protocol/connect.hpp"
 #include "mqtt5/protocol/disconnect.hpp"
 #include "mqtt5/protocol/ping.hpp"
@@ -23,16 +39,21 @@
 #include "mqtt5/puback_reason_code.hpp"
 #include "mqtt5/publish_options.hpp"
 #include "mqtt5/quality_of_service.hpp"
+#include "mqtt5/reconnect_options.hpp"
+#include "mqtt5/session_store.hpp"
 #include "mqtt5/topic_filter.hpp"
 #include "protocol/control_packet.hpp"
 
-#include <boost/asio/executor.hpp>
+#include <boost/asio/post.hpp>
 #include <boost/sml.hpp>
+#include <cassert>
 #include <chrono>
+#include <deque>
 #include <exception>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <p0443_v2/asio/connect.hpp>
-#include <p0443_v2/asio/resolve.hpp>
 #include <p0443_v2/asio/timer.hpp>
 #include <p0443_v2/sink_receiver.hpp>
 #include <p0443_v2/submit.hpp>
@@ -46,7 +67,7 @@ namespace mqtt5
 {
 namespace helper
 {
-std::ostream &steady_now(std::ostream &os) {
+inline std::ostream &steady_now(std::ostream &os) {
     os << std::chrono::duration_cast<std::chrono::seconds>(
               std::chrono::steady_clock::now().time_since_epoch())
               .count()
@@ -59,7 +80,24 @@ namespace net = boost::asio;
 template <class Stream>
 class client
 {
+public:
+    /**
+     * The executor type of the underlying stream.
+     *
+     * Timers and resolvers use the same concrete executor type, so handlers are
+     * dispatched without going through a type-erased executor.
+     */
+    using executor_type = typename connection<Stream>::executor_type;
+
 private:
+    using timer_type = net::basic_waitable_timer<std::chrono::steady_clock,
+                                                 net::wait_traits<std::chrono::steady_clock>,
+                                                 executor_type>;
+
+    using protocol_type = typename std::remove_reference_t<
+        decltype(std::declval<connection<Stream> &>().lowest_layer())>::protocol_type;
+    using resolve_sender_type = detail::cached_resolve_sender<protocol_type, executor_type>;
+
     struct packet_identifier_generator_t
     {
         std::uint16_t next_ = 1;
@@ -80,6 +118,8 @@ private:
         state_type current_state_;
     };
 
+    template <class Client>
+    friend struct detail::event_emitting_receiver_base;
     template <class Client, class... Events>
     friend struct detail::event_emitting_receiver;
 
@@ -97,51 +137,463 @@ private:
 
     template <class>
     friend struct detail::connect_sender;
+    template <class>
+    friend struct detail::supervisor_sender;
 
-    net::executor executor_;
+    template <class>
+    friend class mqtt5::subscription_stream;
+
+#ifdef MQTT5_HAS_COROUTINES
+    template <class>
+    friend struct detail::publish_awaiter;
+    template <class>
+    friend struct detail::subscribe_awaiter;
+    template <class>
+    friend struct detail::receive_awaiter;
+#endif
+
+    executor_type executor_;
     std::vector<std::unique_ptr<detail::message_receiver_base<>>> connect_receivers_;
     connection<Stream> connection_;
-    net::steady_timer connect_and_ping_timer_;
-    net::steady_timer keep_alive_timer_;
+    timer_type connect_and_ping_timer_;
+    timer_type keep_alive_timer_;
+
+    // Checks the keep-alive instead of keep_alive_timer_ when set
+    std::shared_ptr<keep_alive_manager<executor_type>> keep_alive_manager_;
+    struct keep_alive_watcher : detail::keep_alive_watch
+    {
+        // Released with the client, a timeout still queued then finds it expired
+        std::shared_ptr<client *> client_;
+        explicit keep_alive_watcher(client *c) : client_(std::make_shared<client *>(c)) {
+        }
+        void keep_alive_expired(std::uint64_t registration) override {
+            net::post((*client_)->executor_,
+                      [c = std::weak_ptr<client *>(client_), registration] {
+                          if (auto alive = c.lock()) {
+                              (*alive)->shared_keep_alive_expired(registration);
+                          }
+                      });
+        }
+    };
+    keep_alive_watcher keep_alive_watch_{this};
+    bool keep_alive_watched_ = false;
+
+    // Activity on the connection. The ping and keep-alive timers are not touched per
+    // packet, they check these when they fire and re-arm for what is left.
+    std::chrono::steady_clock::time_point last_received_;
+    std::chrono::steady_clock::time_point last_sent_;
+
+    void shared_keep_alive_expired(std::uint64_t registration) {
+        // A timeout posted before the watch was stopped or restarted is stale
+        if (keep_alive_watched_ && registration == keep_alive_watch_.registration()) {
+            keep_alive_watched_ = false;
+            connection_sm_->process_event(typename connection_sm_t::keep_alive_timeout_evt{});
+        }
+    }
 
     mqtt5::connect_options connect_opts_;
 
     std::chrono::duration<std::uint16_t> keep_alive_used_{0};
     std::string client_id_;
-    std::vector<detail::in_flight_publish> published_messages_;
-    std::vector<detail::in_flight_subscribe> subscribe_messages_;
-    std::vector<detail::in_flight_unsubscribe> unsubscribe_messages_;
+    detail::intrusive_list<detail::in_flight_publish> published_messages_;
+    detail::intrusive_list<detail::in_flight_subscribe> subscribe_messages_;
+    detail::intrusive_list<detail::in_flight_unsubscribe> unsubscribe_messages_;
+
+    detail::outbound_topic_aliases outbound_topic_aliases_;
+    detail::inbound_topic_aliases inbound_topic_aliases_;
+
+    // Allocated separately, waiters point to their entry
+    std::vector<std::unique_ptr<detail::filtered_subscription>> publish_waiters_;
+    detail::topic_intern_table received_topics_;
+    detail::filtered_subscription &publish_waiters_entry(const topic_filter &filter) {
+        auto existing_item = std::find_if(
+            publish_waiters_.begin(), publish_waiters_.end(),
+            [&](const std::unique_ptr<detail::filtered_subscription> &item) {
+                return item->filter_ == filter;
+            });
+        if (existing_item != publish_waiters_.end()) {
+            return **existing_item;
+        }
+        auto &new_item =
+            *publish_waiters_.emplace_back(std::make_unique<detail::filtered_subscription>());
+        new_item.filter_ = filter;
+        new_item.index_ = publish_waiters_.size() - 1;
+        received_topics_.invalidate();
+        return new_item;
+    }
+
+    /**
+     * Moves the last entry into the place of the erased one, matches cached in
+     * received_topics_ must be invalidated.
+     */
+    void erase_publish_waiters_entry(detail::filtered_subscription &entry) {
+        const auto index = entry.index_;
+        if (index + 1 != publish_waiters_.size()) {
+            publish_waiters_[index] = std::move(publish_waiters_.back());
+            publish_waiters_[index]->index_ = index;
+        }
+        publish_waiters_.pop_back();
+    }
+
+    void add_publish_waiter(topic_filter filter, detail::publish_waiter &waiter) {
+        auto &entry = publish_waiters_entry(filter);
+        entry.receivers_.push_back(waiter);
+        waiter.subscription_ = &entry;
+    }
+
+    void cancel_publish_waiter(detail::publish_waiter &waiter) {
+        if (waiter.delivering_) {
+            // Linked into a batch being completed, which completes it with done
+            waiter.cancelled_ = true;
+            return;
+        }
+        auto &entry = *std::exchange(waiter.subscription_, nullptr);
+        entry.receivers_.erase(waiter);
+        if (!entry.persistent() && entry.receivers_.empty()) {
+            erase_publish_waiters_entry(entry);
+            received_topics_.invalidate();
+        }
+        waiter.set_done();
+    }
+
+    void add_subscription_stream(detail::subscription_stream_state &stream) {
+        publish_waiters_entry(stream.filter_).streams_.push_back(stream);
+    }
+
+    void remove_subscription_stream(detail::subscription_stream_state &stream) {
+        auto &entry = publish_waiters_entry(stream.filter_);
+        entry.streams_.erase(stream);
+        if (stream.completion_pending_) {
+            ready_streams_.erase(std::find(ready_streams_.begin(), ready_streams_.end(), &stream));
+            stream.completion_pending_ = false;
+        }
+        if (!entry.persistent() && entry.receivers_.empty()) {
+            erase_publish_waiters_entry(entry);
+            received_topics_.invalidate();
+        }
+    }
+
+    // Worker channels are owned by the client while linked
+    std::vector<std::shared_ptr<detail::worker_channel_state>> worker_channels_;
+
+    void add_worker_channel(std::shared_ptr<detail::worker_channel_state> channel) {
+        channel->wake_ = [this] { net::post(executor_, [this] { flush_worker_channels(); }); };
+        publish_waiters_entry(channel->filter_).workers_.push_back(*channel);
+        worker_channels_.emplace_back(std::move(channel));
+    }
+
+    void remove_worker_channel(detail::worker_channel_state &channel) {
+        auto &entry = publish_waiters_entry(channel.filter_);
+        entry.workers_.erase(channel);
+        if (!entry.persistent() && entry.receivers_.empty()) {
+            erase_publish_waiters_entry(entry);
+            received_topics_.invalidate();
+        }
+
+        // Held publishes will never be delivered, acknowledge them anyway
+        for (auto &held : channel.backlog_) {
+            if (held.ack_) {
+                release_held_ack(*held.ack_);
+            }
+        }
+        channel.backlog_.clear();
+
+        auto owner = std::find_if(worker_channels_.begin(), worker_channels_.end(),
+                                  [&](const auto &ptr) { return ptr.get() == &channel; });
+        worker_channels_.erase(owner);
+    }
+
+    void flush_worker_channels() {
+        std::vector<detail::worker_channel_state *> closed;
+        for (auto &channel : worker_channels_) {
+            if (channel->closed_.load(std::memory_order_acquire)) {
+                closed.push_back(channel.get());
+            }
+            else {
+                channel->flush_backlog([this](detail::held_ack &ack) { release_held_ack(ack); });
+            }
+        }
+        for (auto *channel : closed) {
+            remove_worker_channel(*channel);
+        }
+    }
+
+    void release_held_ack(detail::held_ack &ack) {
+        if (--ack.remaining_ == 0) {
+            send_ack(ack);
+        }
+    }
+
+    // Acks are coalesced and written together on the next executor turn
+    detail::ack_batch pending_acks_;
+    void send_ack(const detail::held_ack &ack) {
+        if (pending_acks_.add(ack)) {
+            net::post(executor_, [this] { flush_pending_acks(); });
+        }
+    }
 
-    std::vector<detail::filtered_subscription> publish_waiters_;
-    void deliver_to_publish_waiters(const protocol::publish &publish) {
-        // Vector of unique pointers
-        using filtered_sub_container_t = decltype(publish_waiters_.front().receivers_);
+    void flush_pending_acks() {
+        struct receiver : detail::event_emitting_receiver_base<client<Stream>>
+        {
+            std::size_t count_;
+            void set_value(std::size_t) {
+                // Every written ack gives back one receive quota
+                for (std::size_t i = 0; i < count_; i++) {
+                    this->client_->connection_sm_->process_event(
+                        typename connection_sm_t::puback_sent_evt{});
+                }
+            }
+        };
+        if (pending_acks_.empty()) {
+            return;
+        }
+        auto acks = pending_acks_.take();
+        last_sent_ = std::chrono::steady_clock::now();
+        p0443_v2::submit(connection_.control_packets_writer(acks), receiver{{this}, acks.size()});
+    }
+
+    // Acks held until the application releases them, only used with manual_ack
+    detail::manual_ack_table manual_acks_;
+    // Acks released from any thread, drained on the client executor
+    detail::mpsc_queue<ack_token> released_acks_;
+    void drain_released_acks() {
+        released_acks_.consume_all([this](ack_token &&token) {
+            if (auto ack = manual_acks_.release(token)) {
+                release_held_ack(*ack);
+            }
+        });
+    }
+
+    bool deliver_to_publish_waiters(protocol::publish &publish, detail::held_ack ack = {}) {
+        return deliver_to_publish_waiters(received_topics_.intern(publish.topic), publish, ack);
+    }
+
+    /**
+     * Delivers a publish to every matching receiver, stream and worker channel.
+     *
+     * The topic of a publish with only an alias is filled in from the interned topic
+     * once something matches.
+     *
+     * @return false if the ack is held back, either because a worker channel could
+     *         not accept the publish yet or because manual_ack is used and the publish
+     *         was handed out. The ack is then sent once it is released.
+     */
+    bool deliver_to_publish_waiters(detail::interned_topic &topic, protocol::publish &publish,
+                                    detail::held_ack ack = {}) {
+        // Intrusive list of waiters
+        using filtered_sub_container_t = decltype(detail::filtered_subscription::receivers_);
+
+        const auto &matching =
+            received_topics_.matching(topic, publish_waiters_.size(), [&](std::size_t i) {
+                return publish_waiters_[i]->filter_.matches(topic.levels);
+            });
+        if (!matching.empty() && publish.topic.empty()) {
+            publish.topic = topic.name;
+        }
 
         // Take out all matching current publish waiters
-        // and add them to all_receivers (which is a vector in vector)
+        // and add them to all_receivers (which is a vector of lists)
         // don't just set value in this loop since set_value can
         // add new items to publish_waiters_
+        // Streams only buffer the publish here, waiting stream receivers are
+        // completed in batches by complete_ready_streams.
         std::vector<filtered_sub_container_t> all_receivers;
-        for (auto iter = publish_waiters_.begin(); iter != publish_waiters_.end();) {
-            if (iter->filter_.matches(publish.topic)) {
-                all_receivers.emplace_back(std::move(iter->receivers_));
-                iter = publish_waiters_.erase(iter);
+        std::vector<detail::worker_channel_state *> workers;
+        all_receivers.reserve(matching.size());
+        // Whether anyone got the publish, and with it a way to release its ack
+        bool handed_out = false;
+        bool erased = false;
+        // matching is sorted, iterate from the back so an erased entry is only replaced
+        // by one already visited
+        for (auto iter = matching.rbegin(); iter != matching.rend(); iter++) {
+            auto &entry = *publish_waiters_[*iter];
+            all_receivers.emplace_back(std::move(entry.receivers_));
+            for (auto &receiver : all_receivers.back()) {
+                receiver.subscription_ = nullptr;
+                receiver.delivering_ = true;
+                handed_out = handed_out || !receiver.cancelled_;
             }
-            else {
-                iter++;
+            for (auto &stream : entry.streams_) {
+                handed_out = true;
+                stream.push(publish);
+                if (stream.waiter_ && !stream.completion_pending_) {
+                    stream.completion_pending_ = true;
+                    ready_streams_.push_back(&stream);
+                }
+            }
+            for (auto &worker : entry.workers_) {
+                workers.push_back(&worker);
+            }
+            if (!entry.persistent()) {
+                erase_publish_waiters_entry(entry);
+                erased = true;
+            }
+        }
+        if (erased) {
+            received_topics_.invalidate();
+        }
+
+        // remaining_ starts at one so the ack can't be released while distributing
+        std::shared_ptr<detail::held_ack> held;
+        auto hold = [&] {
+            if (!held) {
+                held = std::make_shared<detail::held_ack>(ack);
+                held->remaining_ = 1;
+            }
+            held->remaining_++;
+            return held;
+        };
+        std::vector<detail::worker_channel_state *> closed;
+        for (auto *worker : workers) {
+            if (worker->closed_.load(std::memory_order_acquire)) {
+                closed.push_back(worker);
+                continue;
+            }
+            auto copy = publish;
+            if (worker->offer(copy)) {
+                handed_out = true;
+                continue;
             }
+            if (publish.quality_of_service() == 0_qos) {
+                worker->dropped_.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            handed_out = true;
+            worker->backlog_.push_back({std::move(copy), hold()});
+            worker->flush_backlog(
+                [this](detail::held_ack &accepted) { release_held_ack(accepted); });
+        }
+        for (auto *worker : closed) {
+            remove_worker_channel(*worker);
         }
 
-        for (auto &rv : all_receivers) {
-            for (auto &rx : rv) {
-                rx->set_value(publish);
+        // Nobody could release an ack that was never handed out, it is sent right away
+        if (connect_opts_.manual_ack && handed_out &&
+            ack.kind_ != detail::held_ack::kind_type::none) {
+            manual_acks_.hold(hold());
+        }
+
+        for (auto iter = all_receivers.rbegin(); iter != all_receivers.rend(); iter++) {
+            while (!iter->empty()) {
+                auto &receiver = iter->pop_front();
+                if (receiver.cancelled_) {
+                    receiver.set_done();
+                }
+                else {
+                    receiver.set_value(publish);
+                }
             }
         }
+        return !held || --held->remaining_ == 0;
+    }
+
+    // Streams with a waiting receiver and buffered publishes. Completion is deferred
+    // until no complete packet is left in the read buffer, so a receive_many
+    // completes with everything decoded from a single read.
+    std::vector<detail::subscription_stream_state *> ready_streams_;
+    void complete_ready_streams() {
+        // Take all batches before completing anything, since a completion may
+        // cancel or destroy other streams
+        std::vector<std::pair<detail::stream_waiter *, std::vector<protocol::publish>>> batches;
+        batches.reserve(ready_streams_.size());
+        for (auto *stream : ready_streams_) {
+            stream->completion_pending_ = false;
+            if (auto *waiter = stream->ready_waiter()) {
+                batches.emplace_back(waiter, stream->take(waiter->max_count_));
+            }
+        }
+        ready_streams_.clear();
+        for (auto &[waiter, publishes] : batches) {
+            waiter->set_value(std::move(publishes));
+        }
     }
 
     std::vector<received_qos2_state> received_qos2_states_;
 
-    std::vector<std::unique_ptr<detail::publish_op_starter_base>> queued_publishes_;
+    // Publishes waiting for send quota, in the order they were started
+    detail::intrusive_list<detail::in_flight_publish> queued_publishes_;
+
+    // Queued publishes with a message expiry interval, ticks are seconds since creation
+    detail::timer_wheel expiry_wheel_;
+    std::chrono::steady_clock::time_point expiry_epoch_ = std::chrono::steady_clock::now();
+    timer_type expiry_timer_;
+    bool expiry_timer_running_ = false;
+
+    [[nodiscard]] std::uint64_t expiry_now() const {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(
+                                              std::chrono::steady_clock::now() - expiry_epoch_)
+                                              .count());
+    }
+
+    struct expiry_timer_receiver
+    {
+        client *client_;
+        template <class... Values>
+        void set_value(Values &&...) {
+            client_->expiry_timer_running_ = false;
+            client_->expire_queued_publishes();
+            client_->start_expiry_timer();
+        }
+        void set_done() {
+        }
+        template <class E>
+        void set_error(E &&) {
+        }
+    };
+
+    // Ticks once a second while there is something to expire
+    void start_expiry_timer() {
+        if (expiry_timer_running_ || expiry_wheel_.empty()) {
+            return;
+        }
+        expiry_timer_running_ = true;
+        p0443_v2::submit(p0443_v2::asio::timer::wait_for(expiry_timer_, std::chrono::seconds{1}),
+                         expiry_timer_receiver{this});
+    }
+
+    void expire_queued_publishes() {
+        expiry_wheel_.advance(expiry_now(), [this](detail::timer_wheel_entry &entry) {
+            auto &in_flight = static_cast<detail::in_flight_publish &>(entry);
+            queued_publishes_.erase(in_flight);
+            in_flight.set_done();
+        });
+    }
+
+    void queue_publish(detail::in_flight_publish &in_flight) {
+        in_flight.queued_ = true;
+        queued_publishes_.push_back(in_flight);
+        const auto expiry = in_flight.message_.properties.message_expiry_interval;
+        // A publish requeued on reconnect keeps its deadline
+        if (expiry.count() != 0 && !in_flight.is_scheduled()) {
+            expiry_wheel_.schedule(in_flight, expiry_now() + expiry.count());
+            start_expiry_timer();
+        }
+    }
+
+    /**
+     * Unschedules a publish leaving the queue, it is sent with the interval it has left.
+     */
+    void take_remaining_expiry(detail::in_flight_publish &in_flight) {
+        if (!in_flight.is_scheduled()) {
+            return;
+        }
+        expiry_wheel_.cancel(in_flight);
+        const auto now = expiry_now();
+        const auto left = in_flight.deadline() > now ? in_flight.deadline() - now : 1;
+        in_flight.message_.properties.message_expiry_interval =
+            std::chrono::duration<std::uint32_t>{static_cast<std::uint32_t>(left)};
+    }
+
+    // Publishes submitted from other threads, drained on the client executor
+    detail::mpsc_queue<protocol::publish> submitted_publishes_;
+    void drain_submitted_publishes() {
+        submitted_publishes_.consume_all([this](protocol::publish &&pub) {
+            detail::publish_sender sender(this, [](protocol::publish &) {});
+            sender.message_ = std::move(pub);
+            p0443_v2::submit(std::move(sender), p0443_v2::sink_receiver{});
+        });
+    }
+
     std::uint16_t server_max_send_quota_{65535};
     std::uint16_t server_send_quota_{65535};
 
@@ -151,12 +603,332 @@ private:
         if (server_send_quota_ < server_max_send_quota_) {
             server_send_quota_++;
 
+            expire_queued_publishes();
             if (!queued_publishes_.empty()) {
-                auto next = std::move(queued_publishes_.front());
-                queued_publishes_.erase(queued_publishes_.begin());
-                next->start();
+                send_in_flight_publish(queued_publishes_.pop_front());
+            }
+        }
+    }
+
+    void send_qos0_publish(protocol::publish &&publish) {
+        if (is_offline()) {
+            if (buffer_offline(publish)) {
+                const auto expiry = publish.properties.message_expiry_interval.count();
+                offline_publishes_.push_back(
+                    offline_publish{std::move(publish), expiry == 0 ? 0 : expiry_now() + expiry});
+            }
+            return;
+        }
+        outbound_topic_aliases_.apply(publish);
+        send_message(std::move(publish));
+    }
+
+    void send_in_flight_publish(detail::in_flight_publish &in_flight) {
+        --server_send_quota_;
+        in_flight.queued_ = false;
+        take_remaining_expiry(in_flight);
+        if (session_store_) {
+            session_store_->publish_sent(in_flight.message_);
+        }
+        // Aliases must be assigned in send order, queued publishes included. They are
+        // applied to the sent copy, so the message can be replayed on a new connection.
+        protocol::publish sent = in_flight.message_;
+        outbound_topic_aliases_.apply(sent);
+        send_message(std::move(sent));
+        published_messages_.push_back(in_flight);
+    }
+
+    /**
+     * Starts a QoS 1 or QoS 2 publish. The publish is sent if the server send
+     * quota allows it, otherwise it is queued.
+     */
+    void start_publish(detail::in_flight_publish &in_flight) {
+        in_flight.message_.packet_identifier = next_packet_identifier();
+        in_flight.state_ = in_flight.message_.quality_of_service() == 2_qos
+                               ? detail::in_flight_publish::state_type::waiting_pubrec
+                               : detail::in_flight_publish::state_type::waiting_puback;
+        if (is_offline()) {
+            if (buffer_offline(in_flight.message_)) {
+                queue_publish(in_flight);
+            }
+            else {
+                in_flight.set_done();
+            }
+            return;
+        }
+        send_or_queue_publish(in_flight);
+    }
+
+    /**
+     * Completes a publish with done. A queued publish is dropped, a sent one is replaced
+     * by a node that completes its acknowledgement without anyone waiting.
+     */
+    void cancel_publish(detail::in_flight_publish &in_flight) {
+        if (!in_flight.is_linked()) {
+            return;
+        }
+        if (in_flight.queued_) {
+            queued_publishes_.erase(in_flight);
+            expiry_wheel_.cancel(in_flight);
+        }
+        else {
+            auto *detached = new detail::recovered_publish;
+            detached->message_ = std::move(in_flight.message_);
+            detached->state_ = in_flight.state_;
+            published_messages_.replace(in_flight, *detached);
+        }
+        in_flight.set_done();
+    }
+
+    void send_or_queue_publish(detail::in_flight_publish &in_flight) {
+        if (server_send_quota_ > 0) {
+            send_in_flight_publish(in_flight);
+        }
+        else {
+            queue_publish(in_flight);
+        }
+    }
+
+    std::shared_ptr<mqtt5::session_store> session_store_;
+    std::optional<stored_session> stored_session_;
+
+    /**
+     * Resends the in-flight state recovered from the session store, the server
+     * still has the session.
+     */
+    void resume_stored_session() {
+        auto session = std::move(*stored_session_);
+        stored_session_.reset();
+
+        for (auto &publish : session.incoming) {
+            received_qos2_state state;
+            state.current_state_ = received_qos2_state::state_type::pubrec_sent;
+            state.publish_ = std::move(publish);
+            received_qos2_states_.emplace_back(std::move(state));
+        }
+
+        std::uint16_t highest_id = 0;
+        for (auto &publish : session.outgoing) {
+            highest_id = std::max(highest_id, publish.packet_identifier);
+            auto *in_flight = new detail::recovered_publish;
+            in_flight->message_ = std::move(publish);
+            const bool released =
+                std::find(session.released.begin(), session.released.end(),
+                          in_flight->message_.packet_identifier) != session.released.end();
+            if (released) {
+                in_flight->state_ = detail::in_flight_publish::state_type::waitiing_pubcomp;
+                if (server_send_quota_ > 0) {
+                    --server_send_quota_;
+                }
+                protocol::pubrel pubrel;
+                pubrel.packet_identifier = in_flight->message_.packet_identifier;
+                send_message(pubrel);
+                published_messages_.push_back(*in_flight);
+            }
+            else {
+                in_flight->state_ = in_flight->message_.quality_of_service() == 2_qos
+                                        ? detail::in_flight_publish::state_type::waiting_pubrec
+                                        : detail::in_flight_publish::state_type::waiting_puback;
+                in_flight->message_.set_duplicate(true);
+                send_or_queue_publish(*in_flight);
+            }
+        }
+        // Don't hand out identifiers that are still in use
+        if (highest_id != 0 && highest_id != 0xffff) {
+            next_packet_identifier.next_ = highest_id + 1;
+        }
+    }
+
+    // While offline these are sent once connected
+    void start_subscribe(detail::in_flight_subscribe &in_flight) {
+        in_flight.message_.packet_identifier = next_packet_identifier();
+        if (!is_offline()) {
+            send_message(in_flight.message_);
+        }
+        subscribe_messages_.push_back(in_flight);
+    }
+
+    /**
+     * Completes a subscribe with done. Once sent it is replaced by a node that still
+     * records what the server grants.
+     */
+    void cancel_subscribe(detail::in_flight_subscribe &in_flight) {
+        if (!in_flight.is_linked()) {
+            return;
+        }
+        if (is_offline()) {
+            subscribe_messages_.erase(in_flight);
+        }
+        else {
+            auto *detached = new detail::resubscribe;
+            detached->message_ = std::move(in_flight.message_);
+            subscribe_messages_.replace(in_flight, *detached);
+        }
+        in_flight.set_done();
+    }
+
+    void start_unsubscribe(detail::in_flight_unsubscribe &in_flight) {
+        in_flight.message_.packet_identifier = next_packet_identifier();
+        if (!is_offline()) {
+            send_message(in_flight.message_);
+        }
+        unsubscribe_messages_.push_back(in_flight);
+    }
+
+    // Subscriptions granted by the server, restored when a reconnect finds the session gone
+    std::vector<protocol::subscribe::topic_filter> active_subscriptions_;
+
+    struct supervision_t
+    {
+        std::string host_;
+        std::string port_;
+        reconnect_options options_;
+        detail::backoff backoff_;
+        // Handshake of the stream layers above the socket, empty if there is none
+        std::function<void()> stream_handshake_;
+        // Set from connack until the connection is lost
+        bool online_ = false;
+        bool connected_before_ = false;
+    };
+    std::optional<supervision_t> supervision_;
+    timer_type reconnect_timer_;
+    typename resolve_sender_type::cache_type endpoints_{std::chrono::seconds{60}};
+
+    // QoS 0 publishes buffered while offline, QoS 1 and 2 wait in queued_publishes_.
+    // They are few and short lived, so they are only checked for expiry when flushed.
+    struct offline_publish
+    {
+        protocol::publish message_;
+        // Expiry wheel tick the message expires at, 0 if it never does
+        std::uint64_t deadline_;
+    };
+    std::deque<offline_publish> offline_publishes_;
+    std::size_t offline_bytes_ = 0;
+
+    [[nodiscard]] bool is_offline() const {
+        return supervision_ && !supervision_->online_;
+    }
+
+    bool buffer_offline(const protocol::publish &publish) {
+        const auto size = publish.topic.size() + publish.payload.size();
+        if (offline_bytes_ + size > supervision_->options_.offline_buffer_size) {
+            return false;
+        }
+        offline_bytes_ += size;
+        return true;
+    }
+
+    void start_reconnect_attempt();
+    void schedule_reconnect();
+
+    struct socket_connected_receiver
+    {
+        client *client_;
+        template <class... Values>
+        void set_value(Values &&...) {
+            if (!client_->supervision_) {
+                return;
+            }
+            if (client_->supervision_->stream_handshake_) {
+                client_->supervision_->stream_handshake_();
+            }
+            else {
+                client_->connection_sm_->process_event(typename connection_sm_t::handshake_evt{});
+            }
+        }
+        void set_done() {
+            if (client_->supervision_) {
+                // The endpoints may be stale, resolve again on the next attempt
+                client_->endpoints_.evict(client_->supervision_->host_,
+                                          client_->supervision_->port_);
+                client_->schedule_reconnect();
+            }
+        }
+        template <class E>
+        void set_error(E &&) {
+            set_done();
+        }
+    };
+
+    struct stream_handshake_receiver
+    {
+        client *client_;
+        template <class... Values>
+        void set_value(Values &&...) {
+            if (client_->supervision_) {
+                client_->connection_sm_->process_event(typename connection_sm_t::handshake_evt{});
             }
         }
+        void set_done() {
+            if (client_->supervision_) {
+                client_->close_socket();
+                client_->schedule_reconnect();
+            }
+        }
+        template <class E>
+        void set_error(E &&) {
+            set_done();
+        }
+    };
+
+    struct reconnect_timer_receiver
+    {
+        client *client_;
+        template <class... Values>
+        void set_value(Values &&...) {
+            client_->start_reconnect_attempt();
+        }
+        void set_done() {
+        }
+        template <class E>
+        void set_error(E &&) {
+        }
+    };
+    void connection_lost(const std::exception_ptr &error) {
+        if (supervision_) {
+            supervision_->online_ = false;
+            schedule_reconnect();
+        }
+        else if (error) {
+            fail_pending_operations(error);
+        }
+    }
+
+    /**
+     * Fails everything waiting for the server, none of it will complete on a connection
+     * lost because of an error. A supervised connection resends it instead.
+     */
+    void fail_pending_operations(const std::exception_ptr &error) {
+        while (!published_messages_.empty()) {
+            published_messages_.pop_front().set_error(error);
+        }
+        while (!queued_publishes_.empty()) {
+            auto &in_flight = queued_publishes_.pop_front();
+            expiry_wheel_.cancel(in_flight);
+            in_flight.set_error(error);
+        }
+        while (!subscribe_messages_.empty()) {
+            subscribe_messages_.pop_front().set_error(error);
+        }
+        while (!unsubscribe_messages_.empty()) {
+            unsubscribe_messages_.pop_front().set_error(error);
+        }
+    }
+    void stop_supervising();
+    void resume_supervised(bool session_present, std::vector<detail::in_flight_publish *> sent,
+                           std::vector<detail::in_flight_publish *> queued);
+
+    void close_socket();
+
+    /**
+     * Sends a disconnect and closes the socket because of a protocol error.
+     * Unlike disconnector() a supervised connection is reestablished.
+     */
+    void abort_connection(mqtt5::disconnect_reason reason) {
+        p0443_v2::submit(
+            p0443_v2::transform(connection_.control_packet_writer(protocol::disconnect(reason)),
+                                [this](auto...) { this->close_socket(); }),
+            p0443_v2::sink_receiver{});
     }
 
     struct connection_sm_t;
@@ -165,8 +937,11 @@ private:
 
     void start_connect_timer();
     void start_ping_timer();
+    void ping_timer_expired();
     void stop_ping_timer();
     void start_keep_alive_timer();
+    void keep_alive_packet_received();
+    void keep_alive_timer_expired();
     void stop_keep_alive_timer();
     void send_connect();
     void send_ping();
@@ -175,6 +950,7 @@ private:
     void send_message(T &&msg);
     void receive_one_message();
     void handle_packet(protocol::connack &connack);
+    void connection_refused(const protocol::connack &connack);
     void handle_packet(protocol::puback &puback);
     void handle_packet(protocol::suback &suback);
     void handle_packet(protocol::unsuback &unsuback);
@@ -194,32 +970,43 @@ private:
             }
         }
     }
-
-    template <int N, class T>
-    auto &get_nth_layer_impl(T &current) {
-        if constexpr (N == 0) {
-            return current;
-        }
-        else {
-            return get_nth_layer_impl<N - 1>(current.next_layer());
+    void notify_connector_receivers(const std::exception_ptr &error) {
+        auto recvs = std::move(connect_receivers_);
+        connect_receivers_.clear();
+        for (auto &&recv : recvs) {
+            recv->set_error(error);
         }
     }
 
 public:
     template <class... Args>
-    client(const net::executor &executor, Args &&... args);
+    client(const executor_type &executor, Args &&... args);
+
+    ~client() {
+        if (keep_alive_watched_) {
+            keep_alive_manager_->unwatch(keep_alive_watch_);
+        }
+    }
 
+    /**
+     * @brief Close the socket, this also stops a supervised connection.
+     */
     void close();
 
-    [[nodiscard]] auto get_executor() {
+    [[nodiscard]] executor_type get_executor() {
         return connection_.get_executor();
     }
 
+    /**
+     * @brief Create a sender connecting the lowest layer to a host.
+     *
+     * Resolved endpoints are cached, see set_endpoint_ttl.
+     */
     [[nodiscard]] auto socket_connector(boost::string_view host, boost::string_view port);
 
     template <int N>
     [[nodiscard]] auto &get_nth_layer() {
-        return get_nth_layer_impl<N>(connection_);
+        return detail::get_nth_layer<N>(connection_);
     }
 
     [[nodiscard]] auto handshaker(connect_options opts) {
@@ -227,6 +1014,62 @@ public:
         return detail::connect_sender{this};
     }
 
+    /**
+     * @brief Create a sender that connects and keeps the connection up.
+     *
+     * Whenever the connection is lost the host is resolved, connected to and
+     * handshaked with again after a jittered exponential backoff, until close() or
+     * disconnector() is used. The backoff starts over once a CONNACK accepts the
+     * connection, one refusing it counts as another failed attempt. Unacknowledged
+     * publishes are resent with DUP set if the server still has the session.
+     * Otherwise they are sent again as new messages and the subscriptions granted so
+     * far are restored.
+     *
+     * While offline, publishes, subscribes and unsubscribes are held and sent once
+     * connected. Publishes are held within reconnect_options::offline_buffer_size.
+     *
+     * Only the lowest layer is reconnected. A stream that needs a handshake of its own,
+     * like TLS, must use the overload taking a stream handshaker.
+     *
+     * Sender value: void, once the first handshake is done
+     * Sender sets done: yes, if supervision stops before the first handshake
+     */
+    [[nodiscard]] auto supervisor(std::string host, std::string port, connect_options opts,
+                                  reconnect_options reconnect = {}) {
+        connect_opts_ = std::move(opts);
+        supervision_.emplace(supervision_t{std::move(host), std::move(port), reconnect,
+                                           detail::backoff(reconnect)});
+        return detail::supervisor_sender<client>{this};
+    }
+
+    /**
+     * @brief Create a supervisor for a stream that needs a handshake of its own.
+     *
+     * stream_handshaker is called after every connect of the lowest layer and returns a
+     * sender doing the handshake of the layers above it, for example
+     * tls_session::handshaker. A failed stream handshake closes the socket and is
+     * retried like a failed connect.
+     */
+    template <class StreamHandshaker>
+    [[nodiscard]] auto supervisor(std::string host, std::string port, connect_options opts,
+                                  reconnect_options reconnect, StreamHandshaker stream_handshaker) {
+        auto retval = supervisor(std::move(host), std::move(port), std::move(opts), reconnect);
+        supervision_->stream_handshake_ = [this, handshaker = std::move(stream_handshaker)]() {
+            p0443_v2::submit(handshaker(), stream_handshake_receiver{this});
+        };
+        return retval;
+    }
+
+    /**
+     * @brief Set how long resolved endpoints are reused by socket_connector.
+     *
+     * Defaults to 60 seconds, zero resolves on every connect. A supervised connection
+     * also resolves again when connecting to the cached endpoints fails.
+     */
+    void set_endpoint_ttl(std::chrono::steady_clock::duration ttl) {
+        endpoints_.set_ttl(ttl);
+    }
+
     template <class Payload, class... Opts>
     [[nodiscard]] auto publisher(std::string topic, Payload &&payload, Opts &&... opts) {
         auto opts_and_modifiers =
@@ -259,6 +1102,71 @@ public:
         return pub;
     }
 
+    /**
+     * @brief Check the keep-alive with a manager shared with other clients.
+     *
+     * Receiving a packet then only records the time instead of re-arming a timer.
+     * Must be set before connecting, the client keeps the manager alive.
+     */
+    void set_keep_alive_manager(std::shared_ptr<keep_alive_manager<executor_type>> manager) {
+        keep_alive_manager_ = std::move(manager);
+    }
+
+    /**
+     * @brief Set the store used to persist the session's in-flight state.
+     *
+     * The stored state is recovered immediately. It is resent after the next
+     * handshake with clean_start set to false if the server reports that the
+     * session is present, and discarded otherwise.
+     */
+    void set_session_store(std::shared_ptr<mqtt5::session_store> store) {
+        session_store_ = std::move(store);
+        stored_session_.reset();
+        if (session_store_) {
+            stored_session_ = session_store_->recover();
+        }
+    }
+
+    /**
+     * @brief Release the acknowledgement of a received publish, safe to call from any thread.
+     *
+     * Only has an effect when connect_options::manual_ack is set. Acks released
+     * before the client executor gets to run are coalesced into a single write.
+     */
+    void release_ack(ack_token token) {
+        if (token.qos == 0_qos) {
+            return;
+        }
+        if (released_acks_.push(token)) {
+            net::post(executor_, [this] { drain_released_acks(); });
+        }
+    }
+
+    /**
+     * @brief Publish a message from any thread.
+     *
+     * The message is pushed onto a lock-free queue that is drained in batches
+     * on the client executor. The executor is only woken up when the queue
+     * goes from empty to non-empty. Completion is not reported back to the caller.
+     */
+    template <class Payload, class... Opts>
+    void submit_publish(std::string topic, Payload &&payload, Opts &&... opts) {
+        protocol::publish pub;
+        pub.topic = std::move(topic);
+        pub.set_payload(std::forward<Payload>(payload));
+        auto opts_and_modifiers =
+            publish_options::detail::separate_options_modifiers(std::forward<Opts>(opts)...);
+        boost::mp11::tuple_for_each(opts_and_modifiers.options, [&](auto &opt) { opt(pub); });
+        boost::mp11::tuple_for_each(opts_and_modifiers.modifiers, [&](auto &mod) { mod(pub); });
+        submit_publish(std::move(pub));
+    }
+
+    void submit_publish(protocol::publish pub) {
+        if (submitted_publishes_.push(std::move(pub))) {
+            net::post(executor_, [this] { drain_submitted_publishes(); });
+        }
+    }
+
     template <class Modifier>
     [[nodiscard]] auto subscriber(std::vector<mqtt5::single_subscription> subs,
                                   Modifier &&modifier) {
@@ -283,6 +1191,83 @@ public:
         return detail::filter_subscribe_sender{this, std::move(topic)};
     }
 
+    /**
+     * @brief Create a persistent stream of publishes matching a topic filter.
+     *
+     * Unlike filtered_subscriber, the stream stays registered until it is cancelled
+     * or destroyed and buffers up to capacity publishes between receives. The
+     * stream must not outlive the client.
+     */
+    [[nodiscard]] mqtt5::subscription_stream<client>
+    stream_subscriber(topic_filter topic, std::size_t capacity = 1024) {
+        return mqtt5::subscription_stream<client>(this, std::move(topic), capacity);
+    }
+
+    /**
+     * @brief Create a channel handing publishes matching a topic filter to a worker thread.
+     *
+     * Publishes are pushed into a wait-free ring of (at least) capacity entries that
+     * a single worker thread consumes. QoS 1 and 2 acknowledgements are sent once the
+     * publish has been accepted into the ring. Must be called on the client executor,
+     * the client must outlive the channel's consumer.
+     */
+    [[nodiscard]] mqtt5::worker_channel worker_subscriber(topic_filter topic,
+                                                          std::size_t capacity = 1024) {
+        auto state = std::make_shared<detail::worker_channel_state>(std::move(topic), capacity);
+        add_worker_channel(state);
+        return mqtt5::worker_channel(std::move(state));
+    }
+
+#ifdef MQTT5_HAS_COROUTINES
+    /**
+     * @brief Awaitable publish.
+     *
+     * The awaiter lives in the coroutine frame and is linked directly into the
+     * client while in flight, so publishing this way does not allocate.
+     *
+     * Await result: std::optional<mqtt5::publish_result>, empty if cancelled
+     * through with_cancellation or dropped by an offline client.
+     */
+    template <class Payload, class... Opts>
+    [[nodiscard]] auto async_publish(std::string topic, Payload &&payload, Opts &&... opts) {
+        protocol::publish pub;
+        pub.topic = std::move(topic);
+        pub.set_payload(std::forward<Payload>(payload));
+        auto opts_and_modifiers =
+            publish_options::detail::separate_options_modifiers(std::forward<Opts>(opts)...);
+        boost::mp11::tuple_for_each(opts_and_modifiers.options, [&](auto &opt) { opt(pub); });
+        boost::mp11::tuple_for_each(opts_and_modifiers.modifiers, [&](auto &mod) { mod(pub); });
+        return detail::publish_awaiter<client>(this, std::move(pub));
+    }
+
+    /**
+     * @brief Awaitable subscribe.
+     *
+     * Await result: std::optional<mqtt5::subscribe_result>, empty if cancelled
+     * through with_cancellation.
+     */
+    [[nodiscard]] auto async_subscribe(std::vector<mqtt5::single_subscription> subs) {
+        return detail::subscribe_awaiter<client>(this, std::move(subs));
+    }
+
+    [[nodiscard]] auto async_subscribe(topic_filter topic, mqtt5::quality_of_service qos) {
+        single_subscription single_sub;
+        single_sub.topic = std::move(topic);
+        single_sub.quality_of_service = qos;
+        return async_subscribe(std::vector<mqtt5::single_subscription>{single_sub});
+    }
+
+    /**
+     * @brief Awaitable receive of the next publish matching a topic filter.
+     *
+     * Await result: std::optional<mqtt5::protocol::publish>, empty if cancelled
+     * through with_cancellation.
+     */
+    [[nodiscard]] auto async_receive(topic_filter topic) {
+        return detail::receive_awaiter<client>(this, std::move(topic));
+    }
+#endif
+
     [[nodiscard]] auto unsubscriber(std::vector<std::string> topics) {
         auto retval = detail::unsubscribe_sender<client>{this};
         retval.unsub.topics = std::move(topics);
@@ -328,6 +1313,8 @@ struct client<Stream>::connection_sm_t
     };
     struct disconnect_evt
     {
+        // Set if the connection was lost because of an error
+        std::exception_ptr error;
     };
 
     struct handshake_done_evt
@@ -375,6 +1362,14 @@ struct client<Stream>::connection_sm_t
         return [](packet_received_evt evt) { return evt.packet->template is<PacketT>(); };
     }
 
+    // A reason code of 0x80 or above refuses the connection
+    auto is_connack(bool accepted) {
+        return [accepted](packet_received_evt evt) {
+            auto *connack = evt.packet->template body_as<protocol::connack>();
+            return connack != nullptr && (connack->reason_code < 0x80) == accepted;
+        };
+    }
+
     template <class PacketT>
     auto packet_handler() {
         return [c = this->client_](packet_received_evt evt) {
@@ -390,7 +1385,20 @@ struct client<Stream>::connection_sm_t
             client_->start_connect_timer();
             client_->send_connect();
         };
-        auto close_socket = [this] { client_->close(); };
+        auto close_socket = [this] { client_->close_socket(); };
+
+        auto connection_lost = [this](const disconnect_evt &evt) {
+            client_->connection_lost(evt.error);
+        };
+
+        auto close_and_reconnect = [this](const disconnect_evt &evt) {
+            client_->close_socket();
+            client_->connection_lost(evt.error);
+        };
+
+        auto connection_refused = [this](packet_received_evt evt) {
+            client_->connection_refused(*evt.packet->template body_as<protocol::connack>());
+        };
 
         auto start_receiving = [this] { client_->receive_one_message(); };
 
@@ -398,10 +1406,11 @@ struct client<Stream>::connection_sm_t
 
         auto start_keep_alive_timer = [this] { client_->start_keep_alive_timer(); };
 
-        auto send_ping = [this] {
-            client_->send_ping();
-            client_->start_ping_timer();
-        };
+        auto keep_alive_packet_received = [this] { client_->keep_alive_packet_received(); };
+
+        auto keep_alive_timer_expired = [this] { client_->keep_alive_timer_expired(); };
+
+        auto ping_timer_expired = [this] { client_->ping_timer_expired(); };
 
         auto stop_ping_timer = [this] { client_->stop_ping_timer(); };
 
@@ -417,9 +1426,11 @@ struct client<Stream>::connection_sm_t
             *idle + sml::event<handshake_evt> = start_handshake,
             start_handshake / ac_start_handshake = handshaking,
 
-            handshaking + sml::event<packet_received_evt>[is_packet<protocol::connack>()] /
+            handshaking + sml::event<packet_received_evt>[is_connack(true)] /
                               packet_handler<protocol::connack>() = connected,
-            handshaking + sml::event<disconnect_evt> / close_socket = idle,
+            handshaking + sml::event<packet_received_evt>[is_connack(false)] /
+                              connection_refused = idle,
+            handshaking + sml::event<disconnect_evt> / close_and_reconnect = idle,
 
             connected + sml::event<packet_received_evt>[is_packet<protocol::puback>()] /
                             packet_handler<protocol::puback>() = connected,
@@ -436,6 +1447,7 @@ struct client<Stream>::connection_sm_t
             connected + sml::event<packet_received_evt>[is_packet<protocol::pubcomp>()] /
                             packet_handler<protocol::pubcomp>() = connected,
             connected + sml::event<puback_sent_evt> / puback_sent_handler = connected,
+            connected + sml::event<disconnect_evt> / connection_lost = idle,
 
             *rx_idle + sml::event<handshake_evt> / start_receiving = rx_receiving,
             rx_receiving + sml::event<packet_received_evt> / start_receiving = rx_receiving,
@@ -443,14 +1455,14 @@ struct client<Stream>::connection_sm_t
 
             *ping_idle + sml::event<handshake_done_evt> / start_ping_timer = ping_waiting,
             ping_waiting + sml::event<disconnect_evt> / stop_ping_timer = ping_idle,
-            ping_waiting + sml::event<ping_timeout_evt> / send_ping = ping_waiting,
+            ping_waiting + sml::event<ping_timeout_evt> / ping_timer_expired = ping_waiting,
 
             *keep_alive_idle + sml::event<handshake_done_evt> / start_keep_alive_timer =
                 keep_alive_waiting,
-            keep_alive_waiting + sml::event<packet_received_evt> / start_keep_alive_timer =
+            keep_alive_waiting + sml::event<packet_received_evt> / keep_alive_packet_received =
+                keep_alive_waiting,
+            keep_alive_waiting + sml::event<keep_alive_timeout_evt> / keep_alive_timer_expired =
                 keep_alive_waiting,
-            keep_alive_waiting + sml::event<keep_alive_timeout_evt> / close_socket =
-                keep_alive_idle,
             keep_alive_waiting + sml::event<disconnect_evt> / stop_keep_alive_timer =
                 keep_alive_idle);
     }
@@ -458,14 +1470,21 @@ struct client<Stream>::connection_sm_t
 
 template <class Stream>
 template <class... Args>
-client<Stream>::client(const net::executor &executor, Args &&... args)
+client<Stream>::client(const executor_type &executor, Args &&... args)
     : executor_(executor), connection_(executor, std::forward<Args>(args)...),
-      connect_and_ping_timer_(executor), keep_alive_timer_(executor),
+      connect_and_ping_timer_(executor), keep_alive_timer_(executor), expiry_timer_(executor),
+      reconnect_timer_(executor),
       connection_sm_(new boost::sml::sm<connection_sm_t>(connection_sm_t{this})) {
 }
 
 template <class Stream>
 void client<Stream>::close() {
+    stop_supervising();
+    close_socket();
+}
+
+template <class Stream>
+void client<Stream>::close_socket() {
     try {
         connection_.lowest_layer().cancel();
     }
@@ -481,7 +1500,8 @@ void client<Stream>::close() {
 template <class Stream>
 auto client<Stream>::socket_connector(boost::string_view host, boost::string_view port) {
     return p0443_v2::transform(
-        p0443_v2::then(p0443_v2::asio::resolve(executor_, host.to_string(), port.to_string()),
+        p0443_v2::then(resolve_sender_type{&endpoints_, executor_, host.to_string(),
+                                           port.to_string()},
                        [this](auto results) {
                            return p0443_v2::asio::connect_socket(connection_.lowest_layer(),
                                                                  results);
@@ -492,6 +1512,7 @@ auto client<Stream>::socket_connector(boost::string_view host, boost::string_vie
 template <class Stream>
 template <class T>
 void client<Stream>::send_message(T &&message) {
+    last_sent_ = std::chrono::steady_clock::now();
     p0443_v2::submit(
         connection_.control_packet_writer(std::forward<T>(message)),
         detail::event_emitting_receiver<client<Stream>,
@@ -509,10 +1530,15 @@ void client<Stream>::receive_one_message() {
         }
 
         void set_done() {
+            this->client_->complete_ready_streams();
             this->client_->connection_sm_->process_event(
                 typename connection_sm_t::disconnect_evt{});
         }
     };
+    if (!connection_.has_buffered_packet()) {
+        // About to wait for the socket, hand out what has been received so far
+        complete_ready_streams();
+    }
     p0443_v2::submit(connection_.control_packet_reader(), receiver{this});
 }
 
@@ -528,26 +1554,79 @@ void client<Stream>::handle_packet(protocol::connack &connack) {
     server_send_quota_ = connack.properties.receive_maximum;
 
     client_receive_quota_ = connect_opts_.receive_maximum;
+    // Acks from an earlier connection must not be sent on this one
+    manual_acks_.clear();
+    pending_acks_.clear();
+    if (!connack.session_present()) {
+        received_qos2_states_.clear();
+    }
+
+    outbound_topic_aliases_.reset(
+        connect_opts_.automatic_topic_alias ? connack.properties.topic_alias_maximum : 0);
 
+    // Taken before the stored session is resumed, which is resent first
+    std::vector<detail::in_flight_publish *> sent;
+    std::vector<detail::in_flight_publish *> queued;
+    if (supervision_) {
+        while (!published_messages_.empty()) {
+            sent.push_back(&published_messages_.pop_front());
+        }
+        while (!queued_publishes_.empty()) {
+            queued.push_back(&queued_publishes_.pop_front());
+        }
+    }
+
+    if (session_store_) {
+        if (!connack.session_present()) {
+            session_store_->clear();
+            stored_session_.reset();
+        }
+        else if (stored_session_) {
+            resume_stored_session();
+        }
+    }
+
+    if (supervision_) {
+        resume_supervised(connack.session_present(), std::move(sent), std::move(queued));
+    }
+
+    // The connect timeout must not fire on an established connection
+    connect_and_ping_timer_.cancel();
     connection_sm_->process_event(typename connection_sm_t::handshake_done_evt{});
     notify_connector_receivers(true);
 }
 
+template <class Stream>
+void client<Stream>::connection_refused(const protocol::connack &connack) {
+    // The session is left as it was, the stored state is needed by the next attempt
+    connect_and_ping_timer_.cancel();
+    close_socket();
+    if (supervision_) {
+        // A failed attempt, the next one waits for the next backoff step
+        schedule_reconnect();
+    }
+    else {
+        notify_connector_receivers(std::make_exception_ptr(
+            connect_error(static_cast<connect_reason_code>(connack.reason_code),
+                          connack.properties.reason_string)));
+    }
+}
+
 template <class Stream>
 void client<Stream>::handle_packet(protocol::puback &puback) {
-    auto iter =
-        std::find_if(published_messages_.begin(), published_messages_.end(), [&](auto &msg) {
-            return puback.packet_identifier == msg.message_.packet_identifier;
-        });
-    if (iter != published_messages_.end()) {
-        detail::in_flight_publish to_finish = std::move(*iter);
-        published_messages_.erase(iter);
-        if (to_finish.state_ == detail::in_flight_publish::state_type::waiting_puback) {
-            to_finish.receiver_->set_value(static_cast<publish_result>(puback.reason_code));
+    auto *to_finish = published_messages_.find_if(
+        [&](auto &msg) { return puback.packet_identifier == msg.message_.packet_identifier; });
+    if (to_finish) {
+        published_messages_.erase(*to_finish);
+        if (session_store_) {
+            session_store_->publish_completed(puback.packet_identifier);
+        }
+        if (to_finish->state_ == detail::in_flight_publish::state_type::waiting_puback) {
+            to_finish->set_value(static_cast<publish_result>(puback.reason_code));
         }
         else {
-            to_finish.receiver_->set_done();
-            close();
+            to_finish->set_done();
+            close_socket();
         }
     }
 
@@ -556,56 +1635,71 @@ void client<Stream>::handle_packet(protocol::puback &puback) {
 
 template <class Stream>
 void client<Stream>::handle_packet(protocol::suback &suback) {
-    auto iter =
-        std::find_if(subscribe_messages_.begin(), subscribe_messages_.end(), [&](auto &msg) {
-            return suback.packet_identifier == msg.message_.packet_identifier;
-        });
-    if (iter != subscribe_messages_.end()) {
-        detail::in_flight_subscribe to_finish = std::move(*iter);
-        subscribe_messages_.erase(iter);
+    auto *to_finish = subscribe_messages_.find_if(
+        [&](auto &msg) { return suback.packet_identifier == msg.message_.packet_identifier; });
+    if (to_finish) {
+        subscribe_messages_.erase(*to_finish);
         mqtt5::subscribe_result result;
         result.codes.reserve(suback.reason_codes.size());
-        for (auto &c : suback.reason_codes) {
-            result.codes.push_back(static_cast<subscribe_result::result_code>(c));
+        auto &topics = to_finish->message_.topics;
+        for (std::size_t i = 0; i < suback.reason_codes.size(); i++) {
+            const auto code = suback.reason_codes[i];
+            result.codes.push_back(static_cast<subscribe_result::result_code>(code));
+            if (code < 0x80 && i < topics.size()) {
+                auto existing = std::find_if(
+                    active_subscriptions_.begin(), active_subscriptions_.end(),
+                    [&](const auto &active) { return active.topic == topics[i].topic; });
+                if (existing != active_subscriptions_.end()) {
+                    *existing = topics[i];
+                }
+                else {
+                    active_subscriptions_.push_back(topics[i]);
+                }
+            }
         }
-        to_finish.receiver_->set_value(std::move(result));
+        to_finish->set_value(std::move(result));
     }
 }
 
 template <class Stream>
 void client<Stream>::handle_packet(protocol::unsuback &unsuback) {
-    auto iter =
-        std::find_if(unsubscribe_messages_.begin(), unsubscribe_messages_.end(), [&](auto &msg) {
-            return unsuback.packet_identifier == msg.message_.packet_identifier;
-        });
-    if (iter != unsubscribe_messages_.end()) {
-        detail::in_flight_unsubscribe to_finish = std::move(*iter);
-        unsubscribe_messages_.erase(iter);
-        to_finish.receiver_->set_value(std::move(unsuback.reason_codes));
+    auto *to_finish = unsubscribe_messages_.find_if(
+        [&](auto &msg) { return unsuback.packet_identifier == msg.message_.packet_identifier; });
+    if (to_finish) {
+        unsubscribe_messages_.erase(*to_finish);
+        for (auto &topic : to_finish->message_.topics) {
+            active_subscriptions_.erase(
+                std::remove_if(active_subscriptions_.begin(), active_subscriptions_.end(),
+                               [&](const auto &active) { return active.topic == topic; }),
+                active_subscriptions_.end());
+        }
+        to_finish->set_value(std::move(unsuback.reason_codes));
     }
 }
 
 template <class Stream>
 void client<Stream>::handle_packet(protocol::publish &publish) {
+    auto *topic = inbound_topic_aliases_.resolve(publish, received_topics_);
+    if (!topic) {
+        abort_connection(mqtt5::disconnect_reason::topic_alias_invalid);
+        return;
+    }
+
     if (publish.quality_of_service() != 0_qos) {
         if (client_receive_quota_ > 0) {
             client_receive_quota_--;
         }
         else {
-            p0443_v2::submit(disconnector(mqtt5::disconnect_reason::quota_exceeded),
-                             p0443_v2::sink_receiver{});
+            abort_connection(mqtt5::disconnect_reason::quota_exceeded);
         }
     }
 
-    bool deliver_to_receivers = true;
-
     if (publish.quality_of_service() == 1_qos) {
-        protocol::puback ack;
-        ack.packet_identifier = publish.packet_identifier;
-        p0443_v2::submit(
-            connection_.control_packet_writer(ack),
-            detail::event_emitting_receiver<client<Stream>,
-                                            typename connection_sm_t::puback_sent_evt>{this});
+        // Held back while a worker channel can't accept the publish
+        detail::held_ack ack{detail::held_ack::kind_type::puback, publish.packet_identifier};
+        if (deliver_to_publish_waiters(*topic, publish, ack)) {
+            send_ack(ack);
+        }
     }
     else if (publish.quality_of_service() == 2_qos) {
         auto iter =
@@ -613,7 +1707,6 @@ void client<Stream>::handle_packet(protocol::publish &publish) {
                          [&](const received_qos2_state &state) {
                              return state.publish_.packet_identifier == publish.packet_identifier;
                          });
-        deliver_to_receivers = false;
         protocol::pubrec rec;
         rec.packet_identifier = publish.packet_identifier;
 
@@ -621,43 +1714,56 @@ void client<Stream>::handle_packet(protocol::publish &publish) {
             received_qos2_state new_state;
             new_state.current_state_ = received_qos2_state::state_type::pubrec_sent;
             new_state.publish_ = std::move(publish);
+            // Delivered on pubrel, the alias may have been remapped by then
+            if (new_state.publish_.topic.empty()) {
+                new_state.publish_.topic = topic->name;
+            }
+            if (session_store_) {
+                session_store_->publish_received(new_state.publish_);
+            }
             received_qos2_states_.emplace_back(std::move(new_state));
         }
         send_message(rec);
     }
-    if (deliver_to_receivers) {
-        deliver_to_publish_waiters(publish);
+    else {
+        deliver_to_publish_waiters(*topic, publish);
     }
 }
 
 template <class Stream>
 void client<Stream>::handle_packet(protocol::pubrec &pubrec) {
-    auto iter =
-        std::find_if(published_messages_.begin(), published_messages_.end(), [&](const auto &msg) {
-            return msg.message_.packet_identifier == pubrec.packet_identifier;
-        });
+    auto *in_flight = published_messages_.find_if([&](const auto &msg) {
+        return msg.message_.packet_identifier == pubrec.packet_identifier;
+    });
     protocol::pubrel response;
     response.packet_identifier = pubrec.packet_identifier;
     bool send_response = true;
 
-    if (iter == published_messages_.end()) {
+    if (!in_flight) {
         response.reason_code = pubrel_reason_code::packet_identifier_not_found;
     }
     else if (pubrec.reason_code > pubrec_reason_code::no_matching_subscribers) {
-        detail::in_flight_publish to_finish = std::move(*iter);
-        published_messages_.erase(iter);
-        to_finish.receiver_->set_value(static_cast<publish_result>(pubrec.reason_code));
+        published_messages_.erase(*in_flight);
+        if (session_store_) {
+            session_store_->publish_completed(pubrec.packet_identifier);
+        }
+        in_flight->set_value(static_cast<publish_result>(pubrec.reason_code));
         send_response = false;
     }
-    else if (iter->state_ == detail::in_flight_publish::state_type::waiting_puback) {
-        detail::in_flight_publish to_finish = std::move(*iter);
-        published_messages_.erase(iter);
-        to_finish.receiver_->set_done();
-        close();
+    else if (in_flight->state_ == detail::in_flight_publish::state_type::waiting_puback) {
+        published_messages_.erase(*in_flight);
+        if (session_store_) {
+            session_store_->publish_completed(pubrec.packet_identifier);
+        }
+        in_flight->set_done();
+        close_socket();
         send_response = false;
     }
     else {
-        iter->state_ = detail::in_flight_publish::state_type::waitiing_pubcomp;
+        in_flight->state_ = detail::in_flight_publish::state_type::waitiing_pubcomp;
+        if (session_store_) {
+            session_store_->publish_released(pubrec.packet_identifier);
+        }
     }
     if (send_response) {
         send_message(response);
@@ -673,34 +1779,156 @@ void client<Stream>::handle_packet(protocol::pubrel &pubrel) {
                      [&](const received_qos2_state &state) {
                          return state.publish_.packet_identifier == pubrel.packet_identifier;
                      });
-    std::optional<protocol::publish> publish;
     if (iter == received_qos2_states_.end()) {
         response.reason_code = pubcomp_reason_code::packet_identifier_not_found;
+        send_message(response);
+        return;
     }
-    else {
-        publish = std::move(iter->publish_);
-        received_qos2_states_.erase(iter);
+    auto publish = std::move(iter->publish_);
+    received_qos2_states_.erase(iter);
+    if (session_store_) {
+        session_store_->receive_completed(pubrel.packet_identifier);
+    }
+
+    // Held back while a worker channel can't accept the publish
+    detail::held_ack ack{detail::held_ack::kind_type::pubcomp, pubrel.packet_identifier};
+    if (deliver_to_publish_waiters(publish, ack)) {
+        send_ack(ack);
     }
-    send_message(response);
-    if (publish) {
-        deliver_to_publish_waiters(*publish);
-    };
 }
 
 template <class Stream>
 void client<Stream>::handle_packet(protocol::pubcomp &pubcomp) {
-    auto iter =
-        std::find_if(published_messages_.begin(), published_messages_.end(),
-                     [&](const detail::in_flight_publish &state) {
-                         return state.message_.packet_identifier == pubcomp.packet_identifier;
-                     });
-    if (iter == published_messages_.end()) {
+    auto *to_finish =
+        published_messages_.find_if([&](const detail::in_flight_publish &state) {
+            return state.message_.packet_identifier == pubcomp.packet_identifier;
+        });
+    if (!to_finish) {
         // Do nothing
     }
     else {
-        detail::in_flight_publish to_finish = std::move(*iter);
-        published_messages_.erase(iter);
-        to_finish.receiver_->set_value(static_cast<publish_result>(pubcomp.reason_code));
+        published_messages_.erase(*to_finish);
+        if (session_store_) {
+            session_store_->publish_completed(pubcomp.packet_identifier);
+        }
+        to_finish->set_value(static_cast<publish_result>(pubcomp.reason_code));
+    }
+}
+
+template <class Stream>
+void client<Stream>::start_reconnect_attempt() {
+    if (!supervision_) {
+        return;
+    }
+    // A partial packet from the lost connection must not be parsed as part of the new one
+    connection_.clear_read_buffer();
+    p0443_v2::submit(socket_connector(supervision_->host_, supervision_->port_),
+                     socket_connected_receiver{this});
+}
+
+template <class Stream>
+void client<Stream>::schedule_reconnect() {
+    p0443_v2::submit(
+        p0443_v2::asio::timer::wait_for(reconnect_timer_, supervision_->backoff_.next()),
+        reconnect_timer_receiver{this});
+}
+
+template <class Stream>
+void client<Stream>::stop_supervising() {
+    if (!supervision_) {
+        return;
+    }
+    const bool online = supervision_->online_;
+    supervision_.reset();
+    reconnect_timer_.cancel();
+    if (online) {
+        return;
+    }
+
+    // Nothing held for the next connection will be sent
+    offline_publishes_.clear();
+    offline_bytes_ = 0;
+    while (!published_messages_.empty()) {
+        published_messages_.pop_front().set_done();
+    }
+    while (!queued_publishes_.empty()) {
+        auto &in_flight = queued_publishes_.pop_front();
+        expiry_wheel_.cancel(in_flight);
+        in_flight.set_done();
+    }
+    while (!subscribe_messages_.empty()) {
+        subscribe_messages_.pop_front().set_done();
+    }
+    while (!unsubscribe_messages_.empty()) {
+        unsubscribe_messages_.pop_front().set_done();
+    }
+    notify_connector_receivers(false);
+}
+
+template <class Stream>
+void client<Stream>::resume_supervised(bool session_present,
+                                       std::vector<detail::in_flight_publish *> sent,
+                                       std::vector<detail::in_flight_publish *> queued) {
+    supervision_->online_ = true;
+    supervision_->backoff_.reset();
+    const bool reconnected = std::exchange(supervision_->connected_before_, true);
+
+    // Subscribes and unsubscribes never acknowledged, or held while offline
+    for (auto &in_flight : subscribe_messages_) {
+        send_message(in_flight.message_);
+    }
+    for (auto &in_flight : unsubscribe_messages_) {
+        send_message(in_flight.message_);
+    }
+    if (reconnected && !session_present && !active_subscriptions_.empty()) {
+        auto *restore = new detail::resubscribe;
+        restore->message_.topics = active_subscriptions_;
+        start_subscribe(*restore);
+    }
+
+    for (auto *in_flight : sent) {
+        if (in_flight->state_ == detail::in_flight_publish::state_type::waitiing_pubcomp) {
+            if (session_present) {
+                if (server_send_quota_ > 0) {
+                    --server_send_quota_;
+                }
+                protocol::pubrel pubrel;
+                pubrel.packet_identifier = in_flight->message_.packet_identifier;
+                send_message(pubrel);
+                published_messages_.push_back(*in_flight);
+            }
+            else {
+                // The server took ownership with its PUBREC, only the PUBCOMP was lost
+                in_flight->set_value(publish_result::success);
+            }
+        }
+        else {
+            in_flight->message_.set_duplicate(session_present);
+            send_or_queue_publish(*in_flight);
+        }
+    }
+    const auto now = expiry_now();
+    for (auto *in_flight : queued) {
+        if (in_flight->is_scheduled() && in_flight->deadline() <= now) {
+            expiry_wheel_.cancel(*in_flight);
+            in_flight->set_done();
+            continue;
+        }
+        send_or_queue_publish(*in_flight);
+    }
+
+    auto offline = std::move(offline_publishes_);
+    offline_publishes_.clear();
+    offline_bytes_ = 0;
+    for (auto &[publish, deadline] : offline) {
+        if (deadline != 0) {
+            if (deadline <= now) {
+                continue;
+            }
+            publish.properties.message_expiry_interval =
+                std::chrono::duration<std::uint32_t>{static_cast<std::uint32_t>(deadline - now)};
+        }
+        send_qos0_publish(std::move(publish));
     }
 }
 
@@ -715,13 +1943,32 @@ void client<Stream>::start_connect_timer() {
 template <class Stream>
 void client<Stream>::start_ping_timer() {
     if (keep_alive_used_.count() > 0) {
+        const auto interval = std::chrono::steady_clock::duration(keep_alive_used_) / 2;
         p0443_v2::submit(
-            p0443_v2::asio::timer::wait_for(connect_and_ping_timer_, keep_alive_used_ / 2),
+            p0443_v2::asio::timer::wait_for(connect_and_ping_timer_, interval),
             detail::event_emitting_receiver<client<Stream>,
                                             typename connection_sm_t::ping_timeout_evt>{this});
     }
 }
 
+template <class Stream>
+void client<Stream>::ping_timer_expired() {
+    if (keep_alive_used_.count() == 0) {
+        return;
+    }
+    const auto remaining = detail::ping_remaining(last_sent_, last_received_, keep_alive_used_,
+                                                  std::chrono::steady_clock::now());
+    if (remaining <= std::chrono::steady_clock::duration::zero()) {
+        send_ping();
+        start_ping_timer();
+        return;
+    }
+    p0443_v2::submit(
+        p0443_v2::asio::timer::wait_for(connect_and_ping_timer_, remaining),
+        detail::event_emitting_receiver<client<Stream>,
+                                        typename connection_sm_t::ping_timeout_evt>{this});
+}
+
 template <class Stream>
 void client<Stream>::stop_ping_timer() {
     connect_and_ping_timer_.cancel();
@@ -729,7 +1976,12 @@ void client<Stream>::stop_ping_timer() {
 
 template <class Stream>
 void client<Stream>::start_keep_alive_timer() {
-    if (keep_alive_used_.count() > 0) {
+    last_received_ = std::chrono::steady_clock::now();
+    if (keep_alive_used_.count() > 0 && keep_alive_manager_) {
+        keep_alive_manager_->watch(keep_alive_watch_, keep_alive_used_);
+        keep_alive_watched_ = true;
+    }
+    else if (keep_alive_used_.count() > 0) {
         p0443_v2::submit(
             p0443_v2::asio::timer::wait_for(keep_alive_timer_, keep_alive_used_),
             detail::event_emitting_receiver<client<Stream>,
@@ -738,8 +1990,39 @@ void client<Stream>::start_keep_alive_timer() {
     }
 }
 
+template <class Stream>
+void client<Stream>::keep_alive_packet_received() {
+    last_received_ = std::chrono::steady_clock::now();
+    if (keep_alive_watched_) {
+        keep_alive_watch_.touch();
+    }
+}
+
+template <class Stream>
+void client<Stream>::keep_alive_timer_expired() {
+    // The shared manager only reports a connection that has been silent long enough.
+    // The socket closing ends in a disconnect_evt, which stops the keep-alive.
+    const auto remaining =
+        keep_alive_manager_
+            ? std::chrono::steady_clock::duration::zero()
+            : detail::keep_alive_remaining(last_received_, keep_alive_used_,
+                                           std::chrono::steady_clock::now());
+    if (remaining <= std::chrono::steady_clock::duration::zero()) {
+        close_socket();
+        return;
+    }
+    p0443_v2::submit(
+        p0443_v2::asio::timer::wait_for(keep_alive_timer_, remaining),
+        detail::event_emitting_receiver<client<Stream>,
+                                        typename connection_sm_t::keep_alive_timeout_evt>{this});
+}
+
 template <class Stream>
 void client<Stream>::stop_keep_alive_timer() {
+    if (keep_alive_watched_) {
+        keep_alive_manager_->unwatch(keep_alive_watch_);
+        keep_alive_watched_ = false;
+    }
     keep_alive_timer_.cancel();
 }
 
@@ -777,8 +2060,14 @@ void client<Stream>::send_connect() {
     connect.client_id = connect_opts_.client_id;
 
     connect.connect_properties.receive_maximum = connect_opts_.receive_maximum;
+    connect.connect_properties.topic_alias_maximum = connect_opts_.topic_alias_maximum;
+    inbound_topic_aliases_.reset(connect_opts_.topic_alias_maximum);
 
-    connect.flags |= connect_opts_.clean_start ? 0 : protocol::connect::clean_start_flag;
+    connect.flags |= connect_opts_.clean_start ? protocol::connect::clean_start_flag : 0;
+    if (connect_opts_.clean_start && session_store_) {
+        session_store_->clear();
+        stored_session_.reset();
+    }
 
     if (!connect_opts_.username.empty()) {
         connect.username = connect_opts_.username;
@@ -0,0 +1,281 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "client.hpp"
+#include "detail/pool_senders.hpp"
+
+#include <boost/utility/string_view.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace mqtt5
+{
+/**
+ * @brief A set of clients, each with its own connection and executor.
+ *
+ * Publishes are distributed over the clients by hashing topic names, a given topic is
+ * always published through the same client, which keeps per-topic ordering.
+ *
+ * Subscriptions are hashed the same way, unless the filter overlaps a subscription
+ * already made through the pool, which puts it on that subscription's client.
+ * Filtered subscribers wait on every client with a subscription overlapping their
+ * filter, since those are the connections the server delivers to. Streams and worker
+ * channels stay on a single client, the one of the first overlapping subscription.
+ *
+ * Each client must only be used from its own executor. The senders returned by the pool
+ * start their operation on the executor of the client they use and complete there, so
+ * they may be started from any thread. Passing one executor per thread (or one strand
+ * per client) lets the pool scale with the number of cores.
+ */
+template <class Stream>
+class client_pool
+{
+public:
+    using client_type = mqtt5::client<Stream>;
+    using executor_type = typename client_type::executor_type;
+
+private:
+    std::vector<std::unique_ptr<client_type>> clients_;
+
+    // Filters subscribed through the pool and the index of their client
+    std::mutex subscriptions_mutex_;
+    std::vector<std::pair<topic_filter, std::size_t>> subscriptions_;
+
+    static std::size_t hash(boost::string_view str) {
+        return std::hash<std::string_view>{}(std::string_view(str.data(), str.size()));
+    }
+
+    std::size_t index_for(boost::string_view topic) const {
+        return hash(topic) % clients_.size();
+    }
+
+    /**
+     * The client of the same filter, or else of the first overlapping one, if it has
+     * been subscribed. Must be called with subscriptions_mutex_ held.
+     */
+    std::size_t index_for_filter(topic_filter &filter) const {
+        auto owner = std::find_if(subscriptions_.begin(), subscriptions_.end(),
+                                  [&](const auto &sub) { return sub.first == filter; });
+        if (owner == subscriptions_.end()) {
+            owner = std::find_if(subscriptions_.begin(), subscriptions_.end(),
+                                 [&](const auto &sub) { return sub.first.overlaps(filter); });
+        }
+        if (owner != subscriptions_.end()) {
+            return owner->second;
+        }
+        return index_for(filter.to_string());
+    }
+
+    /**
+     * The clients of all subscriptions overlapping the filter, or the client the filter
+     * hashes to if there is none. Must be called with subscriptions_mutex_ held.
+     */
+    std::vector<client_type *> clients_for_filter(topic_filter &filter) const {
+        std::vector<bool> overlapping(clients_.size());
+        for (auto &sub : subscriptions_) {
+            if (sub.first == filter || sub.first.overlaps(filter)) {
+                overlapping[sub.second] = true;
+            }
+        }
+        std::vector<client_type *> retval;
+        for (std::size_t i = 0; i < clients_.size(); i++) {
+            if (overlapping[i]) {
+                retval.push_back(clients_[i].get());
+            }
+        }
+        if (retval.empty()) {
+            retval.push_back(clients_[index_for(filter.to_string())].get());
+        }
+        return retval;
+    }
+
+public:
+    /**
+     * @brief Create one client per executor.
+     *
+     * Any extra arguments are passed to each client's stream.
+     */
+    template <class... Args>
+    explicit client_pool(const std::vector<executor_type> &executors, const Args &... args) {
+        assert(!executors.empty());
+        clients_.reserve(executors.size());
+        for (auto &ex : executors) {
+            clients_.emplace_back(std::make_unique<client_type>(ex, args...));
+        }
+    }
+
+    [[nodiscard]] std::size_t size() const {
+        return clients_.size();
+    }
+
+    [[nodiscard]] client_type &operator[](std::size_t index) {
+        return *clients_[index];
+    }
+
+    /**
+     * @brief Get the client publishing to a topic name.
+     */
+    [[nodiscard]] client_type &client_for(boost::string_view topic) {
+        return *clients_[index_for(topic)];
+    }
+
+    /**
+     * @brief Get the client receiving the publishes matching a topic filter.
+     *
+     * This is the client of the first subscription made through the pool that overlaps
+     * the filter, or the client the filter hashes to if there is none.
+     */
+    [[nodiscard]] client_type &client_for_filter(topic_filter filter) {
+        std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+        return *clients_[index_for_filter(filter)];
+    }
+
+    /**
+     * @brief Create a socket connector for the client at index.
+     */
+    [[nodiscard]] auto socket_connector(std::size_t index, boost::string_view host,
+                                        boost::string_view port) {
+        return clients_[index]->socket_connector(host, port);
+    }
+
+    /**
+     * @brief Create a handshaker for the client at index.
+     *
+     * Every connection needs its own client identifier. If a client identifier
+     * is set it is suffixed with "-<index>", otherwise the server assigns one.
+     */
+    [[nodiscard]] auto handshaker(std::size_t index, connect_options opts) {
+        if (!opts.client_id.empty()) {
+            opts.client_id += "-" + std::to_string(index);
+        }
+        return clients_[index]->handshaker(std::move(opts));
+    }
+
+    /**
+     * @brief Create a supervisor for the client at index, see client::supervisor.
+     *
+     * The client identifier is suffixed like for handshaker.
+     */
+    [[nodiscard]] auto supervisor(std::size_t index, std::string host, std::string port,
+                                  connect_options opts, reconnect_options reconnect = {}) {
+        if (!opts.client_id.empty()) {
+            opts.client_id += "-" + std::to_string(index);
+        }
+        return clients_[index]->supervisor(std::move(host), std::move(port), std::move(opts),
+                                           reconnect);
+    }
+
+    template <class StreamHandshaker>
+    [[nodiscard]] auto supervisor(std::size_t index, std::string host, std::string port,
+                                  connect_options opts, reconnect_options reconnect,
+                                  StreamHandshaker stream_handshaker) {
+        if (!opts.client_id.empty()) {
+            opts.client_id += "-" + std::to_string(index);
+        }
+        return clients_[index]->supervisor(std::move(host), std::move(port), std::move(opts),
+                                           reconnect, std::move(stream_handshaker));
+    }
+
+    /**
+     * @brief Publish through the client of the topic, on that client's executor.
+     */
+    template <class Payload, class... Opts>
+    [[nodiscard]] auto publisher(std::string topic, Payload &&payload, Opts &&... opts) {
+        auto &target = client_for(topic);
+        return detail::start_on_sender{target.get_executor(),
+                                       target.publisher(std::move(topic),
+                                                        std::forward<Payload>(payload),
+                                                        std::forward<Opts>(opts)...)};
+    }
+
+    template <class Payload, class... Opts>
+    [[nodiscard]] auto reusable_publisher(std::string topic, Payload &&payload,
+                                          Opts &&... opts) {
+        auto &target = client_for(topic);
+        return detail::start_on_sender{
+            target.get_executor(),
+            target.reusable_publisher(std::move(topic), std::forward<Payload>(payload),
+                                      std::forward<Opts>(opts)...)};
+    }
+
+    /**
+     * @brief Subscribe on the client that already has an overlapping subscription, if any.
+     */
+    [[nodiscard]] auto subscriber(topic_filter topic, mqtt5::quality_of_service qos) {
+        std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+        const auto index = index_for_filter(topic);
+        auto existing = std::find_if(subscriptions_.begin(), subscriptions_.end(),
+                                     [&](const auto &sub) { return sub.first == topic; });
+        if (existing == subscriptions_.end()) {
+            subscriptions_.emplace_back(topic, index);
+        }
+        auto &target = *clients_[index];
+        return detail::start_on_sender{target.get_executor(),
+                                       target.subscriber(std::move(topic), qos)};
+    }
+
+    /**
+     * @brief Wait for the first publish matching the filter on any client receiving it.
+     *
+     * Filtered subscribers are started on every client with an overlapping subscription.
+     */
+    [[nodiscard]] auto filtered_subscriber(topic_filter topic) {
+        std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+        return detail::pool_filter_sender<client_type>{clients_for_filter(topic),
+                                                       std::move(topic)};
+    }
+
+    /**
+     * @brief Create a stream on the client of the first overlapping subscription.
+     *
+     * The stream must only be created and used on that client's executor.
+     */
+    [[nodiscard]] auto stream_subscriber(topic_filter topic, std::size_t capacity = 1024) {
+        return client_for_filter(topic).stream_subscriber(std::move(topic), capacity);
+    }
+
+    /**
+     * @brief Create a worker channel on the client of the first overlapping subscription.
+     *
+     * Must be called on that client's executor, the channel is then read from any thread.
+     */
+    [[nodiscard]] auto worker_subscriber(topic_filter topic, std::size_t capacity = 1024) {
+        return client_for_filter(topic).worker_subscriber(std::move(topic), capacity);
+    }
+
+    /**
+     * @brief Unsubscribe on the client the filter was subscribed on.
+     *
+     * The pool stops routing to the subscription when the unsubscriber is created.
+     */
+    [[nodiscard]] auto unsubscriber(std::string topic) {
+        std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+        topic_filter filter(topic);
+        const auto index = index_for_filter(filter);
+        subscriptions_.erase(std::remove_if(subscriptions_.begin(), subscriptions_.end(),
+                                            [&](const auto &sub) { return sub.first == filter; }),
+                             subscriptions_.end());
+        auto &target = *clients_[index];
+        return detail::start_on_sender{target.get_executor(),
+                                       target.unsubscriber({std::move(topic)})};
+    }
+
+    void close() {
+        for (auto &c : clients_) {
+            c->close();
+        }
+    }
+};
+} // namespace mqtt5
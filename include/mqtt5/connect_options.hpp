@@ -54,6 +54,25 @@ struct connect_options
     std::vector<std::uint8_t> password;
     std::uint16_t receive_maximum=65535;
 
+    /**
+     * Highest topic alias the server may use when sending publishes to the client.
+     * 0 means that the server must not use topic aliases.
+     */
+    std::uint16_t topic_alias_maximum = 0;
+
+    /**
+     * Let the client assign topic aliases to outgoing publishes, within the
+     * topic alias maximum sent by the server.
+     */
+    bool automatic_topic_alias = true;
+
+    /**
+     * Hold back PUBACK and PUBCOMP for received QoS 1 and 2 publishes until the
+     * application releases them with client::release_ack. Publishes nobody receives
+     * are acknowledged right away.
+     */
+    bool manual_ack = false;
+
     bool clean_start = true;
 };
 }
\ No newline at end of file
@@ -0,0 +1,57 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+namespace mqtt5
+{
+enum class connect_reason_code : std::uint8_t {
+    success = 0,
+    unspecified_error = 128,
+    malformed_packet,
+    protocol_error,
+    implementation_specific_error,
+    unsupported_protocol_version,
+    client_identifier_not_valid,
+    bad_username_or_password,
+    not_authorized,
+    server_unavailable,
+    server_busy,
+    banned,
+    bad_authentication_method = 140,
+    topic_name_invalid = 144,
+    packet_too_large = 149,
+    quota_exceeded = 151,
+    payload_format_invalid = 153,
+    retain_not_supported,
+    qos_not_supported,
+    use_another_server,
+    server_moved,
+    connection_rate_exceeded = 159
+};
+
+/**
+ * @brief Error a connect completes with when the server refuses the connection.
+ */
+class connect_error : public std::runtime_error
+{
+    connect_reason_code reason_code_;
+
+public:
+    connect_error(connect_reason_code reason_code, const std::string &reason_string)
+        : std::runtime_error(reason_string.empty() ? "Connection refused by the server"
+                                                   : reason_string),
+          reason_code_(reason_code) {
+    }
+
+    [[nodiscard]] connect_reason_code reason_code() const noexcept {
+        return reason_code_;
+    }
+};
+} // namespace mqtt5
@@ -45,6 +45,19 @@ auto& get_lowest_layer(T& t) {
         return t;
     }
 }
+
+/**
+ * The layer N calls of next_layer() below t, t itself for N == 0.
+ */
+template <int N, class T>
+auto &get_nth_layer(T &t) {
+    if constexpr (N == 0) {
+        return t;
+    }
+    else {
+        return mqtt5::detail::get_nth_layer<N - 1>(t.next_layer());
+    }
+}
 } // namespace detail
 /**
  * @brief An MQTT5 connection object.
@@ -100,6 +113,35 @@ public:
         return stream_.get_executor();
     }
 
+    /**
+     * @brief Check if a complete control packet is already buffered.
+     *
+     * If so the next read completes without waiting for the stream.
+     */
+    [[nodiscard]] bool has_buffered_packet() const {
+        auto data = static_cast<const std::uint8_t *>(read_buffer_.cdata().data());
+        const auto size = read_buffer_.size();
+
+        // Fixed header: type byte followed by a varlen remaining length
+        std::size_t remaining_length = 0;
+        std::size_t multiplier = 1;
+        for (std::size_t i = 1; i < size && i <= 4; i++) {
+            remaining_length += (data[i] & 127) * multiplier;
+            if ((data[i] & 128) == 0) {
+                return size - i - 1 >= remaining_length;
+            }
+            multiplier *= 128;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Discard buffered data, used before the stream is reconnected.
+     */
+    void clear_read_buffer() {
+        read_buffer_.consume(read_buffer_.size());
+    }
+
     /**
      * @brief Create a reader for a complete control packet.
      *
@@ -158,5 +200,27 @@ public:
             },
             std::move(buffer));
     }
+
+    /**
+     * @brief Create a writer for several control packets.
+     *
+     * All packets are serialized into one buffer and written with a single write.
+     *
+     * Sender value: std::size_t
+     * Sender error: std::exception_ptr
+     * Sender sets done: yes
+     */
+    auto control_packets_writer(const std::vector<protocol::control_packet> &packets) {
+        std::vector<std::uint8_t> buffer;
+        for (auto &packet : packets) {
+            packet.serialize([&](auto b) { buffer.push_back(b); });
+        }
+
+        return p0443_v2::with(
+            [this](const auto &buffer) {
+                return p0443_v2::asio::write_all(stream_, boost::asio::buffer(buffer));
+            },
+            std::move(buffer));
+    }
 };
 } // namespace mqtt5
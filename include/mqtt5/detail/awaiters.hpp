@@ -0,0 +1,193 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define MQTT5_HAS_COROUTINES 1
+namespace mqtt5::detail::coro
+{
+using std::coroutine_handle;
+}
+#elif defined(__cpp_coroutines) && __has_include(<experimental/coroutine>)
+#include <experimental/coroutine>
+#define MQTT5_HAS_COROUTINES 1
+namespace mqtt5::detail::coro
+{
+using std::experimental::coroutine_handle;
+}
+#endif
+
+#ifdef MQTT5_HAS_COROUTINES
+
+#include "filter_subscribe_sender.hpp"
+#include "mqtt5/cancellation.hpp"
+#include "publish_sender.hpp"
+#include "subscribe_sender.hpp"
+
+#include <mqtt5/protocol/publish.hpp>
+#include <mqtt5/puback_reason_code.hpp>
+#include <mqtt5/quality_of_service.hpp>
+
+#include <exception>
+#include <optional>
+
+namespace mqtt5::detail
+{
+/**
+ * @brief Stores the outcome of an awaited operation and resumes the awaiting coroutine.
+ *
+ * Awaiters live in the coroutine frame and derive from the in-flight node
+ * that the client links in, so awaiting an operation never allocates. A frame
+ * destroyed while suspended unlinks its awaiter, nothing is resumed.
+ */
+template <class Node, class T>
+struct awaiter_completion : Node
+{
+    coro::coroutine_handle<> continuation_;
+    std::optional<T> result_;
+    std::exception_ptr error_;
+    cancellation_slot slot_;
+
+    awaiter_completion() : Node(this) {
+    }
+
+    void on_value(T value) {
+        slot_.clear();
+        result_.emplace(std::move(value));
+        continuation_.resume();
+    }
+    void on_done() {
+        slot_.clear();
+        continuation_.resume();
+    }
+    void on_error(std::exception_ptr e) {
+        slot_.clear();
+        error_ = std::move(e);
+        continuation_.resume();
+    }
+
+    /**
+     * @return The value the operation completed with, or an empty optional
+     *         if it completed with done, e.g. because it was cancelled.
+     */
+    std::optional<T> await_resume() {
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+        return std::move(result_);
+    }
+};
+
+template <class Client>
+struct publish_awaiter : awaiter_completion<in_flight_publish, mqtt5::publish_result>
+{
+    Client *client_;
+
+    explicit publish_awaiter(Client *client, protocol::publish message) : client_(client) {
+        this->message_ = std::move(message);
+    }
+    publish_awaiter(const publish_awaiter &) = delete;
+    // Only moved before it is awaited, while nothing is linked
+    publish_awaiter(publish_awaiter &&) = default;
+
+    /**
+     * @brief Cancel the publish when the slot's signal is emitted, like
+     * publish_sender::with_cancellation.
+     */
+    publish_awaiter with_cancellation(cancellation_slot slot) && {
+        this->slot_ = slot;
+        return std::move(*this);
+    }
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    bool await_suspend(coro::coroutine_handle<> continuation) {
+        if (this->message_.quality_of_service() == 0_qos) {
+            client_->send_qos0_publish(std::move(this->message_));
+            this->result_ = publish_result::success;
+            return false;
+        }
+        this->continuation_ = continuation;
+        if (this->slot_.is_connected()) {
+            this->slot_.assign([this] { client_->cancel_publish(*this); });
+        }
+        client_->start_publish(*this);
+        return true;
+    }
+};
+
+template <class Client>
+struct subscribe_awaiter : awaiter_completion<in_flight_subscribe, mqtt5::subscribe_result>
+{
+    Client *client_;
+
+    explicit subscribe_awaiter(Client *client, std::vector<single_subscription> subs)
+        : client_(client) {
+        add_subscriptions(this->message_, subs);
+    }
+    subscribe_awaiter(const subscribe_awaiter &) = delete;
+    subscribe_awaiter(subscribe_awaiter &&) = default;
+
+    /**
+     * @brief Cancel the subscribe when the slot's signal is emitted, like
+     * subscribe_sender::with_cancellation.
+     */
+    subscribe_awaiter with_cancellation(cancellation_slot slot) && {
+        this->slot_ = slot;
+        return std::move(*this);
+    }
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    void await_suspend(coro::coroutine_handle<> continuation) {
+        this->continuation_ = continuation;
+        if (this->slot_.is_connected()) {
+            this->slot_.assign([this] { client_->cancel_subscribe(*this); });
+        }
+        client_->start_subscribe(*this);
+    }
+};
+
+template <class Client>
+struct receive_awaiter : awaiter_completion<publish_waiter, protocol::publish>
+{
+    Client *client_;
+    topic_filter filter_;
+
+    explicit receive_awaiter(Client *client, topic_filter filter)
+        : client_(client), filter_(std::move(filter)) {
+    }
+    receive_awaiter(const receive_awaiter &) = delete;
+    receive_awaiter(receive_awaiter &&) = default;
+
+    /**
+     * @brief Stop waiting when the slot's signal is emitted.
+     */
+    receive_awaiter with_cancellation(cancellation_slot slot) && {
+        this->slot_ = slot;
+        return std::move(*this);
+    }
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    void await_suspend(coro::coroutine_handle<> continuation) {
+        this->continuation_ = continuation;
+        if (this->slot_.is_connected()) {
+            this->slot_.assign([this] { client_->cancel_publish_waiter(*this); });
+        }
+        client_->add_publish_waiter(std::move(filter_), *this);
+    }
+};
+} // namespace mqtt5::detail
+
+#endif
@@ -0,0 +1,62 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <mqtt5/reconnect_options.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+namespace mqtt5::detail
+{
+/**
+ * @brief Exponential backoff with jitter.
+ *
+ * Each delay is drawn uniformly from the upper half of the current bound, so
+ * clients that lost their connection at the same time don't reconnect in lockstep
+ * while still waiting at least half the bound.
+ */
+class backoff
+{
+private:
+    using duration = std::chrono::milliseconds;
+
+    duration initial_;
+    duration max_;
+    double multiplier_;
+    duration bound_;
+    std::minstd_rand random_;
+
+public:
+    explicit backoff(const reconnect_options &opts)
+        : initial_(std::max(opts.initial_delay, duration{1})),
+          max_(std::max(opts.max_delay, initial_)), multiplier_(std::max(opts.multiplier, 1.0)),
+          bound_(initial_), random_(std::random_device{}()) {
+    }
+
+    /**
+     * @brief The delay before the next attempt, grows the bound for the one after.
+     */
+    duration next() {
+        std::uniform_int_distribution<duration::rep> dist((bound_.count() + 1) / 2,
+                                                          bound_.count());
+        const duration retval{dist(random_)};
+        const auto grown = static_cast<double>(bound_.count()) * multiplier_;
+        bound_ = grown >= static_cast<double>(max_.count())
+                     ? max_
+                     : duration{static_cast<duration::rep>(grown)};
+        return retval;
+    }
+
+    /**
+     * @brief Start over from the initial delay, called once connected.
+     */
+    void reset() {
+        bound_ = initial_;
+    }
+};
+} // namespace mqtt5::detail
@@ -69,4 +69,36 @@ struct connect_sender
 
 template<class T>
 connect_sender(T*) -> connect_sender<T>;
+
+/**
+ * @brief Starts a supervised connection, completes once the first handshake is done.
+ */
+template <class Client>
+struct supervisor_sender
+{
+    Client *client_;
+
+    template <template <class...> class Tuple, template <class...> class Variant>
+    using value_types = Variant<Tuple<>>;
+
+    template <template <class...> class Variant>
+    using error_types = Variant<std::exception_ptr>;
+
+    static constexpr bool sends_done = true;
+
+    struct operation
+    {
+        Client *client_;
+        void start() {
+            client_->start_reconnect_attempt();
+        }
+    };
+
+    template <class Receiver>
+    auto connect(Receiver &&receiver) {
+        using receiver_t = typename connect_sender<Client>::template receiver_impl<Receiver>;
+        client_->connect_receivers_.emplace_back(new receiver_t{std::move(receiver)});
+        return operation{client_};
+    }
+};
 } // namespace mqtt5::detail
\ No newline at end of file
@@ -0,0 +1,177 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <p0443_v2/set_done.hpp>
+#include <p0443_v2/set_error.hpp>
+#include <p0443_v2/set_value.hpp>
+#include <p0443_v2/type_traits.hpp>
+
+#include <boost/asio/error.hpp>
+#include <boost/asio/ip/basic_resolver.hpp>
+#include <boost/system/system_error.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace mqtt5::detail
+{
+/**
+ * @brief Resolve results kept for a limited time, keyed by host and port.
+ *
+ * A client connects to a handful of hosts at most, so entries are kept in a vector.
+ */
+template <class Results>
+class endpoint_cache
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+private:
+    struct entry
+    {
+        std::string host_;
+        std::string port_;
+        Results results_;
+        clock::time_point expiry_;
+    };
+
+    std::vector<entry> entries_;
+    clock::duration ttl_;
+
+    auto find_entry(const std::string &host, const std::string &port) {
+        return std::find_if(entries_.begin(), entries_.end(), [&](const entry &e) {
+            return e.host_ == host && e.port_ == port;
+        });
+    }
+
+public:
+    explicit endpoint_cache(clock::duration ttl) : ttl_(ttl) {
+    }
+
+    /**
+     * @brief Set how long results are kept, zero disables the cache.
+     */
+    void set_ttl(clock::duration ttl) {
+        ttl_ = ttl;
+        if (ttl_ == clock::duration::zero()) {
+            entries_.clear();
+        }
+    }
+
+    /**
+     * @return The cached results, or nullptr if there are none or they expired.
+     */
+    const Results *find(const std::string &host, const std::string &port, clock::time_point now) {
+        auto iter = find_entry(host, port);
+        if (iter == entries_.end()) {
+            return nullptr;
+        }
+        if (iter->expiry_ <= now) {
+            entries_.erase(iter);
+            return nullptr;
+        }
+        return &iter->results_;
+    }
+
+    void store(const std::string &host, const std::string &port, Results results,
+               clock::time_point now) {
+        if (ttl_ == clock::duration::zero()) {
+            return;
+        }
+        auto iter = find_entry(host, port);
+        if (iter == entries_.end()) {
+            entries_.push_back(entry{host, port, std::move(results), now + ttl_});
+        }
+        else {
+            iter->results_ = std::move(results);
+            iter->expiry_ = now + ttl_;
+        }
+    }
+
+    /**
+     * @brief Drop the results for a host, used when connecting to them failed.
+     */
+    void evict(const std::string &host, const std::string &port) {
+        auto iter = find_entry(host, port);
+        if (iter != entries_.end()) {
+            entries_.erase(iter);
+        }
+    }
+};
+
+/**
+ * @brief Resolves a host, completing immediately with cached results if there are any.
+ *
+ * Sender value: boost::asio::ip::basic_resolver_results<Protocol>
+ * Sender error: std::exception_ptr
+ * Sender sets done: yes, if the resolve is cancelled
+ */
+template <class Protocol, class Executor>
+struct cached_resolve_sender
+{
+    using results_type = boost::asio::ip::basic_resolver_results<Protocol>;
+    using cache_type = endpoint_cache<results_type>;
+
+    template <template <class...> class Tuple, template <class...> class Variant>
+    using value_types = Variant<Tuple<results_type>>;
+
+    template <template <class...> class Variant>
+    using error_types = Variant<std::exception_ptr>;
+
+    static constexpr bool sends_done = true;
+
+    cache_type *cache_;
+    Executor executor_;
+    std::string host_;
+    std::string port_;
+
+    template <class Receiver>
+    struct operation
+    {
+        cache_type *cache_;
+        Executor executor_;
+        std::string host_;
+        std::string port_;
+        Receiver receiver_;
+        std::optional<boost::asio::ip::basic_resolver<Protocol, Executor>> resolver_;
+
+        void start() {
+            if (auto *cached = cache_->find(host_, port_, cache_type::clock::now())) {
+                p0443_v2::set_value(std::move(receiver_), *cached);
+                return;
+            }
+            resolver_.emplace(executor_);
+            resolver_->async_resolve(
+                host_, port_, [this](const boost::system::error_code &ec, results_type results) {
+                    if (ec == boost::asio::error::operation_aborted) {
+                        p0443_v2::set_done(std::move(receiver_));
+                    }
+                    else if (ec) {
+                        p0443_v2::set_error(
+                            std::move(receiver_),
+                            std::make_exception_ptr(boost::system::system_error(ec)));
+                    }
+                    else {
+                        cache_->store(host_, port_, results, cache_type::clock::now());
+                        p0443_v2::set_value(std::move(receiver_), std::move(results));
+                    }
+                });
+        }
+    };
+
+    template <class Receiver>
+    auto connect(Receiver &&receiver) {
+        return operation<p0443_v2::remove_cvref_t<Receiver>>{cache_, executor_, std::move(host_),
+                                                             std::move(port_),
+                                                             std::forward<Receiver>(receiver)};
+    }
+};
+} // namespace mqtt5::detail
@@ -6,10 +6,29 @@
 
 #pragma once
 
+#include <boost/system/error_code.hpp>
+#include <boost/system/system_error.hpp>
+
 #include <exception>
+#include <type_traits>
+#include <utility>
 
 namespace mqtt5::detail
 {
+template <class E>
+std::exception_ptr to_exception_ptr(E &&e) {
+    using error_type = std::decay_t<E>;
+    if constexpr (std::is_same_v<error_type, std::exception_ptr>) {
+        return std::forward<E>(e);
+    }
+    else if constexpr (std::is_same_v<error_type, boost::system::error_code>) {
+        return std::make_exception_ptr(boost::system::system_error(e));
+    }
+    else {
+        return std::make_exception_ptr(std::forward<E>(e));
+    }
+}
+
 template<class Client>
 struct event_emitting_receiver_base
 {
@@ -19,10 +38,15 @@ struct event_emitting_receiver_base
 
     void set_done() {
     }
+
+    /**
+     * An error on a read, write or timer loses the connection, the error is handed to
+     * the operations waiting on it.
+     */
     template <class E>
     void set_error(E &&e) {
-        // Do this more graceful!
-        std::terminate();
+        client_->connection_sm_->process_event(
+            typename Client::connection_sm_t::disconnect_evt{to_exception_ptr(std::forward<E>(e))});
     }
 };
 
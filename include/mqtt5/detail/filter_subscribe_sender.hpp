@@ -6,7 +6,11 @@
 
 #pragma once
 
+#include "intrusive_list.hpp"
+#include "mqtt5/cancellation.hpp"
 #include "message_receiver_base.hpp"
+#include "subscription_stream.hpp"
+#include "worker_channel.hpp"
 #include <exception>
 #include <mqtt5/protocol/publish.hpp>
 #include <mqtt5/topic_filter.hpp>
@@ -17,11 +21,39 @@
 
 namespace mqtt5::detail
 {
+struct filtered_subscription;
+
+struct publish_waiter : operation_completion<protocol::publish>,
+                        intrusive_list_node<publish_waiter>
+{
+    // The subscription the waiter is linked into
+    filtered_subscription *subscription_ = nullptr;
+    // Taken out of its subscription to be completed with a matching publish
+    bool delivering_ = false;
+    // Cancelled while delivering, completed with done instead
+    bool cancelled_ = false;
+
+    template <class Derived>
+    explicit publish_waiter(Derived *self) : operation_completion(self) {
+    }
+};
+
 struct filtered_subscription
 {
-    using receiver_type = detail::message_receiver_base<protocol::publish>;
+    using receiver_type = publish_waiter;
     topic_filter filter_;
-    std::vector<std::unique_ptr<receiver_type>> receivers_;
+    // Position in the client's list of subscriptions
+    std::size_t index_ = 0;
+    // One-shot receivers, removed when a matching publish is delivered
+    intrusive_list<receiver_type> receivers_;
+    // Persistent streams, stay linked until cancelled
+    intrusive_list<subscription_stream_state> streams_;
+    // Worker channels, stay linked until closed
+    intrusive_list<worker_channel_state> workers_;
+
+    [[nodiscard]] bool persistent() const noexcept {
+        return !streams_.empty() || !workers_.empty();
+    }
 };
 
 template <class Client>
@@ -37,51 +69,56 @@ struct filter_subscribe_sender
 
     Client *client_;
     topic_filter filter_;
+    cancellation_slot slot_;
+
+    /**
+     * @brief Stop waiting when the slot's signal is emitted, the operation completes
+     * with done.
+     */
+    [[nodiscard]] filter_subscribe_sender with_cancellation(cancellation_slot slot) && {
+        slot_ = slot;
+        return std::move(*this);
+    }
 
     template <class Receiver>
-    struct operation
+    struct operation: filtered_subscription::receiver_type
     {
         Client *client_;
         topic_filter filter_;
         Receiver receiver_;
+        cancellation_slot slot_;
 
-        struct receiver: filtered_subscription::receiver_type
-        {
-            Receiver receiver_;
-
-            receiver(Receiver recv): receiver_(std::move(recv)) {}
+        operation(Client *client, topic_filter filter, Receiver receiver, cancellation_slot slot)
+            : filtered_subscription::receiver_type(this), client_(client),
+              filter_(std::move(filter)), receiver_(std::move(receiver)), slot_(slot) {
+        }
 
-            void set_value(protocol::publish pub) override {
-                p0443_v2::set_value(std::move(receiver_), std::move(pub));
-            }
-            void set_done() override {
-                p0443_v2::set_done(std::move(receiver_));
-            }
-            void set_error(std::exception_ptr ex) override {
-                p0443_v2::set_error(std::move(receiver_), std::move(ex));
-            }
-        };
+        void on_value(protocol::publish pub) {
+            slot_.clear();
+            p0443_v2::set_value(std::move(receiver_), std::move(pub));
+        }
+        void on_done() {
+            slot_.clear();
+            p0443_v2::set_done(std::move(receiver_));
+        }
+        void on_error(std::exception_ptr ex) {
+            slot_.clear();
+            p0443_v2::set_error(std::move(receiver_), std::move(ex));
+        }
 
         void start() {
-            auto existing_item = std::find_if(
-                client_->publish_waiters_.begin(), client_->publish_waiters_.end(),
-                [this](const filtered_subscription &item) { return item.filter_ == filter_; });
-            if(existing_item != client_->publish_waiters_.end()) {
-                existing_item->receivers_.emplace_back(std::make_unique<receiver>(std::move(receiver_)));
-            }
-            else {
-                filtered_subscription new_item;
-                new_item.filter_ = std::move(filter_);
-                new_item.receivers_.emplace_back(std::make_unique<receiver>(std::move(receiver_)));
-                client_->publish_waiters_.emplace_back(std::move(new_item));
+            if (slot_.is_connected()) {
+                slot_.assign([this] { client_->cancel_publish_waiter(*this); });
             }
+            client_->add_publish_waiter(std::move(filter_), *this);
         }
     };
 
     template<class Receiver>
     auto connect(Receiver&& rx) {
         using receiver_t = p0443_v2::remove_cvref_t<Receiver>;
-        return operation<receiver_t>{client_, std::move(filter_), std::forward<Receiver>(rx)};
+        return operation<receiver_t>{client_, std::move(filter_), std::forward<Receiver>(rx),
+                                     slot_};
     }
 };
 template<class T>
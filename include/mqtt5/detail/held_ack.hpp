@@ -0,0 +1,122 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "mqtt5/ack_token.hpp"
+#include "mqtt5/protocol/control_packet.hpp"
+#include "mqtt5/quality_of_service.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace mqtt5::detail
+{
+/**
+ * @brief An acknowledgement held back until every worker channel accepted the publish.
+ */
+struct held_ack
+{
+    enum class kind_type { none, puback, pubcomp };
+    kind_type kind_ = kind_type::none;
+    std::uint16_t packet_identifier_ = 0;
+    std::size_t remaining_ = 0;
+};
+
+/**
+ * @brief Acks of publishes handed to the application with manual_ack, held until
+ * their tokens are released.
+ */
+class manual_ack_table
+{
+private:
+    std::vector<std::shared_ptr<held_ack>> acks_;
+
+public:
+    void hold(std::shared_ptr<held_ack> ack) {
+        acks_.emplace_back(std::move(ack));
+    }
+
+    /**
+     * @brief Take the ack a token was handed out for.
+     *
+     * @return The ack, or nullptr if the token is unknown or was already released.
+     */
+    std::shared_ptr<held_ack> release(const ack_token &token) {
+        const auto kind =
+            token.qos == 1_qos ? held_ack::kind_type::puback : held_ack::kind_type::pubcomp;
+        auto held = std::find_if(acks_.begin(), acks_.end(), [&](const auto &ack) {
+            return ack->packet_identifier_ == token.packet_identifier && ack->kind_ == kind;
+        });
+        if (held == acks_.end()) {
+            return nullptr;
+        }
+        auto retval = std::move(*held);
+        acks_.erase(held);
+        return retval;
+    }
+
+    void clear() {
+        acks_.clear();
+    }
+
+    [[nodiscard]] std::size_t size() const {
+        return acks_.size();
+    }
+};
+
+/**
+ * @brief PUBACK and PUBCOMP packets collected to be written together.
+ */
+class ack_batch
+{
+private:
+    std::vector<protocol::control_packet> packets_;
+
+public:
+    /**
+     * @brief Add the packet acknowledging ack, does nothing for an ack of kind none.
+     *
+     * @return true if this started a new batch, which must then be flushed.
+     */
+    bool add(const held_ack &ack) {
+        if (ack.kind_ == held_ack::kind_type::none) {
+            return false;
+        }
+        const bool first = packets_.empty();
+        if (ack.kind_ == held_ack::kind_type::puback) {
+            protocol::puback puback;
+            puback.packet_identifier = ack.packet_identifier_;
+            packets_.emplace_back(std::move(puback));
+        }
+        else {
+            protocol::pubcomp pubcomp;
+            pubcomp.packet_identifier = ack.packet_identifier_;
+            packets_.emplace_back(std::move(pubcomp));
+        }
+        return first;
+    }
+
+    /**
+     * @brief Take every packet added since the last call, in the order they were added.
+     */
+    std::vector<protocol::control_packet> take() {
+        auto retval = std::move(packets_);
+        packets_.clear();
+        return retval;
+    }
+
+    void clear() {
+        packets_.clear();
+    }
+
+    [[nodiscard]] bool empty() const {
+        return packets_.empty();
+    }
+};
+} // namespace mqtt5::detail
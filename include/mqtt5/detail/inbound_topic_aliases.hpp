@@ -0,0 +1,105 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "topic_intern_table.hpp"
+#include <mqtt5/protocol/publish.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace mqtt5::detail
+{
+/**
+ * @brief Resolves topic aliases on incoming publishes.
+ *
+ * The table is indexed directly by alias number and sized by the
+ * topic alias maximum the client sent in CONNECT. Entries are interned
+ * topics, an aliased publish is matched without looking its topic up again.
+ */
+class inbound_topic_aliases
+{
+private:
+    std::vector<std::shared_ptr<interned_topic>> topics_;
+
+    /**
+     * Updates or looks up the entry of an aliased publish, nullptr on a protocol error.
+     */
+    template <class Intern>
+    interned_topic *resolve_alias(const protocol::publish &publish, Intern &&intern) {
+        const auto alias = publish.properties.topic_alias;
+        if (alias > topics_.size()) {
+            return nullptr;
+        }
+        auto &entry = topics_[alias - 1];
+        if (!publish.topic.empty()) {
+            entry = intern(publish.topic);
+        }
+        return entry.get();
+    }
+
+public:
+    /**
+     * @brief Clears all aliases and sets a new maximum.
+     *
+     * Must be called for each new CONNECT.
+     */
+    void reset(std::uint16_t maximum) {
+        topics_.clear();
+        topics_.resize(maximum);
+    }
+
+    [[nodiscard]] std::uint16_t maximum() const {
+        return static_cast<std::uint16_t>(topics_.size());
+    }
+
+    /**
+     * @brief Resolves the interned topic of a received publish.
+     *
+     * A publish carrying both topic and alias updates the table. The topic of a publish
+     * with only an alias is left empty, it is the returned topic's name.
+     *
+     * @return nullptr if the topic is missing or the alias is out of range or unknown,
+     *         which is a protocol error.
+     */
+    [[nodiscard]] interned_topic *resolve(const protocol::publish &publish,
+                                          topic_intern_table &topics) {
+        if (publish.properties.topic_alias == 0) {
+            return publish.topic.empty() ? nullptr : &topics.intern(publish.topic);
+        }
+        return resolve_alias(publish, [&](const std::string &name) {
+            return topics.intern_shared(name);
+        });
+    }
+
+    /**
+     * @brief Resolves the topic of a received publish, filling it in for a publish with
+     *        only an alias.
+     *
+     * @return false if the topic is missing or the alias is out of range or unknown,
+     *         which is a protocol error.
+     */
+    [[nodiscard]] bool resolve(protocol::publish &publish) {
+        if (publish.properties.topic_alias == 0) {
+            return !publish.topic.empty();
+        }
+        const auto *topic = resolve_alias(publish, [](const std::string &name) {
+            return std::make_shared<interned_topic>(name,
+                                                    std::hash<std::string_view>{}(name));
+        });
+        if (!topic) {
+            return false;
+        }
+        if (publish.topic.empty()) {
+            publish.topic = topic->name;
+        }
+        return true;
+    }
+};
+} // namespace mqtt5::detail
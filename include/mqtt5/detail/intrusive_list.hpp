@@ -0,0 +1,253 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <utility>
+
+namespace mqtt5::detail
+{
+template <class T>
+class intrusive_list;
+
+/**
+ * @brief Base class for objects that can be linked into an intrusive_list.
+ *
+ * Copying or moving a node never copies its links, the new node is always unlinked.
+ * A node destroyed while it is linked unlinks itself, for example the operation state
+ * of an abandoned operation.
+ */
+template <class T>
+class intrusive_list_node
+{
+private:
+    friend class intrusive_list<T>;
+    intrusive_list_node *next_node_ = nullptr;
+    intrusive_list_node *prev_node_ = nullptr;
+    // The list the node is linked into
+    intrusive_list<T> *list_ = nullptr;
+
+public:
+    intrusive_list_node() = default;
+    intrusive_list_node(const intrusive_list_node &) noexcept {
+    }
+    intrusive_list_node &operator=(const intrusive_list_node &) noexcept {
+        return *this;
+    }
+    ~intrusive_list_node() {
+        if (list_) {
+            list_->unlink(*this);
+        }
+    }
+
+    [[nodiscard]] bool is_linked() const noexcept {
+        return list_ != nullptr;
+    }
+};
+
+/**
+ * @brief Doubly linked list of nodes owned by someone else.
+ *
+ * Insertion and removal are O(1) and never allocate. The list never owns its nodes.
+ * Nodes point back at their list, so moving a list is linear in its size. Nodes still
+ * linked when the list is destroyed are unlinked.
+ */
+template <class T>
+class intrusive_list
+{
+private:
+    using node_type = intrusive_list_node<T>;
+    friend class intrusive_list_node<T>;
+
+    node_type *head_ = nullptr;
+    node_type *tail_ = nullptr;
+    std::size_t size_ = 0;
+
+    static node_type &node(T &t) noexcept {
+        return static_cast<node_type &>(t);
+    }
+
+    static T &value(node_type &n) noexcept {
+        return static_cast<T &>(n);
+    }
+
+    void adopt() noexcept {
+        for (auto *current = head_; current; current = current->next_node_) {
+            current->list_ = this;
+        }
+    }
+
+    // Works on the node alone, it may be unlinked from its destructor
+    void unlink(node_type &n) noexcept {
+        assert(n.list_ == this);
+        if (n.prev_node_) {
+            n.prev_node_->next_node_ = n.next_node_;
+        }
+        else {
+            head_ = n.next_node_;
+        }
+        if (n.next_node_) {
+            n.next_node_->prev_node_ = n.prev_node_;
+        }
+        else {
+            tail_ = n.prev_node_;
+        }
+        n.next_node_ = n.prev_node_ = nullptr;
+        n.list_ = nullptr;
+        size_--;
+    }
+
+public:
+    class iterator
+    {
+        node_type *current_;
+
+    public:
+        explicit iterator(node_type *current) : current_(current) {
+        }
+        T &operator*() const {
+            return value(*current_);
+        }
+        T *operator->() const {
+            return &value(*current_);
+        }
+        iterator &operator++() {
+            current_ = current_->next_node_;
+            return *this;
+        }
+        friend bool operator==(const iterator &lhs, const iterator &rhs) {
+            return lhs.current_ == rhs.current_;
+        }
+        friend bool operator!=(const iterator &lhs, const iterator &rhs) {
+            return lhs.current_ != rhs.current_;
+        }
+    };
+
+    intrusive_list() = default;
+    intrusive_list(const intrusive_list &) = delete;
+    intrusive_list &operator=(const intrusive_list &) = delete;
+
+    intrusive_list(intrusive_list &&rhs) noexcept
+        : head_(std::exchange(rhs.head_, nullptr)), tail_(std::exchange(rhs.tail_, nullptr)),
+          size_(std::exchange(rhs.size_, 0)) {
+        adopt();
+    }
+    intrusive_list &operator=(intrusive_list &&rhs) noexcept {
+        if (this != &rhs) {
+            assert(empty());
+            head_ = std::exchange(rhs.head_, nullptr);
+            tail_ = std::exchange(rhs.tail_, nullptr);
+            size_ = std::exchange(rhs.size_, 0);
+            adopt();
+        }
+        return *this;
+    }
+
+    ~intrusive_list() {
+        clear();
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return head_ == nullptr;
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept {
+        return size_;
+    }
+
+    T &front() noexcept {
+        assert(head_);
+        return value(*head_);
+    }
+
+    iterator begin() noexcept {
+        return iterator{head_};
+    }
+
+    iterator end() noexcept {
+        return iterator{nullptr};
+    }
+
+    void push_back(T &t) noexcept {
+        auto &n = node(t);
+        assert(!n.list_);
+        n.list_ = this;
+        n.prev_node_ = tail_;
+        n.next_node_ = nullptr;
+        if (tail_) {
+            tail_->next_node_ = &n;
+        }
+        else {
+            head_ = &n;
+        }
+        tail_ = &n;
+        size_++;
+    }
+
+    /**
+     * @brief Unlink a node, which must be linked into this list.
+     */
+    void erase(T &t) noexcept {
+        unlink(node(t));
+    }
+
+    /**
+     * @brief Unlink all nodes.
+     */
+    void clear() noexcept {
+        while (head_) {
+            unlink(*head_);
+        }
+    }
+
+    /**
+     * @brief Put an unlinked node in the place of a node linked into this list.
+     */
+    void replace(T &old_node, T &new_node) noexcept {
+        auto &o = node(old_node);
+        auto &n = node(new_node);
+        assert(o.list_ == this && !n.list_);
+        n.prev_node_ = std::exchange(o.prev_node_, nullptr);
+        n.next_node_ = std::exchange(o.next_node_, nullptr);
+        if (n.prev_node_) {
+            n.prev_node_->next_node_ = &n;
+        }
+        else {
+            head_ = &n;
+        }
+        if (n.next_node_) {
+            n.next_node_->prev_node_ = &n;
+        }
+        else {
+            tail_ = &n;
+        }
+        o.list_ = nullptr;
+        n.list_ = this;
+    }
+
+    T &pop_front() noexcept {
+        auto &retval = front();
+        erase(retval);
+        return retval;
+    }
+
+    /**
+     * @brief Find the first node matching a predicate.
+     *
+     * @return Pointer to the node, or nullptr if no node matches.
+     */
+    template <class Pred>
+    T *find_if(Pred &&pred) noexcept(noexcept(pred(std::declval<T &>()))) {
+        for (auto *current = head_; current; current = current->next_node_) {
+            if (pred(value(*current))) {
+                return &value(*current);
+            }
+        }
+        return nullptr;
+    }
+};
+} // namespace mqtt5::detail
@@ -0,0 +1,40 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+
+namespace mqtt5::detail
+{
+using keep_alive_clock = std::chrono::steady_clock;
+
+/**
+ * @brief Time left before a connection last receiving at last_received times out.
+ *
+ * @return Zero or less once the keep-alive has run out.
+ */
+inline keep_alive_clock::duration keep_alive_remaining(keep_alive_clock::time_point last_received,
+                                                       keep_alive_clock::duration keep_alive,
+                                                       keep_alive_clock::time_point now) {
+    return last_received + keep_alive - now;
+}
+
+/**
+ * @brief Time left before a PINGREQ has to be sent.
+ *
+ * Traffic both ways within half the keep-alive makes a ping unnecessary. Inbound
+ * traffic is needed too, the server may have nothing else to answer with.
+ *
+ * @return Zero or less if a ping is due now.
+ */
+inline keep_alive_clock::duration ping_remaining(keep_alive_clock::time_point last_sent,
+                                                 keep_alive_clock::time_point last_received,
+                                                 keep_alive_clock::duration keep_alive,
+                                                 keep_alive_clock::time_point now) {
+    return std::min(last_sent, last_received) + keep_alive / 2 - now;
+}
+} // namespace mqtt5::detail
@@ -1,4 +1,3 @@
-
 //          Copyright Andreas Wass 2004 - 2020.
 // Distributed under the Boost Software License, Version 1.0.
 //    (See accompanying file LICENSE or copy at
@@ -7,6 +6,7 @@
 #pragma once
 
 #include <exception>
+#include <utility>
 
 namespace mqtt5::detail
 {
@@ -19,4 +19,45 @@ struct message_receiver_base
     virtual void set_done() = 0;
     virtual void set_error(std::exception_ptr) = 0;
 };
-}
\ No newline at end of file
+
+/**
+ * @brief Completion of an operation state that is linked into the client.
+ *
+ * The operation deriving from it provides on_value, on_done and on_error, which are
+ * bound to plain function pointers when it is constructed. Completing the node is a
+ * single indirect call and the node has no vtable.
+ */
+template <class... Values>
+class operation_completion
+{
+private:
+    void (*value_)(operation_completion &, Values...);
+    void (*done_)(operation_completion &);
+    void (*error_)(operation_completion &, std::exception_ptr);
+
+protected:
+    template <class Derived>
+    explicit operation_completion(Derived *) noexcept
+        : value_([](operation_completion &self, Values... values) {
+              static_cast<Derived &>(self).on_value(std::move(values)...);
+          }),
+          done_([](operation_completion &self) { static_cast<Derived &>(self).on_done(); }),
+          error_([](operation_completion &self, std::exception_ptr e) {
+              static_cast<Derived &>(self).on_error(std::move(e));
+          }) {
+    }
+
+    ~operation_completion() = default;
+
+public:
+    void set_value(Values... values) {
+        value_(*this, std::move(values)...);
+    }
+    void set_done() {
+        done_(*this);
+    }
+    void set_error(std::exception_ptr e) {
+        error_(*this, std::move(e));
+    }
+};
+}
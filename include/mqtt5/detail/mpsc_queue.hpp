@@ -0,0 +1,105 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+namespace mqtt5::detail
+{
+/**
+ * @brief Lock-free multi-producer, single-consumer queue.
+ *
+ * Producers push onto an atomic list head. The consumer takes the whole list
+ * in one exchange and processes it in push order, so items are always
+ * drained in batches.
+ */
+template <class T>
+class mpsc_queue
+{
+private:
+    struct node
+    {
+        T value;
+        node *next;
+    };
+
+    std::atomic<node *> head_{nullptr};
+
+    static void delete_list(node *n) {
+        while (n) {
+            auto *next = n->next;
+            delete n;
+            n = next;
+        }
+    }
+
+public:
+    mpsc_queue() = default;
+    mpsc_queue(const mpsc_queue &) = delete;
+    mpsc_queue &operator=(const mpsc_queue &) = delete;
+
+    ~mpsc_queue() {
+        delete_list(head_.exchange(nullptr, std::memory_order_acquire));
+    }
+
+    /**
+     * @brief Push a value, safe to call from any thread.
+     *
+     * @return true if the queue was empty before the push, meaning the consumer
+     *         must be woken up.
+     */
+    bool push(T value) {
+        auto *new_node = new node{std::move(value), head_.load(std::memory_order_relaxed)};
+        while (!head_.compare_exchange_weak(new_node->next, new_node, std::memory_order_release,
+                                            std::memory_order_relaxed)) {
+        }
+        return new_node->next == nullptr;
+    }
+
+    /**
+     * @brief Take all currently queued values and pass them to fn in push order.
+     *
+     * Must only be called by the single consumer.
+     *
+     * @return Number of values consumed.
+     */
+    template <class Fn>
+    std::size_t consume_all(Fn &&fn) {
+        node *list = head_.exchange(nullptr, std::memory_order_acquire);
+
+        // The list is newest first, reverse it to get push order
+        node *in_order = nullptr;
+        while (list) {
+            auto *next = list->next;
+            list->next = in_order;
+            in_order = list;
+            list = next;
+        }
+
+        std::size_t count = 0;
+        while (in_order) {
+            auto *next = in_order->next;
+            try {
+                fn(std::move(in_order->value));
+            }
+            catch (...) {
+                delete in_order;
+                delete_list(next);
+                throw;
+            }
+            delete in_order;
+            in_order = next;
+            count++;
+        }
+        return count;
+    }
+
+    [[nodiscard]] bool empty() const {
+        return head_.load(std::memory_order_acquire) == nullptr;
+    }
+};
+} // namespace mqtt5::detail
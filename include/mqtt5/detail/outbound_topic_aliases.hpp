@@ -0,0 +1,141 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <mqtt5/protocol/publish.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace mqtt5::detail
+{
+/**
+ * @brief Assigns topic aliases to outgoing publishes.
+ *
+ * Keeps a least-recently-used map from topic name to topic alias, limited
+ * by the topic alias maximum the server sent in CONNACK. The full topic is only
+ * sent the first time an alias is used for a topic, or when the alias has been
+ * evicted and reassigned to a new topic.
+ */
+class outbound_topic_aliases
+{
+private:
+    struct entry
+    {
+        std::string topic;
+        std::uint16_t alias;
+    };
+
+    // Most recently used entry first.
+    std::list<entry> lru_;
+    // Keys point into the topic strings owned by lru_
+    std::unordered_map<std::string_view, std::list<entry>::iterator> lookup_;
+    // Aliases that the application has assigned explicitly, never handed out automatically.
+    std::vector<bool> reserved_;
+    std::uint16_t next_alias_ = 1;
+    std::uint16_t maximum_ = 0;
+
+    void reserve(std::uint16_t alias) {
+        if (alias > maximum_ || reserved_[alias]) {
+            return;
+        }
+        reserved_[alias] = true;
+        auto iter = std::find_if(lru_.begin(), lru_.end(),
+                                 [alias](const entry &e) { return e.alias == alias; });
+        if (iter != lru_.end()) {
+            lookup_.erase(iter->topic);
+            lru_.erase(iter);
+        }
+    }
+
+    std::uint16_t allocate() {
+        while (next_alias_ != 0 && next_alias_ <= maximum_) {
+            auto alias = next_alias_++;
+            if (!reserved_[alias]) {
+                return alias;
+            }
+        }
+        return 0;
+    }
+
+public:
+    /**
+     * @brief Clears all aliases and sets a new maximum.
+     *
+     * Aliases are only valid for the lifetime of a network connection so
+     * this must be called for each new CONNACK.
+     */
+    void reset(std::uint16_t maximum) {
+        lookup_.clear();
+        lru_.clear();
+        reserved_.assign(std::size_t{maximum} + 1, false);
+        next_alias_ = 1;
+        maximum_ = maximum;
+    }
+
+    [[nodiscard]] std::uint16_t maximum() const {
+        return maximum_;
+    }
+
+    [[nodiscard]] std::size_t size() const {
+        return lru_.size();
+    }
+
+    /**
+     * @brief Applies a topic alias to a publish that is about to be sent.
+     *
+     * If the publish already carries an explicit alias it is sent as is, and that
+     * alias is never handed out automatically until the next reset.
+     *
+     * @return true if the publish was modified.
+     */
+    bool apply(protocol::publish &publish) {
+        if (maximum_ == 0) {
+            return false;
+        }
+        if (publish.properties.topic_alias != 0) {
+            reserve(publish.properties.topic_alias);
+            return false;
+        }
+        if (publish.topic.empty()) {
+            return false;
+        }
+
+        auto existing = lookup_.find(publish.topic);
+        if (existing != lookup_.end()) {
+            lru_.splice(lru_.begin(), lru_, existing->second);
+            publish.properties.topic_alias = existing->second->alias;
+            publish.topic.clear();
+            return true;
+        }
+
+        std::uint16_t alias = allocate();
+        if (alias != 0) {
+            lru_.emplace_front(entry{publish.topic, alias});
+        }
+        else if (lru_.empty()) {
+            // Every alias is reserved by the application
+            return false;
+        }
+        else {
+            // Reuse the least recently used alias for the new topic
+            lookup_.erase(lru_.back().topic);
+            lru_.splice(lru_.begin(), lru_, std::prev(lru_.end()));
+            lru_.front().topic = publish.topic;
+            alias = lru_.front().alias;
+        }
+        lookup_.emplace(lru_.front().topic, lru_.begin());
+        publish.properties.topic_alias = alias;
+        return true;
+    }
+};
+} // namespace mqtt5::detail
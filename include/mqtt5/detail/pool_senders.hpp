@@ -0,0 +1,258 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "mqtt5/cancellation.hpp"
+#include <mqtt5/protocol/publish.hpp>
+#include <mqtt5/topic_filter.hpp>
+
+#include <boost/asio/post.hpp>
+
+#include <p0443_v2/connect.hpp>
+#include <p0443_v2/set_done.hpp>
+#include <p0443_v2/set_error.hpp>
+#include <p0443_v2/set_value.hpp>
+#include <p0443_v2/start.hpp>
+#include <p0443_v2/type_traits.hpp>
+
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace mqtt5::detail
+{
+/**
+ * @brief Starts a sender of a client on that client's executor.
+ *
+ * The operation is posted to the executor, so the client is only used from its own
+ * executor whichever thread starts the operation. The receiver is completed there too.
+ */
+template <class Executor, class Sender>
+struct start_on_sender
+{
+    template <template <class...> class Tuple, template <class...> class Variant>
+    using value_types =
+        typename p0443_v2::sender_traits<Sender>::template value_types<Tuple, Variant>;
+
+    template <template <class...> class Variant>
+    using error_types = typename p0443_v2::sender_traits<Sender>::template error_types<Variant>;
+
+    static constexpr bool sends_done = p0443_v2::sender_traits<Sender>::sends_done;
+
+    Executor executor_;
+    Sender sender_;
+
+    /**
+     * @brief Forwarded to the wrapped sender, the signal must be emitted on the executor.
+     */
+    [[nodiscard]] start_on_sender with_cancellation(cancellation_slot slot) && {
+        return start_on_sender{std::move(executor_), std::move(sender_).with_cancellation(slot)};
+    }
+
+    template <class Receiver>
+    struct operation
+    {
+        Executor executor_;
+        p0443_v2::operation_type<Sender, Receiver> operation_;
+
+        template <class S>
+        operation(Executor executor, S &&sender, Receiver receiver)
+            : executor_(std::move(executor)),
+              operation_(p0443_v2::connect(std::forward<S>(sender), std::move(receiver))) {
+        }
+
+        void start() {
+            boost::asio::post(executor_, [this] { p0443_v2::start(operation_); });
+        }
+    };
+
+    template <class Receiver>
+    auto connect(Receiver &&receiver) && {
+        return operation<p0443_v2::remove_cvref_t<Receiver>>{executor_, std::move(sender_),
+                                                             std::forward<Receiver>(receiver)};
+    }
+
+    // Reusable senders are connected from a copy
+    template <class Receiver>
+    auto connect(Receiver &&receiver) & {
+        return operation<p0443_v2::remove_cvref_t<Receiver>>{executor_, sender_,
+                                                             std::forward<Receiver>(receiver)};
+    }
+};
+
+template <class Executor, class Sender>
+start_on_sender(Executor, Sender) -> start_on_sender<Executor, Sender>;
+
+/**
+ * @brief Waits for the first publish matching a filter on any of several clients.
+ *
+ * A filtered subscriber is started on each client, on that client's executor. The first
+ * to complete cancels the others and the operation completes once all of them have,
+ * with the first publish or error, or with done if all of them were cancelled.
+ */
+template <class Client>
+struct pool_filter_sender
+{
+    template <template <class...> class Tuple, template <class...> class Variant>
+    using value_types = Variant<Tuple<protocol::publish>>;
+
+    template <template <class...> class Variant>
+    using error_types = Variant<std::exception_ptr>;
+
+    static constexpr bool sends_done = true;
+
+    std::vector<Client *> clients_;
+    topic_filter filter_;
+    cancellation_slot slot_;
+
+    /**
+     * @brief Stop waiting on every client when the slot's signal is emitted.
+     */
+    [[nodiscard]] pool_filter_sender with_cancellation(cancellation_slot slot) && {
+        slot_ = slot;
+        return std::move(*this);
+    }
+
+    template <class Receiver>
+    struct operation
+    {
+        struct branch_receiver
+        {
+            operation *op_;
+            std::size_t index_;
+
+            void set_value(protocol::publish pub) {
+                op_->branch_completed(index_, std::move(pub), nullptr);
+            }
+            void set_done() {
+                op_->branch_completed(index_, std::nullopt, nullptr);
+            }
+            void set_error(std::exception_ptr ex) {
+                op_->branch_completed(index_, std::nullopt, std::move(ex));
+            }
+        };
+
+        using branch_sender = decltype(std::declval<Client &>()
+                                           .filtered_subscriber(std::declval<topic_filter>())
+                                           .with_cancellation(cancellation_slot{}));
+
+        struct branch
+        {
+            typename Client::executor_type executor_;
+            cancellation_signal signal_;
+            p0443_v2::operation_type<branch_sender, branch_receiver> operation_;
+            bool completed_ = false;
+
+            branch(Client &client, const topic_filter &filter, branch_receiver receiver)
+                : executor_(client.get_executor()),
+                  operation_(p0443_v2::connect(
+                      client.filtered_subscriber(filter).with_cancellation(signal_.slot()),
+                      receiver)) {
+            }
+        };
+
+        Receiver receiver_;
+        cancellation_slot slot_;
+        std::vector<std::unique_ptr<branch>> branches_;
+
+        std::mutex mutex_;
+        // Branches and posted cancellations that still refer to the operation
+        std::size_t pending_ = 0;
+        std::optional<protocol::publish> value_;
+        std::exception_ptr error_;
+
+        operation(std::vector<Client *> clients, const topic_filter &filter, Receiver receiver,
+                  cancellation_slot slot)
+            : receiver_(std::move(receiver)), slot_(slot) {
+            branches_.reserve(clients.size());
+            for (std::size_t i = 0; i < clients.size(); i++) {
+                branches_.emplace_back(
+                    std::make_unique<branch>(*clients[i], filter, branch_receiver{this, i}));
+            }
+        }
+
+        void start() {
+            pending_ = branches_.size();
+            if (slot_.is_connected()) {
+                slot_.assign([this] { cancel_branches(); });
+            }
+            for (auto &b : branches_) {
+                boost::asio::post(b->executor_,
+                                  [b = b.get()] { p0443_v2::start(b->operation_); });
+            }
+        }
+
+        /**
+         * Posts a cancellation to every branch still waiting.
+         */
+        void cancel_branches() {
+            std::vector<branch *> to_cancel;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                for (auto &b : branches_) {
+                    if (!b->completed_) {
+                        to_cancel.push_back(b.get());
+                    }
+                }
+                pending_ += to_cancel.size();
+            }
+            for (auto *b : to_cancel) {
+                boost::asio::post(b->executor_, [this, b] {
+                    // Does nothing if the branch completed in the meantime
+                    b->signal_.emit();
+                    release();
+                });
+            }
+        }
+
+        void branch_completed(std::size_t index, std::optional<protocol::publish> value,
+                              std::exception_ptr error) {
+            bool first = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                branches_[index]->completed_ = true;
+                if ((value || error) && !value_ && !error_) {
+                    first = true;
+                    value_ = std::move(value);
+                    error_ = std::move(error);
+                }
+            }
+            if (first) {
+                cancel_branches();
+            }
+            release();
+        }
+
+        void release() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (--pending_ != 0) {
+                    return;
+                }
+            }
+            slot_.clear();
+            if (value_) {
+                p0443_v2::set_value(std::move(receiver_), std::move(*value_));
+            }
+            else if (error_) {
+                p0443_v2::set_error(std::move(receiver_), std::move(error_));
+            }
+            else {
+                p0443_v2::set_done(std::move(receiver_));
+            }
+        }
+    };
+
+    template <class Receiver>
+    auto connect(Receiver &&receiver) {
+        return operation<p0443_v2::remove_cvref_t<Receiver>>{
+            std::move(clients_), filter_, std::forward<Receiver>(receiver), slot_};
+    }
+};
+} // namespace mqtt5::detail
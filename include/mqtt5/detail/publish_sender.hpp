@@ -6,14 +6,27 @@
 
 #pragma once
 
+#include "mqtt5/cancellation.hpp"
 #include "mqtt5/quality_of_service.hpp"
 #include <mqtt5/protocol/publish.hpp>
 
+#include "intrusive_list.hpp"
 #include "message_receiver_base.hpp"
+#include "timer_wheel.hpp"
 
 namespace mqtt5::detail
 {
-struct in_flight_publish
+/**
+ * @brief A QoS 1 or QoS 2 publish waiting to be sent or acknowledged.
+ *
+ * The node is owned by the operation that started the publish and linked into
+ * the client while in flight. It is unlinked before it is completed. While it
+ * waits to be sent a message with an expiry interval is also scheduled in the
+ * client's expiry wheel.
+ */
+struct in_flight_publish : operation_completion<mqtt5::publish_result>,
+                           intrusive_list_node<in_flight_publish>,
+                           timer_wheel_entry
 {
     enum class state_type
     {
@@ -22,26 +35,33 @@ struct in_flight_publish
         waitiing_pubcomp
     };
     protocol::publish message_;
-    std::unique_ptr<detail::message_receiver_base<mqtt5::publish_result>> receiver_;
     state_type state_ = state_type::waiting_puback;
-};
+    // Linked into the queue waiting for send quota rather than the sent publishes
+    bool queued_ = false;
 
-struct publish_op_starter_base
-{
-    virtual ~publish_op_starter_base() = default;
-    virtual void start() = 0;
+    template <class Derived>
+    explicit in_flight_publish(Derived *self) : operation_completion(self) {
+    }
 };
 
-template <class Fn>
-struct publish_op_starter : publish_op_starter_base
+/**
+ * @brief In-flight publish restored from a session store.
+ *
+ * Nobody waits for the result, the node deletes itself once it completes.
+ */
+struct recovered_publish : in_flight_publish
 {
-    Fn function_;
-
-    publish_op_starter(Fn &&fn) : function_(std::move(fn)) {
+    recovered_publish() : in_flight_publish(this) {
     }
 
-    void start() override {
-        function_();
+    void on_value(mqtt5::publish_result) {
+        delete this;
+    }
+    void on_done() {
+        delete this;
+    }
+    void on_error(std::exception_ptr) {
+        delete this;
     }
 };
 
@@ -59,82 +79,79 @@ struct publish_sender
     protocol::publish message_;
     Modifier modifying_function_;
     Client *client_;
+    cancellation_slot slot_;
 
     publish_sender(Client *client, Modifier modifier)
         : modifying_function_(std::move(modifier)), client_(client) {
     }
 
+    /**
+     * @brief Cancel the publish when the slot's signal is emitted.
+     *
+     * A queued publish is dropped. One already sent is still acknowledged by the
+     * client, only the operation completes. Either way it completes with done.
+     */
+    [[nodiscard]] publish_sender with_cancellation(cancellation_slot slot) && {
+        slot_ = slot;
+        return std::move(*this);
+    }
+
+    /**
+     * The operation state is itself the in-flight node, it is linked into
+     * the client while the publish is in flight.
+     */
     template <class Receiver>
-    struct operation
+    struct operation : in_flight_publish
     {
         Receiver receiver_;
-
-        protocol::publish message_;
         Modifier modifying_function_;
         Client *client_;
+        cancellation_slot slot_;
 
-        struct publish_receiver : detail::message_receiver_base<mqtt5::publish_result>
-        {
-            Receiver next_;
-
-            publish_receiver(Receiver &&next) : next_(std::move(next)) {
-            }
+        operation(Receiver receiver, protocol::publish message, Modifier modifier, Client *client,
+                  cancellation_slot slot = {})
+            : in_flight_publish(this), receiver_(std::move(receiver)),
+              modifying_function_(std::move(modifier)), client_(client), slot_(slot) {
+            this->message_ = std::move(message);
+        }
 
-            void set_value(mqtt5::publish_result code) override {
-                p0443_v2::set_value(std::move(next_), code);
-            }
+        void on_value(mqtt5::publish_result code) {
+            slot_.clear();
+            p0443_v2::set_value(std::move(receiver_), code);
+        }
 
-            void set_done() override {
-                p0443_v2::set_done(std::move(next_));
-            }
+        void on_done() {
+            slot_.clear();
+            p0443_v2::set_done(std::move(receiver_));
+        }
 
-            void set_error(std::exception_ptr ex) override {
-                p0443_v2::set_error(std::move(next_), std::move(ex));
-            }
-        };
+        void on_error(std::exception_ptr ex) {
+            slot_.clear();
+            p0443_v2::set_error(std::move(receiver_), std::move(ex));
+        }
 
         void start() {
             modifying_function_(message_);
 
             if (message_.quality_of_service() == 0_qos) {
-                client_->send_message(std::move(message_));
+                client_->send_qos0_publish(std::move(message_));
                 p0443_v2::set_value(std::move(receiver_), publish_result::success);
             }
             else {
-                message_.packet_identifier = client_->next_packet_identifier();
-                auto start_fn = [client_ = client_, message_ = std::move(message_),
-                                 receiver_ = std::move(receiver_)]() mutable {
-                    --client_->server_send_quota_;
-                    client_->send_message(message_);
-                    auto start_state = in_flight_publish::state_type::waiting_puback;
-                    if(message_.quality_of_service() == 2_qos)
-                    {
-                        start_state = in_flight_publish::state_type::waiting_pubrec;
-                    }
-                    in_flight_publish stored{
-                        std::move(message_),
-                        std::make_unique<publish_receiver>(std::move(receiver_)),
-                        start_state
-                        };
-
-                    client_->published_messages_.emplace_back(std::move(stored));
-                };
-                if (client_->server_send_quota_ > 0) {
-                    start_fn();
-                }
-                else {
-                    auto publish_starter = std::make_unique<publish_op_starter<decltype(start_fn)>>(
-                        std::move(start_fn));
-                    client_->queued_publishes_.push_back(std::move(publish_starter));
+                // Installed first, the publish may complete before start_publish returns
+                if (slot_.is_connected()) {
+                    slot_.assign([this] { client_->cancel_publish(*this); });
                 }
+                client_->start_publish(*this);
             }
         }
     };
 
     template <class Receiver>
     auto connect(Receiver &&receiver) {
-        return operation<p0443_v2::remove_cvref_t<Receiver>>{
-            std::forward<Receiver>(receiver), std::move(message_), modifying_function_, client_};
+        return operation<p0443_v2::remove_cvref_t<Receiver>>{std::forward<Receiver>(receiver),
+                                                             std::move(message_),
+                                                             modifying_function_, client_, slot_};
     }
 };
 
@@ -0,0 +1,202 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "mqtt5/broker.hpp"
+#include "mqtt5/detail/subscription_index.hpp"
+#include "mqtt5/protocol/publish.hpp"
+#include "mqtt5/protocol/publish_frame.hpp"
+#include "mqtt5/retained_store.hpp"
+#include "mqtt5/topic_filter.hpp"
+
+#include <boost/utility/string_view.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace mqtt5::detail
+{
+/**
+ * @brief A session of a sharded broker, as stored in the subscription index of every shard.
+ */
+struct shard_subscriber
+{
+    std::uint32_t shard;
+    std::uint64_t session;
+    // Backlog of the session, published by its shard for least loaded selection
+    std::shared_ptr<std::atomic<std::size_t>> load;
+
+    friend bool operator==(const shard_subscriber &lhs, const shard_subscriber &rhs) {
+        return lhs.shard == rhs.shard && lhs.session == rhs.session;
+    }
+};
+
+/**
+ * @brief A session of the receiving shard a publish is delivered to.
+ */
+struct shard_target
+{
+    std::uint64_t session;
+    std::uint8_t options;
+    std::uint32_t identifier = 0;
+};
+
+struct deliver_mail
+{
+    protocol::publish_frame frame;
+    std::vector<shard_target> targets;
+};
+struct subscribe_mail
+{
+    std::string filter;
+    shard_subscriber subscriber;
+    std::uint8_t options;
+    std::uint32_t identifier = 0;
+};
+struct unsubscribe_mail
+{
+    std::string filter;
+    shard_subscriber subscriber;
+};
+struct retain_mail
+{
+    // Empty payload erases the topic
+    retained_store::message_ptr message;
+    // Taken from a counter shared by all shards, the highest one wins
+    std::uint64_t sequence;
+};
+struct close_mail
+{
+    std::uint64_t session;
+};
+
+/**
+ * @brief What the shards of a sharded broker send each other through their mailboxes.
+ */
+using shard_mail =
+    std::variant<deliver_mail, subscribe_mail, unsubscribe_mail, retain_mail, close_mail>;
+
+/**
+ * @brief The copy of the subscriptions and retained messages kept by one shard.
+ *
+ * Changes made on the shard itself are applied directly, changes made on the other
+ * shards arrive as mails. Retained changes carry a sequence number, a change older than
+ * the last one applied to its topic is ignored, so all replicas end up with the same
+ * message whatever order the mails arrive in. Only used from the shard's executor.
+ */
+class shard_replica
+{
+private:
+    std::uint32_t shard_;
+    subscription_index<shard_subscriber> index_;
+    retained_store retained_;
+    std::vector<boost::string_view> levels_;
+    // Sequence of the last change applied to each retained topic, erased ones included
+    std::unordered_map<std::string, std::uint64_t> retained_sequences_;
+
+    bool newest(const std::string &topic, std::uint64_t sequence) {
+        auto &last = retained_sequences_[topic];
+        if (sequence < last) {
+            return false;
+        }
+        last = sequence;
+        return true;
+    }
+
+public:
+    explicit shard_replica(std::uint32_t shard) : shard_(shard) {
+    }
+
+    shard_replica(const shard_replica &) = delete;
+    shard_replica &operator=(const shard_replica &) = delete;
+
+    [[nodiscard]] subscription_index<shard_subscriber> &index() {
+        return index_;
+    }
+
+    [[nodiscard]] retained_store &retained() {
+        return retained_;
+    }
+
+    void apply(subscribe_mail &m) {
+        index_.insert(m.filter, std::move(m.subscriber), m.options, nullptr, m.identifier);
+    }
+
+    void apply(unsubscribe_mail &m) {
+        index_.erase(m.filter, m.subscriber);
+    }
+
+    void apply(retain_mail &m) {
+        if (!newest(m.message->topic, m.sequence)) {
+            return;
+        }
+        if (m.message->payload.empty()) {
+            retained_.erase(m.message->topic);
+        }
+        else {
+            retained_.store(std::move(m.message));
+        }
+    }
+
+    /**
+     * @brief Store or erase a retained publish received by this shard.
+     *
+     * @param sequence Orders the change against those made on the other shards.
+     * @return The mail applying the same change to the other shards.
+     */
+    retain_mail retain(const protocol::publish &publish, std::uint64_t sequence) {
+        const bool apply = newest(publish.topic, sequence);
+        if (publish.payload.empty()) {
+            if (apply) {
+                retained_.erase(publish.topic);
+            }
+            auto erase = std::make_shared<protocol::publish>();
+            erase->topic = publish.topic;
+            return retain_mail{std::move(erase), sequence};
+        }
+        auto message = retained_store::make_message(publish);
+        if (apply) {
+            retained_.store(message);
+        }
+        return retain_mail{std::move(message), sequence};
+    }
+
+    /**
+     * @brief Collect the sessions a publish goes to, one target list per shard.
+     *
+     * The lists are cleared first, targets must have one list per shard.
+     *
+     * @param sender Session the publish was received from, skipped by no local
+     * subscriptions.
+     */
+    void route(boost::string_view topic, std::uint64_t sender, shared_subscription_policy policy,
+               std::vector<std::vector<shard_target>> &targets) {
+        for (auto &list : targets) {
+            list.clear();
+        }
+        split_topic_levels(topic, levels_);
+        index_.match(
+            levels_,
+            [&](const auto &subscription) {
+                const auto &ref = subscription.subscriber;
+                if ((subscription.options & subscription_no_local_flag) && ref.shard == shard_ &&
+                    ref.session == sender) {
+                    return;
+                }
+                targets[ref.shard].push_back(
+                    shard_target{ref.session, subscription.options, subscription.identifier});
+            },
+            policy,
+            [](const shard_subscriber &ref) { return ref.load->load(std::memory_order_relaxed); });
+    }
+};
+} // namespace mqtt5::detail
@@ -0,0 +1,116 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <utility>
+
+namespace mqtt5::detail
+{
+/**
+ * @brief Wait-free bounded single-producer, single-consumer ring buffer.
+ *
+ * The capacity is rounded up to a power of two. Head and tail are only ever
+ * written by one side each and live on separate cache lines.
+ */
+template <class T>
+class spsc_ring
+{
+private:
+    static constexpr std::size_t cache_line = 64;
+
+    std::unique_ptr<std::optional<T>[]> slots_;
+    std::size_t mask_;
+
+    // Written by the consumer
+    alignas(cache_line) std::atomic<std::size_t> head_{0};
+    // Written by the producer
+    alignas(cache_line) std::atomic<std::size_t> tail_{0};
+
+    static std::size_t round_up(std::size_t capacity) {
+        std::size_t retval = 1;
+        while (retval < capacity) {
+            retval <<= 1;
+        }
+        return retval;
+    }
+
+public:
+    explicit spsc_ring(std::size_t capacity)
+        : slots_(new std::optional<T>[round_up(capacity)]), mask_(round_up(capacity) - 1) {
+        assert(capacity > 0);
+    }
+    spsc_ring(const spsc_ring &) = delete;
+    spsc_ring &operator=(const spsc_ring &) = delete;
+
+    [[nodiscard]] std::size_t capacity() const noexcept {
+        return mask_ + 1;
+    }
+
+    /**
+     * @brief Push a value, must only be called by the producer.
+     *
+     * @return false if the ring is full, value is left untouched.
+     */
+    bool try_push(T &value) {
+        const auto tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == capacity()) {
+            return false;
+        }
+        slots_[tail & mask_].emplace(std::move(value));
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Pop a value, must only be called by the consumer.
+     */
+    std::optional<T> try_pop() {
+        const auto head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return std::nullopt;
+        }
+        auto &slot = slots_[head & mask_];
+        std::optional<T> retval(std::move(slot));
+        slot.reset();
+        head_.store(head + 1, std::memory_order_release);
+        return retval;
+    }
+
+    /**
+     * @brief Pass every value currently in the ring to fn, must only be called by the consumer.
+     *
+     * @return Number of values consumed.
+     */
+    template <class Fn>
+    std::size_t consume_all(Fn &&fn) {
+        auto head = head_.load(std::memory_order_relaxed);
+        const auto tail = tail_.load(std::memory_order_acquire);
+        const auto count = tail - head;
+        for (; head != tail; head++) {
+            auto &slot = slots_[head & mask_];
+            auto value = std::move(*slot);
+            slot.reset();
+            // Release each slot before running fn so the producer can reuse it
+            head_.store(head + 1, std::memory_order_release);
+            fn(std::move(value));
+        }
+        return count;
+    }
+
+    [[nodiscard]] bool empty() const {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+    [[nodiscard]] std::size_t size() const {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+};
+} // namespace mqtt5::detail
@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include "mqtt5/cancellation.hpp"
 #include "mqtt5/protocol/subscribe.hpp"
 #include "mqtt5/quality_of_service.hpp"
 #include "mqtt5/topic_filter.hpp"
@@ -14,6 +15,7 @@
 #include <p0443_v2/type_traits.hpp>
 #include <vector>
 
+#include "intrusive_list.hpp"
 #include "message_receiver_base.hpp"
 
 namespace mqtt5
@@ -53,18 +55,70 @@ struct subscribe_result
 };
 namespace detail
 {
-struct in_flight_subscribe
+struct in_flight_subscribe : operation_completion<subscribe_result>,
+                             intrusive_list_node<in_flight_subscribe>
 {
     protocol::subscribe message_;
-    std::unique_ptr<message_receiver_base<subscribe_result>> receiver_;
+
+    template <class Derived>
+    explicit in_flight_subscribe(Derived *self) : operation_completion(self) {
+    }
+};
+
+/**
+ * @brief Subscribe restoring the subscriptions of a lost session after a reconnect.
+ *
+ * Nobody waits for the result, the node deletes itself once it completes.
+ */
+struct resubscribe : in_flight_subscribe
+{
+    resubscribe() : in_flight_subscribe(this) {
+    }
+
+    void on_value(subscribe_result) {
+        delete this;
+    }
+    void on_done() {
+        delete this;
+    }
+    void on_error(std::exception_ptr) {
+        delete this;
+    }
 };
 
+inline void add_subscriptions(protocol::subscribe &message,
+                              std::vector<single_subscription> &subscriptions) {
+    for (auto &s : subscriptions) {
+        std::uint8_t flags = static_cast<std::uint8_t>(s.quality_of_service);
+        if (s.no_local) {
+            flags += 0x04;
+        }
+        if (s.retain_as_published) {
+            flags += 0x08;
+        }
+        flags += static_cast<std::uint8_t>(s.subscription_retain_handling) << 4;
+        message.topics.emplace_back(s.topic.to_string(), flags);
+    }
+}
+
 template <class Client, class Modifier>
 struct subscribe_sender
 {
     Client *client_;
     Modifier modifier_;
     std::vector<single_subscription> subscriptions_;
+    cancellation_slot slot_;
+
+    /**
+     * @brief Cancel the subscribe when the slot's signal is emitted.
+     *
+     * The operation completes with done. A SUBSCRIBE already sent is still tracked,
+     * the subscriptions the server grants are restored after a reconnect as usual.
+     */
+    [[nodiscard]] subscribe_sender with_cancellation(cancellation_slot slot) && {
+        slot_ = slot;
+        return std::move(*this);
+    }
 
     template <template <class...> class Tuple, template <class...> class Variant>
     using value_types = Variant<Tuple<subscribe_result>>;
@@ -75,48 +129,41 @@ struct subscribe_sender
     static constexpr bool sends_done = true;
 
     template <class Receiver>
-    struct operation
+    struct operation : in_flight_subscribe
     {
         Receiver receiver_;
         Client *client_;
         Modifier modifier_;
         std::vector<single_subscription> subscriptions_;
+        cancellation_slot slot_;
 
-        struct receiver : message_receiver_base<subscribe_result>
-        {
-            Receiver next_;
-            receiver(Receiver &&next) : next_(std::move(next)) {
-            }
-            void set_value(subscribe_result results) override {
-                p0443_v2::set_value(std::move(next_), std::move(results));
-            }
-            void set_done() override {
-                p0443_v2::set_done(std::move(next_));
-            }
-            void set_error(std::exception_ptr e) override {
-                p0443_v2::set_error(std::move(next_), std::move(e));
-            }
-        };
+        operation(Receiver receiver, Client *client, Modifier modifier,
+                  std::vector<single_subscription> subscriptions, cancellation_slot slot)
+            : in_flight_subscribe(this), receiver_(std::move(receiver)), client_(client),
+              modifier_(std::move(modifier)), subscriptions_(std::move(subscriptions)),
+              slot_(slot) {
+        }
+
+        void on_value(subscribe_result results) {
+            slot_.clear();
+            p0443_v2::set_value(std::move(receiver_), std::move(results));
+        }
+        void on_done() {
+            slot_.clear();
+            p0443_v2::set_done(std::move(receiver_));
+        }
+        void on_error(std::exception_ptr e) {
+            slot_.clear();
+            p0443_v2::set_error(std::move(receiver_), std::move(e));
+        }
 
         void start() {
-            in_flight_subscribe in_flight;
-            in_flight.receiver_ = std::make_unique<receiver>(std::move(receiver_));
-
-            for (auto &s : subscriptions_) {
-                std::uint8_t flags = flags = static_cast<std::uint8_t>(s.quality_of_service);
-                if (s.no_local) {
-                    flags += 0x04;
-                }
-                if (s.retain_as_published) {
-                    flags += 0x08;
-                }
-                flags += static_cast<std::uint8_t>(s.subscription_retain_handling) << 4;
-                in_flight.message_.topics.emplace_back(s.topic.to_string(), flags);
+            add_subscriptions(this->message_, subscriptions_);
+            modifier_(this->message_);
+            if (slot_.is_connected()) {
+                slot_.assign([this] { client_->cancel_subscribe(*this); });
             }
-            modifier_(in_flight.message_);
-            in_flight.message_.packet_identifier = client_->next_packet_identifier();
-            client_->send_message(in_flight.message_);
-            client_->subscribe_messages_.emplace_back(std::move(in_flight));
+            client_->start_subscribe(*this);
         }
     };
 
@@ -124,7 +171,7 @@ struct subscribe_sender
     auto connect(Receiver &&receiver) {
         using receiver_t = p0443_v2::remove_cvref_t<Receiver>;
         return operation<receiver_t>{std::forward<Receiver>(receiver), client_,
-                                     std::move(modifier_), std::move(subscriptions_)};
+                                     std::move(modifier_), std::move(subscriptions_), slot_};
     }
 };
 template<class C, class M>
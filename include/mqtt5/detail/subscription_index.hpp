@@ -0,0 +1,395 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <mqtt5/topic_filter.hpp>
+
+#include <boost/utility/string_view.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace mqtt5
+{
+/**
+ * @brief How a member of a shared subscription group is picked for each message.
+ */
+enum class shared_subscription_policy {
+    // Members take turns
+    round_robin,
+    // The member with the least pending messages, ties are broken round robin
+    least_loaded
+};
+
+namespace detail
+{
+/**
+ * @brief A topic filter split into an optional share group and the filter itself.
+ */
+struct parsed_filter
+{
+    boost::string_view share_group;
+    boost::string_view filter;
+};
+
+/**
+ * @brief Split "$share/group/filter" into its parts.
+ *
+ * Filters that aren't shared are returned with an empty share_group.
+ *
+ * @return false if the filter isn't a valid topic filter.
+ */
+inline bool parse_filter(boost::string_view topic_filter, parsed_filter &out) {
+    out = parsed_filter{};
+    constexpr boost::string_view share_prefix = "$share/";
+    if (topic_filter.starts_with(share_prefix)) {
+        topic_filter.remove_prefix(share_prefix.size());
+        const auto separator = topic_filter.find('/');
+        if (separator == 0 || separator == boost::string_view::npos) {
+            return false;
+        }
+        out.share_group = topic_filter.substr(0, separator);
+        if (out.share_group.find_first_of("+#") != boost::string_view::npos) {
+            return false;
+        }
+        topic_filter.remove_prefix(separator + 1);
+    }
+    if (topic_filter.empty()) {
+        return false;
+    }
+
+    // Same rules as topic_filter, but without asserting
+    std::size_t level_start = 0;
+    for (std::size_t i = 0; i <= topic_filter.size(); i++) {
+        if (i != topic_filter.size() && topic_filter[i] != '/') {
+            continue;
+        }
+        const auto level = topic_filter.substr(level_start, i - level_start);
+        if (level.find('#') != boost::string_view::npos &&
+            (level.size() != 1 || i != topic_filter.size())) {
+            return false;
+        }
+        if (level.find('+') != boost::string_view::npos && level.size() != 1) {
+            return false;
+        }
+        level_start = i + 1;
+    }
+    out.filter = topic_filter;
+    return true;
+}
+
+/**
+ * @brief Maps topic names to the subscribers of matching topic filters.
+ *
+ * Filters are stored in a trie with one node per topic level, so matching a topic only
+ * visits the branches that can match instead of testing every filter. Shared
+ * subscriptions ("$share/group/filter") are stored as groups, of which one member is
+ * picked per message.
+ *
+ * Subscriber is a small copyable handle, compared with ==.
+ */
+template <class Subscriber>
+class subscription_index
+{
+public:
+    struct subscription
+    {
+        Subscriber subscriber;
+        // Subscription options byte from SUBSCRIBE
+        std::uint8_t options;
+        // Subscription identifier from SUBSCRIBE, 0 if there was none
+        std::uint32_t identifier = 0;
+    };
+
+private:
+    struct shared_group
+    {
+        std::string name;
+        std::vector<subscription> members;
+        std::size_t next = 0;
+    };
+
+    struct node
+    {
+        // Keys point into the level stored in each child
+        std::unordered_map<std::string_view, std::unique_ptr<node>> children;
+        std::unique_ptr<node> single_level;
+        std::unique_ptr<node> multi_level;
+        std::string level;
+
+        std::vector<subscription> subscriptions;
+        std::vector<shared_group> groups;
+
+        [[nodiscard]] bool empty() const {
+            return children.empty() && !single_level && !multi_level && subscriptions.empty() &&
+                   groups.empty();
+        }
+    };
+
+    node root_;
+    std::size_t size_ = 0;
+
+    static std::string_view to_std(boost::string_view v) {
+        return std::string_view(v.data(), v.size());
+    }
+
+    node &find_or_create(boost::string_view filter) {
+        node *current = &root_;
+        for (auto level : split_topic_levels(filter)) {
+            std::unique_ptr<node> *child;
+            if (level == "+") {
+                child = &current->single_level;
+            }
+            else if (level == "#") {
+                child = &current->multi_level;
+            }
+            else {
+                auto iter = current->children.find(to_std(level));
+                if (iter != current->children.end()) {
+                    current = iter->second.get();
+                    continue;
+                }
+                auto created = std::make_unique<node>();
+                created->level = std::string(level.data(), level.size());
+                auto *next = created.get();
+                current->children.emplace(std::string_view(next->level), std::move(created));
+                current = next;
+                continue;
+            }
+            if (!*child) {
+                *child = std::make_unique<node>();
+                (*child)->level = std::string(level.data(), level.size());
+            }
+            current = child->get();
+        }
+        return *current;
+    }
+
+    /**
+     * Follow a filter down the trie, collecting the path so empty nodes can be pruned.
+     */
+    bool find_path(boost::string_view filter, std::vector<node *> &path) {
+        node *current = &root_;
+        path.push_back(current);
+        for (auto level : split_topic_levels(filter)) {
+            node *next = nullptr;
+            if (level == "+") {
+                next = current->single_level.get();
+            }
+            else if (level == "#") {
+                next = current->multi_level.get();
+            }
+            else if (auto iter = current->children.find(to_std(level));
+                     iter != current->children.end()) {
+                next = iter->second.get();
+            }
+            if (!next) {
+                return false;
+            }
+            path.push_back(next);
+            current = next;
+        }
+        return true;
+    }
+
+    void prune(std::vector<node *> &path) {
+        while (path.size() > 1 && path.back()->empty()) {
+            auto *child = path.back();
+            path.pop_back();
+            auto *parent = path.back();
+            if (parent->single_level.get() == child) {
+                parent->single_level.reset();
+            }
+            else if (parent->multi_level.get() == child) {
+                parent->multi_level.reset();
+            }
+            else {
+                parent->children.erase(std::string_view(child->level));
+            }
+        }
+    }
+
+    template <class Load>
+    static const subscription &pick(shared_group &group, shared_subscription_policy policy,
+                                    Load &load) {
+        const auto count = group.members.size();
+        const auto start = group.next % count;
+        auto selected = start;
+        if (policy == shared_subscription_policy::least_loaded && count > 1) {
+            auto lowest = load(group.members[start].subscriber);
+            for (std::size_t i = 1; i < count && lowest != 0; i++) {
+                const auto candidate = (start + i) % count;
+                const auto candidate_load = load(group.members[candidate].subscriber);
+                if (candidate_load < lowest) {
+                    lowest = candidate_load;
+                    selected = candidate;
+                }
+            }
+        }
+        group.next = selected + 1;
+        return group.members[selected];
+    }
+
+    template <class F, class Load>
+    static void visit(node &n, F &f, shared_subscription_policy policy, Load &load) {
+        for (const auto &s : n.subscriptions) {
+            f(s);
+        }
+        for (auto &group : n.groups) {
+            f(pick(group, policy, load));
+        }
+    }
+
+    template <class F, class Load>
+    static void match_node(node &n, const std::vector<boost::string_view> &levels,
+                           std::size_t index, F &f, shared_subscription_policy policy,
+                           Load &load) {
+        // Wildcards at the first level don't match topics starting with '$'
+        const bool wildcards = index != 0 || levels.empty() || !levels.front().starts_with("$");
+        // "a/#" also matches "a"
+        if (wildcards && n.multi_level) {
+            visit(*n.multi_level, f, policy, load);
+        }
+        if (index == levels.size()) {
+            visit(n, f, policy, load);
+            return;
+        }
+        if (auto iter = n.children.find(to_std(levels[index])); iter != n.children.end()) {
+            match_node(*iter->second, levels, index + 1, f, policy, load);
+        }
+        if (wildcards && n.single_level) {
+            match_node(*n.single_level, levels, index + 1, f, policy, load);
+        }
+    }
+
+public:
+    /**
+     * @brief Add a subscription, or update the options of an existing one.
+     *
+     * @param filter Topic filter, possibly shared ("$share/group/filter").
+     * @param identifier Subscription identifier, replaces the one of an existing subscription.
+     * @return false if the filter is invalid, true if it was added or updated.
+     */
+    bool insert(boost::string_view filter, Subscriber subscriber, std::uint8_t options,
+                bool *existed = nullptr, std::uint32_t identifier = 0) {
+        parsed_filter parsed;
+        if (!parse_filter(filter, parsed)) {
+            return false;
+        }
+        auto &n = find_or_create(parsed.filter);
+        std::vector<subscription> *list = &n.subscriptions;
+        if (!parsed.share_group.empty()) {
+            auto group = std::find_if(n.groups.begin(), n.groups.end(), [&](const auto &g) {
+                return g.name == parsed.share_group;
+            });
+            if (group == n.groups.end()) {
+                n.groups.push_back(shared_group{
+                    std::string(parsed.share_group.data(), parsed.share_group.size()), {}, 0});
+                group = std::prev(n.groups.end());
+            }
+            list = &group->members;
+        }
+
+        auto existing = std::find_if(list->begin(), list->end(), [&](const subscription &s) {
+            return s.subscriber == subscriber;
+        });
+        if (existed) {
+            *existed = existing != list->end();
+        }
+        if (existing != list->end()) {
+            existing->options = options;
+            existing->identifier = identifier;
+        }
+        else {
+            list->push_back(subscription{subscriber, options, identifier});
+            size_++;
+        }
+        return true;
+    }
+
+    /**
+     * @return true if the subscription existed.
+     */
+    bool erase(boost::string_view filter, const Subscriber &subscriber) {
+        parsed_filter parsed;
+        if (!parse_filter(filter, parsed)) {
+            return false;
+        }
+        std::vector<node *> path;
+        if (!find_path(parsed.filter, path)) {
+            return false;
+        }
+        auto &n = *path.back();
+
+        auto remove_from = [&](std::vector<subscription> &list) {
+            auto iter = std::find_if(list.begin(), list.end(), [&](const subscription &s) {
+                return s.subscriber == subscriber;
+            });
+            if (iter == list.end()) {
+                return false;
+            }
+            list.erase(iter);
+            size_--;
+            return true;
+        };
+
+        bool removed;
+        if (parsed.share_group.empty()) {
+            removed = remove_from(n.subscriptions);
+        }
+        else {
+            auto group = std::find_if(n.groups.begin(), n.groups.end(), [&](const auto &g) {
+                return g.name == parsed.share_group;
+            });
+            removed = group != n.groups.end() && remove_from(group->members);
+            if (removed && group->members.empty()) {
+                n.groups.erase(group);
+            }
+        }
+        prune(path);
+        return removed;
+    }
+
+    /**
+     * @brief Call f once per matching subscription.
+     *
+     * Each matching shared group calls f once, with the member picked by policy.
+     * load(subscriber) returns the number of messages pending for a subscriber and is
+     * only called for least_loaded.
+     *
+     * @param levels Topic name split with split_topic_levels.
+     */
+    template <class F, class Load>
+    void match(const std::vector<boost::string_view> &levels, F &&f,
+               shared_subscription_policy policy, Load &&load) {
+        match_node(root_, levels, 0, f, policy, load);
+    }
+
+    template <class F>
+    void match(const std::vector<boost::string_view> &levels, F &&f) {
+        auto no_load = [](const Subscriber &) { return std::size_t(0); };
+        match_node(root_, levels, 0, f, shared_subscription_policy::round_robin, no_load);
+    }
+
+    /**
+     * @brief Number of subscriptions, each member of a shared group counts as one.
+     */
+    [[nodiscard]] std::size_t size() const {
+        return size_;
+    }
+
+    [[nodiscard]] bool empty() const {
+        return size_ == 0;
+    }
+};
+} // namespace detail
+} // namespace mqtt5
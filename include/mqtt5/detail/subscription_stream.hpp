@@ -0,0 +1,234 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "intrusive_list.hpp"
+#include "message_receiver_base.hpp"
+
+#include <mqtt5/protocol/publish.hpp>
+#include <mqtt5/topic_filter.hpp>
+
+#include <p0443_v2/set_done.hpp>
+#include <p0443_v2/set_error.hpp>
+#include <p0443_v2/set_value.hpp>
+#include <p0443_v2/transform.hpp>
+#include <p0443_v2/type_traits.hpp>
+
+#include <cassert>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <vector>
+
+namespace mqtt5
+{
+namespace detail
+{
+struct stream_waiter : operation_completion<std::vector<protocol::publish>>
+{
+    std::size_t max_count_ = 1;
+
+    template <class Derived>
+    explicit stream_waiter(Derived *self) : operation_completion(self) {
+    }
+};
+
+/**
+ * @brief State of a persistent filtered subscription.
+ *
+ * Linked into the client for as long as the subscription stream is active.
+ * Matching publishes are buffered in a bounded queue until they are received.
+ */
+struct subscription_stream_state : intrusive_list_node<subscription_stream_state>
+{
+    topic_filter filter_;
+    std::deque<protocol::publish> queue_;
+    std::size_t capacity_;
+    std::size_t dropped_ = 0;
+    stream_waiter *waiter_ = nullptr;
+    // Set while the client holds a deferred completion for this stream
+    bool completion_pending_ = false;
+
+    subscription_stream_state(topic_filter filter, std::size_t capacity)
+        : filter_(std::move(filter)), capacity_(capacity) {
+    }
+
+    /**
+     * Buffers a publish, dropping the oldest buffered publish if the queue is full.
+     */
+    void push(const protocol::publish &publish) {
+        if (queue_.size() >= capacity_) {
+            queue_.pop_front();
+            dropped_++;
+        }
+        queue_.push_back(publish);
+    }
+
+    std::vector<protocol::publish> take(std::size_t max_count) {
+        std::vector<protocol::publish> retval;
+        const auto count = std::min(max_count, queue_.size());
+        retval.reserve(count);
+        for (std::size_t i = 0; i < count; i++) {
+            retval.emplace_back(std::move(queue_.front()));
+            queue_.pop_front();
+        }
+        return retval;
+    }
+
+    /**
+     * Takes the pending waiter, if there is one and there is data for it.
+     */
+    stream_waiter *ready_waiter() {
+        if (waiter_ && !queue_.empty()) {
+            return std::exchange(waiter_, nullptr);
+        }
+        return nullptr;
+    }
+};
+
+struct stream_receive_sender
+{
+    template <template <class...> class Tuple, template <class...> class Variant>
+    using value_types = Variant<Tuple<std::vector<protocol::publish>>>;
+
+    template <template <class...> class Variant>
+    using error_types = Variant<std::exception_ptr>;
+
+    static constexpr bool sends_done = true;
+
+    subscription_stream_state *state_;
+    std::size_t max_count_;
+
+    template <class Receiver>
+    struct operation : stream_waiter
+    {
+        subscription_stream_state *state_;
+        Receiver receiver_;
+
+        operation(subscription_stream_state *state, std::size_t max_count, Receiver receiver)
+            : stream_waiter(this), state_(state), receiver_(std::move(receiver)) {
+            this->max_count_ = max_count;
+        }
+
+        void on_value(std::vector<protocol::publish> publishes) {
+            p0443_v2::set_value(std::move(receiver_), std::move(publishes));
+        }
+        void on_done() {
+            p0443_v2::set_done(std::move(receiver_));
+        }
+        void on_error(std::exception_ptr e) {
+            p0443_v2::set_error(std::move(receiver_), std::move(e));
+        }
+
+        void start() {
+            if (!state_ || !state_->is_linked()) {
+                on_done();
+            }
+            else if (!state_->queue_.empty()) {
+                on_value(state_->take(this->max_count_));
+            }
+            else {
+                // Only a single receive may be pending at a time
+                assert(state_->waiter_ == nullptr);
+                state_->waiter_ = this;
+            }
+        }
+    };
+
+    template <class Receiver>
+    auto connect(Receiver &&receiver) {
+        using receiver_t = p0443_v2::remove_cvref_t<Receiver>;
+        return operation<receiver_t>{state_, max_count_, std::forward<Receiver>(receiver)};
+    }
+};
+} // namespace detail
+
+/**
+ * @brief A filtered subscription that stays registered until cancelled.
+ *
+ * Every publish matching the filter is buffered in a bounded queue, so nothing is
+ * lost between two receives. When the queue is full the oldest buffered
+ * publish is dropped.
+ *
+ * Only one receive may be pending at a time. Destroying the stream cancels it.
+ */
+template <class Client>
+class subscription_stream
+{
+private:
+    Client *client_;
+    std::unique_ptr<detail::subscription_stream_state> state_;
+
+public:
+    subscription_stream(Client *client, topic_filter filter, std::size_t capacity)
+        : client_(client),
+          state_(std::make_unique<detail::subscription_stream_state>(std::move(filter), capacity)) {
+        client_->add_subscription_stream(*state_);
+    }
+
+    subscription_stream(subscription_stream &&) noexcept = default;
+    subscription_stream &operator=(subscription_stream &&rhs) noexcept {
+        if (this != &rhs) {
+            cancel();
+            client_ = rhs.client_;
+            state_ = std::move(rhs.state_);
+        }
+        return *this;
+    }
+
+    ~subscription_stream() {
+        cancel();
+    }
+
+    /**
+     * @brief Create a receiver for up to max_count publishes.
+     *
+     * Completes as soon as at least one publish is available, with everything
+     * already buffered up to max_count. While the client still has complete packets
+     * in its read buffer the completion is held back, so one completion carries all
+     * publishes decoded from a single socket read.
+     *
+     * Sender value: std::vector<mqtt5::protocol::publish>
+     * Sender error: std::exception_ptr
+     * Sender sets done: yes, when the stream is cancelled
+     */
+    [[nodiscard]] auto receive_many(std::size_t max_count) {
+        assert(max_count > 0);
+        return detail::stream_receive_sender{state_.get(), max_count};
+    }
+
+    /**
+     * @brief Create a receiver for the next publish.
+     *
+     * Sender value: mqtt5::protocol::publish
+     */
+    [[nodiscard]] auto receiver() {
+        return p0443_v2::transform(receive_many(1), [](std::vector<protocol::publish> pubs) {
+            return std::move(pubs.front());
+        });
+    }
+
+    /**
+     * @brief Number of publishes dropped because the queue was full.
+     */
+    [[nodiscard]] std::size_t dropped() const {
+        return state_ ? state_->dropped_ : 0;
+    }
+
+    /**
+     * @brief Unregister the stream. A pending receive completes with done.
+     */
+    void cancel() {
+        if (state_ && state_->is_linked()) {
+            client_->remove_subscription_stream(*state_);
+            if (auto *waiter = std::exchange(state_->waiter_, nullptr)) {
+                waiter->set_done();
+            }
+        }
+    }
+};
+} // namespace mqtt5
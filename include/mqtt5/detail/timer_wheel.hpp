@@ -0,0 +1,229 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+namespace mqtt5::detail
+{
+class timer_wheel;
+
+/**
+ * @brief Base class for objects with a deadline in a timer_wheel.
+ *
+ * Copying or moving an entry never copies its links, the new entry is never scheduled.
+ * An entry destroyed while it is scheduled cancels itself.
+ */
+class timer_wheel_entry
+{
+private:
+    friend class timer_wheel;
+    timer_wheel_entry *next_entry_ = nullptr;
+    timer_wheel_entry *prev_entry_ = nullptr;
+    timer_wheel_entry **slot_ = nullptr;
+    timer_wheel *wheel_ = nullptr;
+    std::uint64_t deadline_ = 0;
+
+public:
+    timer_wheel_entry() = default;
+    timer_wheel_entry(const timer_wheel_entry &) noexcept {
+    }
+    timer_wheel_entry &operator=(const timer_wheel_entry &) noexcept {
+        return *this;
+    }
+    ~timer_wheel_entry();
+
+    [[nodiscard]] bool is_scheduled() const noexcept {
+        return slot_ != nullptr;
+    }
+
+    /**
+     * @brief The tick the entry expires at.
+     */
+    [[nodiscard]] std::uint64_t deadline() const noexcept {
+        return deadline_;
+    }
+};
+
+/**
+ * @brief Hierarchical timer wheel with O(1) scheduling and cancellation.
+ *
+ * Time is counted in ticks of a resolution chosen by the user. Level 0 has one slot
+ * per tick, every level above has slots 64 times as wide. When level 0 wraps the
+ * next slot of the level above is cascaded down, so an entry is moved at most once
+ * per level before it expires. Deadlines beyond the range of the top level are
+ * parked in its last slot and rescheduled when it is cascaded.
+ *
+ * The wheel never owns its entries. Entries still scheduled when the wheel is destroyed are
+ * cancelled.
+ */
+class timer_wheel
+{
+private:
+    static constexpr std::size_t slot_bits = 6;
+    static constexpr std::size_t slot_count = 1 << slot_bits;
+    static constexpr std::size_t level_count = 4;
+
+    std::array<std::array<timer_wheel_entry *, slot_count>, level_count> slots_{};
+    std::uint64_t now_ = 0;
+    std::size_t size_ = 0;
+
+    void link(timer_wheel_entry *&slot, timer_wheel_entry &entry) {
+        entry.prev_entry_ = nullptr;
+        entry.next_entry_ = slot;
+        if (slot) {
+            slot->prev_entry_ = &entry;
+        }
+        slot = &entry;
+        entry.slot_ = &slot;
+        entry.wheel_ = this;
+    }
+
+    static void unlink(timer_wheel_entry &entry) {
+        if (entry.prev_entry_) {
+            entry.prev_entry_->next_entry_ = entry.next_entry_;
+        }
+        else {
+            *entry.slot_ = entry.next_entry_;
+        }
+        if (entry.next_entry_) {
+            entry.next_entry_->prev_entry_ = entry.prev_entry_;
+        }
+        entry.next_entry_ = entry.prev_entry_ = nullptr;
+        entry.slot_ = nullptr;
+        entry.wheel_ = nullptr;
+    }
+
+    void place(timer_wheel_entry &entry) {
+        const auto deadline = entry.deadline_ > now_ ? entry.deadline_ : now_;
+        const auto delta = deadline - now_;
+        for (std::size_t level = 0; level < level_count; level++) {
+            if (delta < (std::uint64_t(1) << (slot_bits * (level + 1)))) {
+                const auto slot = (deadline >> (slot_bits * level)) & (slot_count - 1);
+                link(slots_[level][slot], entry);
+                return;
+            }
+        }
+        // Too far away, parked in the slot that is cascaded last
+        const auto top = level_count - 1;
+        const auto slot = ((now_ >> (slot_bits * top)) - 1) & (slot_count - 1);
+        link(slots_[top][slot], entry);
+    }
+
+    /**
+     * Move the entries of the current slot of a level down to lower levels.
+     */
+    void cascade(std::size_t level) {
+        const auto slot = (now_ >> (slot_bits * level)) & (slot_count - 1);
+        auto *entry = slots_[level][slot];
+        slots_[level][slot] = nullptr;
+        while (entry) {
+            auto *next = entry->next_entry_;
+            entry->slot_ = nullptr;
+            place(*entry);
+            entry = next;
+        }
+    }
+
+public:
+    explicit timer_wheel(std::uint64_t now = 0) : now_(now) {
+    }
+
+    timer_wheel(const timer_wheel &) = delete;
+    timer_wheel &operator=(const timer_wheel &) = delete;
+
+    ~timer_wheel() {
+        for (auto &level : slots_) {
+            for (auto &slot : level) {
+                while (slot) {
+                    unlink(*slot);
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Schedule an entry, rescheduling it if it already is.
+     *
+     * A deadline that has already passed expires on the next advance.
+     */
+    void schedule(timer_wheel_entry &entry, std::uint64_t deadline) {
+        if (entry.slot_) {
+            unlink(entry);
+            size_--;
+        }
+        entry.deadline_ = deadline;
+        place(entry);
+        size_++;
+    }
+
+    /**
+     * @brief Cancel a scheduled entry, does nothing if it isn't scheduled.
+     */
+    void cancel(timer_wheel_entry &entry) {
+        if (entry.slot_) {
+            unlink(entry);
+            size_--;
+        }
+    }
+
+    /**
+     * @brief Advance to tick now, calling expired(entry) for every entry whose deadline
+     * has passed.
+     *
+     * Entries are unscheduled before expired is called, which may schedule and cancel
+     * entries.
+     */
+    template <class F>
+    void advance(std::uint64_t now, F &&expired) {
+        while (now_ <= now) {
+            auto &slot = slots_[0][now_ & (slot_count - 1)];
+            while (slot) {
+                auto &entry = *slot;
+                unlink(entry);
+                size_--;
+                expired(entry);
+            }
+            if (now_ == now) {
+                break;
+            }
+            now_++;
+            // Cascade every level that wrapped around
+            for (std::size_t level = 1; level < level_count; level++) {
+                if ((now_ & ((std::uint64_t(1) << (slot_bits * level)) - 1)) != 0) {
+                    break;
+                }
+                cascade(level);
+            }
+            if (size_ == 0) {
+                // Nothing to expire, skip ahead without visiting every slot
+                now_ = now;
+            }
+        }
+    }
+
+    [[nodiscard]] std::uint64_t now() const {
+        return now_;
+    }
+
+    [[nodiscard]] std::size_t size() const {
+        return size_;
+    }
+
+    [[nodiscard]] bool empty() const {
+        return size_ == 0;
+    }
+};
+
+inline timer_wheel_entry::~timer_wheel_entry() {
+    if (wheel_) {
+        wheel_->cancel(*this);
+    }
+}
+} // namespace mqtt5::detail
@@ -0,0 +1,138 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <mqtt5/topic_filter.hpp>
+
+#include <boost/utility/string_view.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace mqtt5::detail
+{
+/**
+ * @brief A received topic name together with precomputed matching data.
+ *
+ * Instances are shared by a topic_intern_table and the inbound topic aliases
+ * referring to them, and have stable addresses.
+ */
+struct interned_topic
+{
+    std::string name;
+    std::size_t hash = 0;
+    // Views into name, one per topic level
+    std::vector<boost::string_view> levels;
+
+    // Indices of matching subscriptions, valid while generation matches the table.
+    std::vector<std::size_t> matching_subscriptions;
+    std::uint64_t generation = 0;
+
+    interned_topic(std::string topic, std::size_t topic_hash)
+        : name(std::move(topic)), hash(topic_hash), levels(split_topic_levels(name)) {
+    }
+
+    interned_topic(const interned_topic &) = delete;
+    interned_topic &operator=(const interned_topic &) = delete;
+};
+
+/**
+ * @brief Maps each distinct topic name to a stable interned_topic.
+ *
+ * Matching subscriptions are cached per topic and recomputed lazily after
+ * the subscription set has changed. The table is bounded; when it is full it
+ * is cleared and starts over, which only costs a recomputation per topic.
+ * Topics shared with intern_shared outlive the clearing.
+ */
+class topic_intern_table
+{
+private:
+    // Keys point into the names owned by the interned topics
+    std::unordered_map<std::string_view, std::shared_ptr<interned_topic>> topics_;
+    std::uint64_t generation_ = 1;
+    std::size_t capacity_;
+
+public:
+    explicit topic_intern_table(std::size_t capacity = 4096) : capacity_(capacity) {
+    }
+
+private:
+    const std::shared_ptr<interned_topic> &find_or_insert(boost::string_view topic) {
+        std::string_view key(topic.data(), topic.size());
+        auto iter = topics_.find(key);
+        if (iter != topics_.end()) {
+            return iter->second;
+        }
+        if (topics_.size() >= capacity_) {
+            clear();
+        }
+        auto new_topic =
+            std::make_shared<interned_topic>(std::string(key), std::hash<std::string_view>{}(key));
+        const std::string_view new_key(new_topic->name);
+        return topics_.emplace(new_key, std::move(new_topic)).first->second;
+    }
+
+public:
+    /**
+     * @brief Find or insert a topic name.
+     *
+     * The returned reference is valid until the next call to intern or clear.
+     */
+    interned_topic &intern(boost::string_view topic) {
+        return *find_or_insert(topic);
+    }
+
+    /**
+     * @brief Find or insert a topic name that is kept alive by the returned pointer.
+     */
+    std::shared_ptr<interned_topic> intern_shared(boost::string_view topic) {
+        return find_or_insert(topic);
+    }
+
+    /**
+     * @brief Marks all cached subscription matches as stale.
+     *
+     * Must be called whenever subscriptions are added, removed or reordered.
+     */
+    void invalidate() {
+        generation_++;
+    }
+
+    /**
+     * @brief Get the indices of all subscriptions matching a topic.
+     *
+     * @param count Number of subscriptions in the current subscription set.
+     * @param is_match Called with a subscription index when the cache is stale.
+     */
+    template <class Predicate>
+    const std::vector<std::size_t> &matching(interned_topic &topic, std::size_t count,
+                                             Predicate &&is_match) {
+        if (topic.generation != generation_) {
+            topic.matching_subscriptions.clear();
+            for (std::size_t i = 0; i < count; i++) {
+                if (is_match(i)) {
+                    topic.matching_subscriptions.push_back(i);
+                }
+            }
+            topic.generation = generation_;
+        }
+        return topic.matching_subscriptions;
+    }
+
+    void clear() {
+        topics_.clear();
+    }
+
+    [[nodiscard]] std::size_t size() const {
+        return topics_.size();
+    }
+};
+} // namespace mqtt5::detail
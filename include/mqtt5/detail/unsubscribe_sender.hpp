@@ -7,6 +7,7 @@
 #pragma once
 
 #include <mqtt5/protocol/unsubscribe.hpp>
+#include "intrusive_list.hpp"
 #include "message_receiver_base.hpp"
 
 #include <p0443_v2/type_traits.hpp>
@@ -15,10 +16,14 @@
 
 namespace mqtt5::detail
 {
-struct in_flight_unsubscribe
+struct in_flight_unsubscribe : operation_completion<std::vector<std::uint8_t>>,
+                               intrusive_list_node<in_flight_unsubscribe>
 {
     mqtt5::protocol::unsubscribe message_;
-    std::unique_ptr<message_receiver_base<std::vector<std::uint8_t>>> receiver_;
+
+    template <class Derived>
+    explicit in_flight_unsubscribe(Derived *self) : operation_completion(self) {
+    }
 };
 
 template<class Client>
@@ -36,35 +41,28 @@ struct unsubscribe_sender
     mqtt5::protocol::unsubscribe unsub;
 
     template<class Receiver>
-    struct operation
+    struct operation: in_flight_unsubscribe
     {
-        mqtt5::protocol::unsubscribe unsub;
         Client* client_;
         Receiver receiver_;
 
-        struct receiver: message_receiver_base<std::vector<std::uint8_t>>
-        {
-            Receiver next_;
-            receiver(Receiver &&next) : next_(std::move(next)) {
-            }
-            void set_value(std::vector<std::uint8_t> results) override {
-                p0443_v2::set_value(std::move(next_), std::move(results));
-            }
-            void set_done() override {
-                p0443_v2::set_done(std::move(next_));
-            }
-            void set_error(std::exception_ptr e) override {
-                p0443_v2::set_error(std::move(next_), std::move(e));
-            }
-        };
+        operation(mqtt5::protocol::unsubscribe unsub, Client *client, Receiver receiver)
+            : in_flight_unsubscribe(this), client_(client), receiver_(std::move(receiver)) {
+            this->message_ = std::move(unsub);
+        }
+
+        void on_value(std::vector<std::uint8_t> results) {
+            p0443_v2::set_value(std::move(receiver_), std::move(results));
+        }
+        void on_done() {
+            p0443_v2::set_done(std::move(receiver_));
+        }
+        void on_error(std::exception_ptr e) {
+            p0443_v2::set_error(std::move(receiver_), std::move(e));
+        }
 
         void start() {
-            in_flight_unsubscribe in_flight;
-            in_flight.message_ = std::move(unsub);
-            in_flight.receiver_ = std::make_unique<receiver>(std::move(receiver_));
-            in_flight.message_.packet_identifier = client_->next_packet_identifier();
-            client_->send_message(in_flight.message_);
-            client_->unsubscribe_messages_.emplace_back(std::move(in_flight));
+            client_->start_unsubscribe(*this);
         }
     };
 
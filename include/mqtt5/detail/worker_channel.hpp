@@ -0,0 +1,177 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "held_ack.hpp"
+#include "intrusive_list.hpp"
+#include "spsc_ring.hpp"
+
+#include <mqtt5/protocol/publish.hpp>
+#include <mqtt5/topic_filter.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <utility>
+
+namespace mqtt5
+{
+namespace detail
+{
+/**
+ * @brief Shared state of a worker channel.
+ *
+ * The client (on its executor) is the single producer and the worker thread is
+ * the single consumer of the ring. Publishes that do not fit are kept in a
+ * backlog on the client side, and the consumer wakes the client up once it has
+ * made room.
+ */
+struct worker_channel_state : intrusive_list_node<worker_channel_state>
+{
+    struct backlog_entry
+    {
+        protocol::publish publish_;
+        std::shared_ptr<held_ack> ack_;
+    };
+
+    topic_filter filter_;
+    spsc_ring<protocol::publish> ring_;
+    // Posts a backlog flush to the client executor, set before the channel is shared
+    std::function<void()> wake_;
+
+    std::atomic<bool> wake_requested_{false};
+    std::atomic<bool> closed_{false};
+    std::atomic<std::size_t> dropped_{0};
+
+    // Only accessed on the client executor
+    std::deque<backlog_entry> backlog_;
+
+    worker_channel_state(topic_filter filter, std::size_t capacity)
+        : filter_(std::move(filter)), ring_(capacity) {
+    }
+
+    /**
+     * @brief Hand a publish to the worker if nothing is backlogged and there is room.
+     */
+    bool offer(protocol::publish &publish) {
+        return backlog_.empty() && ring_.try_push(publish);
+    }
+
+    /**
+     * @brief Move as much of the backlog as possible into the ring.
+     *
+     * on_accepted is called with the held ack of every entry that was moved. If
+     * entries remain the consumer is asked to wake the client up.
+     */
+    template <class OnAccepted>
+    void flush_backlog(OnAccepted &&on_accepted) {
+        bool wake_armed = false;
+        while (!backlog_.empty()) {
+            auto &front = backlog_.front();
+            if (ring_.try_push(front.publish_)) {
+                auto ack = std::move(front.ack_);
+                backlog_.pop_front();
+                if (ack) {
+                    on_accepted(*ack);
+                }
+            }
+            else if (wake_armed) {
+                return;
+            }
+            else {
+                // Retry once after arming, the consumer may have made room before
+                // it could see the request
+                wake_requested_.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                wake_armed = true;
+            }
+        }
+    }
+
+    /**
+     * @brief Called by the consumer after it has taken values out of the ring.
+     */
+    void consumed() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (wake_requested_.load(std::memory_order_relaxed) &&
+            wake_requested_.exchange(false, std::memory_order_relaxed)) {
+            wake_();
+        }
+    }
+};
+} // namespace detail
+
+/**
+ * @brief Hands received publishes to a worker thread through a wait-free ring buffer.
+ *
+ * The client pushes every publish matching the channel's filter into the ring
+ * and a single worker thread consumes them, so application code never runs on
+ * the client's I/O thread.
+ *
+ * QoS 1 and 2 publishes are only acknowledged once every matching worker channel has
+ * accepted them into its ring. While a ring is full publishes are held on the client
+ * side without being acknowledged, so the server's receive maximum bounds how much
+ * is held. QoS 0 publishes that do not fit are dropped and counted.
+ *
+ * try_pop and consume_all must only be called from one thread at a time.
+ */
+class worker_channel
+{
+private:
+    std::shared_ptr<detail::worker_channel_state> state_;
+
+public:
+    explicit worker_channel(std::shared_ptr<detail::worker_channel_state> state)
+        : state_(std::move(state)) {
+    }
+
+    /**
+     * @brief Take the next publish, if there is one.
+     */
+    std::optional<protocol::publish> try_pop() {
+        auto retval = state_->ring_.try_pop();
+        if (retval) {
+            state_->consumed();
+        }
+        return retval;
+    }
+
+    /**
+     * @brief Pass every publish currently in the ring to fn.
+     *
+     * @return Number of publishes consumed.
+     */
+    template <class Fn>
+    std::size_t consume_all(Fn &&fn) {
+        auto count = state_->ring_.consume_all(std::forward<Fn>(fn));
+        if (count > 0) {
+            state_->consumed();
+        }
+        return count;
+    }
+
+    /**
+     * @brief Number of QoS 0 publishes dropped because the ring was full.
+     */
+    [[nodiscard]] std::size_t dropped() const {
+        return state_->dropped_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Stop delivering to this channel, safe to call from any thread.
+     *
+     * Publishes held for the channel are acknowledged and dropped.
+     */
+    void close() {
+        state_->closed_.store(true, std::memory_order_release);
+        state_->wake_();
+    }
+};
+} // namespace mqtt5
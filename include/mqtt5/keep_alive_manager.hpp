@@ -0,0 +1,267 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "detail/timer_wheel.hpp"
+
+#include <boost/asio/basic_waitable_timer.hpp>
+#include <boost/asio/post.hpp>
+#include <p0443_v2/asio/timer.hpp>
+#include <p0443_v2/submit.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace mqtt5
+{
+namespace detail
+{
+class keep_alive_wheel;
+
+/**
+ * @brief A connection watched by a keep_alive_manager.
+ *
+ * touch() is called for every received packet, it only stores the manager's current
+ * tick. The deadline is checked when the manager reaches it, and moved to the tick
+ * the connection was last active plus its limit if there was traffic since.
+ */
+class keep_alive_watch : private timer_wheel_entry
+{
+private:
+    friend class keep_alive_wheel;
+    keep_alive_wheel *wheel_ = nullptr;
+    std::atomic<std::uint64_t> last_activity_{0};
+    std::uint64_t limit_ = 0;
+    std::uint64_t registration_ = 0;
+
+public:
+    keep_alive_watch() = default;
+    keep_alive_watch(const keep_alive_watch &) = delete;
+    keep_alive_watch &operator=(const keep_alive_watch &) = delete;
+
+    inline void touch();
+
+    /**
+     * @brief Identifies the current watch, increases every time the connection is watched.
+     */
+    [[nodiscard]] std::uint64_t registration() const {
+        return registration_;
+    }
+
+protected:
+    ~keep_alive_watch() = default;
+
+    /**
+     * @brief The connection has been silent for its limit and is no longer watched.
+     *
+     * Called on the manager's executor with its lock held, it should only post the
+     * timeout to the connection's executor.
+     */
+    virtual void keep_alive_expired(std::uint64_t registration) = 0;
+};
+
+/**
+ * @brief The deadlines of a keep_alive_manager, counted in ticks.
+ *
+ * Not synchronized, the manager holds its lock for everything but touch() and now().
+ */
+class keep_alive_wheel
+{
+private:
+    timer_wheel wheel_;
+    std::atomic<std::uint64_t> now_{0};
+
+public:
+    /**
+     * @brief Watch a connection that must be active within limit ticks from now.
+     *
+     * A connection already watched is watched again with a new registration.
+     */
+    void watch(keep_alive_watch &watch, std::uint64_t limit) {
+        const auto now = now_.load(std::memory_order_relaxed);
+        watch.wheel_ = this;
+        watch.registration_++;
+        watch.limit_ = limit;
+        watch.last_activity_.store(now, std::memory_order_relaxed);
+        wheel_.schedule(watch, now + limit + 1);
+    }
+
+    void unwatch(keep_alive_watch &watch) {
+        wheel_.cancel(watch);
+    }
+
+    /**
+     * @brief Move to tick now, the connections silent since their deadline expire.
+     */
+    void advance(std::uint64_t now) {
+        now_.store(now, std::memory_order_relaxed);
+        wheel_.advance(now, [now, this](timer_wheel_entry &entry) {
+            auto &watch = static_cast<keep_alive_watch &>(entry);
+            // Activity within the current tick may have been recorded as the previous
+            // one, a deadline is never reached early
+            const auto deadline =
+                watch.last_activity_.load(std::memory_order_relaxed) + watch.limit_ + 1;
+            if (deadline > now) {
+                wheel_.schedule(watch, deadline);
+            }
+            else {
+                watch.keep_alive_expired(watch.registration_);
+            }
+        });
+    }
+
+    [[nodiscard]] std::uint64_t now() const {
+        return now_.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] std::size_t size() const {
+        return wheel_.size();
+    }
+
+    [[nodiscard]] bool empty() const {
+        return wheel_.empty();
+    }
+};
+} // namespace detail
+
+/**
+ * @brief Checks the keep-alive of many connections with a single timer.
+ *
+ * A client re-arming its own timer for every received packet costs a timer queue
+ * operation per packet. Clients sharing a manager instead record the tick they last
+ * received something at, and the manager keeps their deadlines in a timer wheel with
+ * buckets one tick wide. A deadline is checked once when its bucket is reached and
+ * either expires or is moved to the bucket of the last activity plus the limit.
+ *
+ * Connections are watched and unwatched from their own executors, the manager runs
+ * its timer on its own. Clients share it through a shared_ptr, which keeps it alive
+ * as long as one of them uses it. The manager must be created with std::make_shared,
+ * a pending check holds a reference too, so the manager is only destroyed once its
+ * timer is idle and never while its executor uses it.
+ *
+ * The timer uses Executor directly, a client accepts a manager with its own executor type.
+ */
+template <class Executor>
+class keep_alive_manager : public std::enable_shared_from_this<keep_alive_manager<Executor>>
+{
+public:
+    using executor_type = Executor;
+
+private:
+    using clock = std::chrono::steady_clock;
+    using timer_type =
+        boost::asio::basic_waitable_timer<clock, boost::asio::wait_traits<clock>, executor_type>;
+
+    std::mutex mutex_;
+    detail::keep_alive_wheel wheel_;
+    timer_type timer_;
+    const clock::time_point epoch_ = clock::now();
+    const clock::duration resolution_;
+    bool running_ = false;
+
+    struct sweep_receiver
+    {
+        std::shared_ptr<keep_alive_manager> manager_;
+        template <class... Values>
+        void set_value(Values &&...) {
+            manager_->sweep();
+        }
+        void set_done() {
+        }
+        template <class E>
+        void set_error(E &&) {
+        }
+    };
+
+    std::uint64_t current_tick() const {
+        return static_cast<std::uint64_t>((clock::now() - epoch_) / resolution_);
+    }
+
+    void arm() {
+        p0443_v2::submit(p0443_v2::asio::timer::wait_for(timer_, resolution_),
+                         sweep_receiver{this->shared_from_this()});
+    }
+
+    void sweep() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        wheel_.advance(current_tick());
+        running_ = !wheel_.empty();
+        if (running_) {
+            arm();
+        }
+    }
+
+public:
+    /**
+     * @brief Create a manager checking deadlines every resolution on executor.
+     *
+     * Timeouts are detected up to one resolution late.
+     */
+    explicit keep_alive_manager(const executor_type &executor,
+                                clock::duration resolution = std::chrono::seconds{1})
+        : timer_(executor), resolution_(resolution) {
+    }
+
+    keep_alive_manager(const keep_alive_manager &) = delete;
+    keep_alive_manager &operator=(const keep_alive_manager &) = delete;
+
+    /**
+     * @brief Start watching a connection that must receive something within limit.
+     *
+     * A connection already watched is watched again from now with the new limit.
+     */
+    void watch(detail::keep_alive_watch &watch, clock::duration limit) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) {
+            // Nothing was checked while idle, catch up first
+            wheel_.advance(current_tick());
+        }
+        // Rounded up, a connection is never reported before its limit
+        wheel_.watch(watch, static_cast<std::uint64_t>(
+                                (limit + resolution_ - clock::duration{1}) / resolution_));
+        if (!running_) {
+            running_ = true;
+            // The timer is only used from the manager's executor
+            boost::asio::post(timer_.get_executor(), [self = this->shared_from_this()] {
+                std::lock_guard<std::mutex> lock(self->mutex_);
+                self->arm();
+            });
+        }
+    }
+
+    /**
+     * @brief Stop watching a connection, it will not expire after this returns.
+     */
+    void unwatch(detail::keep_alive_watch &watch) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        wheel_.unwatch(watch);
+    }
+
+    /**
+     * @brief The current tick, as recorded by the last check.
+     */
+    [[nodiscard]] std::uint64_t now() const {
+        return wheel_.now();
+    }
+
+    /**
+     * @brief Number of connections watched.
+     */
+    [[nodiscard]] std::size_t size() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return wheel_.size();
+    }
+};
+
+void detail::keep_alive_watch::touch() {
+    if (wheel_) {
+        last_activity_.store(wheel_->now(), std::memory_order_relaxed);
+    }
+}
+} // namespace mqtt5
@@ -0,0 +1,374 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "mqtt5/session_store.hpp"
+#include "mqtt5/transport/data_fetcher.hpp"
+
+#include <boost/crc.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace mqtt5
+{
+/**
+ * @brief Session store backed by a memory-mapped journal file.
+ *
+ * Every state transition is appended to the mapped file as a CRC-checked record,
+ * so appending is a memcpy without any system call. An in-memory index of the live
+ * records is kept, and when the file is full the live records are copied into a
+ * new file, which replaces the old one.
+ *
+ * Opening an existing journal scans it once to rebuild the index. The scan stops at
+ * the first record with a bad checksum, which is where a crash interrupted an append.
+ *
+ * Records are written in native byte order, so a journal can't be moved between
+ * machines with different endianness. Data is written to the page cache, call flush()
+ * to also survive power loss.
+ */
+class mapped_session_store : public session_store
+{
+private:
+    enum class record_type : std::uint8_t {
+        publish_sent = 1,
+        publish_released,
+        publish_completed,
+        publish_received,
+        receive_completed
+    };
+
+    static constexpr std::uint32_t file_magic = 0x4a53514d; // "MQSJ"
+    // magic, epoch, 8 reserved bytes
+    static constexpr std::size_t file_header_size = 16;
+    // size including this header, crc of epoch and body
+    static constexpr std::size_t record_header_size = 8;
+    // type and packet identifier
+    static constexpr std::size_t min_body_size = 3;
+
+    struct outgoing_entry
+    {
+        std::size_t offset;
+        bool released;
+    };
+
+    std::string path_;
+    boost::interprocess::file_mapping mapping_;
+    boost::interprocess::mapped_region region_;
+    std::uint8_t *data_ = nullptr;
+    std::size_t capacity_ = 0;
+    std::size_t end_ = file_header_size;
+    // Bumped by clear(), records from an older epoch fail the checksum
+    std::uint32_t epoch_ = 1;
+
+    std::unordered_map<std::uint16_t, outgoing_entry> outgoing_;
+    std::unordered_map<std::uint16_t, std::size_t> incoming_;
+    std::vector<std::uint8_t> scratch_;
+
+    template <class T>
+    static T read(const std::uint8_t *src) {
+        T retval;
+        std::memcpy(&retval, src, sizeof(T));
+        return retval;
+    }
+
+    template <class T>
+    static void write(std::uint8_t *dst, T value) {
+        std::memcpy(dst, &value, sizeof(T));
+    }
+
+    std::uint32_t checksum(const std::uint8_t *body, std::size_t size) const {
+        boost::crc_32_type crc;
+        crc.process_bytes(&epoch_, sizeof(epoch_));
+        crc.process_bytes(body, size);
+        return crc.checksum();
+    }
+
+    static void create_file(const std::string &path, std::size_t size) {
+        std::ofstream(path, std::ios::binary | std::ios::app);
+        std::filesystem::resize_file(path, size);
+    }
+
+    void map(const std::string &path) {
+        mapping_ = boost::interprocess::file_mapping(path.c_str(), boost::interprocess::read_write);
+        region_ = boost::interprocess::mapped_region(mapping_, boost::interprocess::read_write);
+        data_ = static_cast<std::uint8_t *>(region_.get_address());
+        capacity_ = region_.get_size();
+    }
+
+    void unmap() {
+        region_ = boost::interprocess::mapped_region();
+        mapping_ = boost::interprocess::file_mapping();
+        data_ = nullptr;
+        capacity_ = 0;
+    }
+
+    void write_file_header() {
+        write<std::uint32_t>(data_, file_magic);
+        write<std::uint32_t>(data_ + 4, epoch_);
+    }
+
+    std::size_t record_size(std::size_t offset) const {
+        return read<std::uint32_t>(data_ + offset);
+    }
+
+    /**
+     * Rebuild the index from the journal, stopping at the first invalid record.
+     */
+    void scan() {
+        outgoing_.clear();
+        incoming_.clear();
+        end_ = file_header_size;
+        while (end_ + record_header_size <= capacity_) {
+            const auto size = record_size(end_);
+            if (size < record_header_size + min_body_size || size > capacity_ - end_) {
+                break;
+            }
+            const auto *body = data_ + end_ + record_header_size;
+            if (read<std::uint32_t>(data_ + end_ + 4) !=
+                checksum(body, size - record_header_size)) {
+                break;
+            }
+            apply(static_cast<record_type>(body[0]), read<std::uint16_t>(body + 1), end_);
+            end_ += size;
+        }
+    }
+
+    void apply(record_type type, std::uint16_t packet_identifier, std::size_t offset) {
+        switch (type) {
+        case record_type::publish_sent:
+            outgoing_[packet_identifier] = outgoing_entry{offset, false};
+            break;
+        case record_type::publish_released:
+            if (auto iter = outgoing_.find(packet_identifier); iter != outgoing_.end()) {
+                iter->second.released = true;
+            }
+            break;
+        case record_type::publish_completed:
+            outgoing_.erase(packet_identifier);
+            break;
+        case record_type::publish_received:
+            incoming_[packet_identifier] = offset;
+            break;
+        case record_type::receive_completed:
+            incoming_.erase(packet_identifier);
+            break;
+        }
+    }
+
+    void append(record_type type, std::uint16_t packet_identifier,
+                const protocol::publish *publish = nullptr) {
+        scratch_.clear();
+        scratch_.push_back(static_cast<std::uint8_t>(type));
+        scratch_.resize(min_body_size);
+        write<std::uint16_t>(scratch_.data() + 1, packet_identifier);
+        if (publish) {
+            scratch_.push_back(static_cast<std::uint8_t>(
+                (publish->retain_flag() ? 1 : 0) |
+                (static_cast<std::uint8_t>(publish->quality_of_service()) << 1)));
+            publish->serialize_body([this](std::uint8_t b) { scratch_.push_back(b); });
+        }
+
+        if (record_header_size + scratch_.size() > capacity_ - end_) {
+            compact(record_header_size + scratch_.size());
+        }
+        write_record(scratch_.data(), scratch_.size());
+    }
+
+    void write_record(const std::uint8_t *body, std::size_t body_size) {
+        const auto size = record_header_size + body_size;
+        auto *dst = data_ + end_;
+        std::memcpy(dst + record_header_size, body, body_size);
+        write<std::uint32_t>(dst + 4, checksum(body, body_size));
+        // The size is written last, a record is only visible once it is complete
+        write<std::uint32_t>(dst, static_cast<std::uint32_t>(size));
+        apply(static_cast<record_type>(body[0]), read<std::uint16_t>(body + 1), end_);
+        end_ += size;
+    }
+
+    /**
+     * Copy the live records to a new journal, growing it until it is at most half full.
+     */
+    void compact(std::size_t extra) {
+        std::vector<std::size_t> live;
+        std::size_t live_bytes = file_header_size + extra;
+        std::vector<std::uint16_t> released;
+        for (auto &[id, entry] : outgoing_) {
+            live.push_back(entry.offset);
+            live_bytes += record_size(entry.offset);
+            if (entry.released) {
+                released.push_back(id);
+                live_bytes += record_header_size + min_body_size;
+            }
+        }
+        for (auto &[id, offset] : incoming_) {
+            live.push_back(offset);
+            live_bytes += record_size(offset);
+        }
+        std::sort(live.begin(), live.end());
+
+        auto new_capacity = capacity_;
+        while (live_bytes > new_capacity / 2) {
+            new_capacity *= 2;
+        }
+
+        const auto tmp_path = path_ + ".compact";
+        std::filesystem::remove(tmp_path);
+        create_file(tmp_path, new_capacity);
+
+        {
+            auto old_mapping = std::move(mapping_);
+            auto old_region = std::move(region_);
+            auto *old_data = data_;
+            map(tmp_path);
+            write_file_header();
+            end_ = file_header_size;
+            // Records are copied verbatim, the epoch and therefore the checksum is unchanged
+            for (auto offset : live) {
+                const auto size = read<std::uint32_t>(old_data + offset);
+                std::memcpy(data_ + end_, old_data + offset, size);
+                end_ += size;
+            }
+        }
+        // Neither file may be mapped while it is replaced, Windows refuses to rename
+        // or replace a file that is mapped
+        unmap();
+        std::filesystem::rename(tmp_path, path_);
+        map(path_);
+
+        scan();
+        // Room for these was included when sizing the new journal
+        for (auto id : released) {
+            std::uint8_t body[min_body_size] = {
+                static_cast<std::uint8_t>(record_type::publish_released)};
+            write<std::uint16_t>(body + 1, id);
+            write_record(body, sizeof(body));
+        }
+    }
+
+    protocol::publish decode(std::size_t offset) const {
+        const auto size = record_size(offset);
+        const auto *body = data_ + offset + record_header_size;
+        const auto flags = body[min_body_size];
+
+        protocol::publish retval;
+        retval.set_quality_of_service(static_cast<quality_of_service>((flags >> 1) & 0x03));
+        retval.set_retain(flags & 0x01);
+        nonstd::span<const std::uint8_t> span(body + min_body_size + 1,
+                                              size - record_header_size - min_body_size - 1);
+        retval.deserialize(transport::span_byte_data_fetcher_t{span});
+        return retval;
+    }
+
+public:
+    /**
+     * @brief Open a journal, creating it if it doesn't exist.
+     *
+     * @param path Path of the journal file.
+     * @param capacity Initial size of the file, it grows as needed during compaction.
+     */
+    explicit mapped_session_store(std::string path, std::size_t capacity = 16 * 1024 * 1024)
+        : path_(std::move(path)) {
+        if (!std::filesystem::exists(path_) || std::filesystem::file_size(path_) < capacity) {
+            create_file(path_, std::max(capacity, file_header_size + record_header_size));
+        }
+        map(path_);
+        if (read<std::uint32_t>(data_) != file_magic) {
+            std::memset(data_, 0, file_header_size);
+            write_file_header();
+        }
+        else {
+            epoch_ = read<std::uint32_t>(data_ + 4);
+            scan();
+        }
+    }
+
+    mapped_session_store(const mapped_session_store &) = delete;
+    mapped_session_store &operator=(const mapped_session_store &) = delete;
+
+    void publish_sent(const protocol::publish &publish) override {
+        append(record_type::publish_sent, publish.packet_identifier, &publish);
+    }
+
+    void publish_released(std::uint16_t packet_identifier) override {
+        append(record_type::publish_released, packet_identifier);
+    }
+
+    void publish_completed(std::uint16_t packet_identifier) override {
+        append(record_type::publish_completed, packet_identifier);
+    }
+
+    void publish_received(const protocol::publish &publish) override {
+        append(record_type::publish_received, publish.packet_identifier, &publish);
+    }
+
+    void receive_completed(std::uint16_t packet_identifier) override {
+        append(record_type::receive_completed, packet_identifier);
+    }
+
+    stored_session recover() override {
+        std::vector<std::pair<std::size_t, std::uint16_t>> outgoing;
+        outgoing.reserve(outgoing_.size());
+        for (auto &[id, entry] : outgoing_) {
+            outgoing.emplace_back(entry.offset, id);
+        }
+        std::sort(outgoing.begin(), outgoing.end());
+
+        std::vector<std::size_t> incoming;
+        incoming.reserve(incoming_.size());
+        for (auto &[id, offset] : incoming_) {
+            incoming.push_back(offset);
+        }
+        std::sort(incoming.begin(), incoming.end());
+
+        stored_session retval;
+        for (auto &[offset, id] : outgoing) {
+            retval.outgoing.emplace_back(decode(offset));
+            if (outgoing_[id].released) {
+                retval.released.push_back(id);
+            }
+        }
+        for (auto offset : incoming) {
+            retval.incoming.emplace_back(decode(offset));
+        }
+        return retval;
+    }
+
+    void clear() override {
+        epoch_++;
+        write_file_header();
+        end_ = file_header_size;
+        outgoing_.clear();
+        incoming_.clear();
+    }
+
+    /**
+     * @brief Write the mapped pages to disk.
+     *
+     * Not needed to survive a process crash, only to survive power loss.
+     */
+    void flush() {
+        region_.flush();
+    }
+
+    /**
+     * @brief Number of bytes of the journal currently in use.
+     */
+    [[nodiscard]] std::size_t size() const {
+        return end_;
+    }
+};
+} // namespace mqtt5
@@ -431,6 +431,10 @@ struct connack
         deserialize(fetcher);
     }
 
+    [[nodiscard]] bool session_present() const {
+        return flags & 0x01;
+    }
+
     template <class Stream>
     void deserialize(transport::data_fetcher<Stream> fetcher) {
         flags = fixed_int<std::uint8_t>::deserialize(fetcher);
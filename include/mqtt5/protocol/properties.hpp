@@ -156,7 +156,7 @@ struct property
         case 9:
             ACTIVATE(5);
         case 11:
-            ACTIVATE(5);
+            ACTIVATE(3);
         case 17:
             ACTIVATE(2);
         case 18:
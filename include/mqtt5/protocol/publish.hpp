@@ -68,7 +68,7 @@ public:
                 }
                 else if (prop.identifier == ids::message_expiry_interval) {
                     retval.message_expiry_interval =
-                        decltype(retval.message_expiry_interval){prop.value_as<std::uint16_t>()};
+                        decltype(retval.message_expiry_interval){prop.value_as<std::uint32_t>()};
                 }
                 else if (prop.identifier == ids::topic_alias) {
                     set_value(retval.topic_alias, prop);
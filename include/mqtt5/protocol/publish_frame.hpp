@@ -0,0 +1,258 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <mqtt5/protocol/fixed_int.hpp>
+#include <mqtt5/protocol/publish.hpp>
+#include <mqtt5/protocol/string.hpp>
+#include <mqtt5/protocol/varlen_int.hpp>
+#include <mqtt5/quality_of_service.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace mqtt5::protocol
+{
+/**
+ * @brief A publish encoded once, to be sent to many receivers.
+ *
+ * The topic, properties and payload are encoded into a shared immutable buffer. What
+ * differs per receiver, the fixed header with QoS, retain and DUP flags and the packet
+ * identifier, is written separately around it. The frame is laid out as:
+ *
+ * [fixed header][topic = data[0, topic_size)][packet identifier][data[topic_size, size)]
+ *
+ * Topic aliases are never encoded, they are specific to a connection. Neither are
+ * subscription identifiers, they are specific to a subscription. A receiver's identifier
+ * is written in front of the properties, data[topic_size, properties_offset) with the
+ * property length is replaced for it. A message expiry interval is encoded as the first
+ * property, so a receiver can be sent the remaining interval in its place.
+ */
+class publish_frame
+{
+public:
+    using data_ptr = std::shared_ptr<const std::vector<std::uint8_t>>;
+
+private:
+    data_ptr data_;
+    std::uint32_t topic_size_ = 0;
+    // Offset of the first property in data_, after the property length
+    std::uint32_t properties_offset_ = 0;
+    // Property length as encoded in data_
+    std::uint32_t properties_size_ = 0;
+    // Offset of the four byte expiry interval in data_, 0 if there is none
+    std::uint32_t expiry_offset_ = 0;
+    std::uint8_t flags_ = 0;
+
+    static std::size_t varlen_size(std::uint32_t value) {
+        std::size_t retval = 1;
+        while (value >= 128) {
+            value /= 128;
+            retval++;
+        }
+        return retval;
+    }
+
+public:
+    publish_frame() = default;
+
+    explicit publish_frame(const publish &message) {
+        auto data = std::make_shared<std::vector<std::uint8_t>>();
+        auto writer = [&data](std::uint8_t b) { data->push_back(b); };
+        string::serialize(message.topic, writer);
+        topic_size_ = static_cast<std::uint32_t>(data->size());
+        const auto expiry = message.properties.message_expiry_interval;
+        if (message.properties.topic_alias == 0 &&
+            message.properties.subscription_identifier == 0 && expiry.count() == 0) {
+            message.properties.serialize(writer);
+            std::size_t length_size = 0;
+            while ((*data)[topic_size_ + length_size++] & 0x80) {
+            }
+            properties_offset_ = static_cast<std::uint32_t>(topic_size_ + length_size);
+            properties_size_ = static_cast<std::uint32_t>(data->size() - properties_offset_);
+        }
+        else {
+            auto properties = message.properties;
+            properties.topic_alias = 0;
+            properties.subscription_identifier = 0;
+            properties.message_expiry_interval = decltype(expiry){0};
+            std::vector<std::uint8_t> encoded;
+            properties.serialize([&encoded](std::uint8_t b) { encoded.push_back(b); });
+            // Replace the length with one that includes the interval in front
+            std::size_t length_size = 0;
+            while (encoded[length_size++] & 0x80) {
+            }
+            properties_size_ = static_cast<std::uint32_t>(encoded.size() - length_size +
+                                                          (expiry.count() != 0 ? 5 : 0));
+            varlen_int::serialize(properties_size_, writer);
+            properties_offset_ = static_cast<std::uint32_t>(data->size());
+            if (expiry.count() != 0) {
+                writer(property_ids::message_expiry_interval);
+                expiry_offset_ = static_cast<std::uint32_t>(data->size());
+                fixed_int<std::uint32_t>::serialize(expiry.count(), writer);
+            }
+            data->insert(data->end(), encoded.begin() + length_size, encoded.end());
+        }
+        data->insert(data->end(), message.payload.begin(), message.payload.end());
+        data_ = std::move(data);
+        flags_ = static_cast<std::uint8_t>(
+            (static_cast<std::uint8_t>(message.quality_of_service()) << 1) |
+            (message.retain_flag() ? 1 : 0));
+    }
+
+    [[nodiscard]] bool empty() const {
+        return !data_;
+    }
+
+    [[nodiscard]] const data_ptr &data() const {
+        return data_;
+    }
+
+    /**
+     * @brief Size of the encoded topic at the start of data().
+     */
+    [[nodiscard]] std::size_t topic_size() const {
+        return topic_size_;
+    }
+
+    [[nodiscard]] std::size_t size() const {
+        return data_->size();
+    }
+
+    /**
+     * @brief Offset of the first property in data(), after the property length.
+     */
+    [[nodiscard]] std::size_t properties_offset() const {
+        return properties_offset_;
+    }
+
+    /**
+     * @brief Bytes added to the packet by a receiver's subscription identifier.
+     */
+    [[nodiscard]] std::size_t subscription_identifier_size(std::uint32_t identifier) const {
+        if (identifier == 0) {
+            return 0;
+        }
+        const auto with_identifier = properties_size_ + 1 + varlen_size(identifier);
+        return with_identifier + varlen_size(static_cast<std::uint32_t>(with_identifier)) -
+               (properties_offset_ - topic_size_) - properties_size_;
+    }
+
+    /**
+     * @brief Write the property length and subscription identifier for one receiver.
+     *
+     * Replaces data[topic_size, properties_offset), identifier must not be 0.
+     */
+    template <class Writer>
+    void serialize_subscription_identifier(std::uint32_t identifier, Writer &&writer) const {
+        varlen_int::serialize(
+            static_cast<std::uint32_t>(properties_size_ + 1 + varlen_size(identifier)), writer);
+        writer(property_ids::subscription_identifier);
+        varlen_int::serialize(identifier, writer);
+    }
+
+    /**
+     * @brief Offset of the encoded message expiry interval in data(), 0 if there is none.
+     */
+    [[nodiscard]] std::size_t expiry_offset() const {
+        return expiry_offset_;
+    }
+
+    /**
+     * @brief Message expiry interval of the original publish, 0 if it never expires.
+     */
+    [[nodiscard]] std::chrono::duration<std::uint32_t> message_expiry_interval() const {
+        if (expiry_offset_ == 0) {
+            return std::chrono::duration<std::uint32_t>{0};
+        }
+        const auto *bytes = data_->data() + expiry_offset_;
+        return std::chrono::duration<std::uint32_t>{
+            (std::uint32_t(bytes[0]) << 24) | (std::uint32_t(bytes[1]) << 16) |
+            (std::uint32_t(bytes[2]) << 8) | std::uint32_t(bytes[3])};
+    }
+
+    /**
+     * @brief QoS of the original publish.
+     */
+    [[nodiscard]] mqtt5::quality_of_service quality_of_service() const {
+        return static_cast<mqtt5::quality_of_service>((flags_ >> 1) & 0x03);
+    }
+
+    /**
+     * @brief Retain flag of the original publish.
+     */
+    [[nodiscard]] bool retain_flag() const {
+        return flags_ & 0x01;
+    }
+
+    /**
+     * @brief Write the fixed header for one receiver.
+     *
+     * @param subscription_identifier Identifier the receiver is sent, 0 for none.
+     */
+    template <class Writer>
+    void serialize_header(mqtt5::quality_of_service qos, bool retain, bool duplicate,
+                          std::uint32_t subscription_identifier, Writer &&writer) const {
+        const auto has_identifier = qos != mqtt5::quality_of_service::qos0;
+        writer(static_cast<std::uint8_t>((publish::type_value << 4) |
+                                         (duplicate && has_identifier ? 0x08 : 0) |
+                                         (static_cast<std::uint8_t>(qos) << 1) |
+                                         (retain ? 1 : 0)));
+        varlen_int::serialize(
+            static_cast<std::uint32_t>(size() + (has_identifier ? 2 : 0) +
+                                       subscription_identifier_size(subscription_identifier)),
+            writer);
+    }
+
+    /**
+     * @brief Write the complete packet for one receiver, byte by byte.
+     *
+     * The packet identifier is only written for QoS 1 and 2. If the frame has a message
+     * expiry interval remaining_expiry is written in its place. A subscription_identifier
+     * other than 0 is written as the first property.
+     */
+    template <class Writer>
+    void serialize(mqtt5::quality_of_service qos, bool retain, bool duplicate,
+                   std::uint16_t packet_identifier,
+                   std::chrono::duration<std::uint32_t> remaining_expiry,
+                   std::uint32_t subscription_identifier, Writer &&writer) const {
+        serialize_header(qos, retain, duplicate, subscription_identifier, writer);
+        const auto &data = *data_;
+        for (std::size_t i = 0; i < topic_size_; i++) {
+            writer(data[i]);
+        }
+        if (qos != mqtt5::quality_of_service::qos0) {
+            fixed_int<std::uint16_t>::serialize(packet_identifier, writer);
+        }
+        auto rest = std::size_t(topic_size_);
+        if (subscription_identifier != 0) {
+            serialize_subscription_identifier(subscription_identifier, writer);
+            rest = properties_offset_;
+        }
+        if (expiry_offset_ != 0) {
+            for (; rest < expiry_offset_; rest++) {
+                writer(data[rest]);
+            }
+            fixed_int<std::uint32_t>::serialize(remaining_expiry.count(), writer);
+            rest += 4;
+        }
+        for (; rest < data.size(); rest++) {
+            writer(data[rest]);
+        }
+    }
+
+    template <class Writer>
+    void serialize(mqtt5::quality_of_service qos, bool retain, bool duplicate,
+                   std::uint16_t packet_identifier, Writer &&writer) const {
+        serialize(qos, retain, duplicate, packet_identifier, message_expiry_interval(), 0,
+                  std::forward<Writer>(writer));
+    }
+};
+} // namespace mqtt5::protocol
@@ -0,0 +1,41 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+namespace mqtt5
+{
+/**
+ * @brief Options for a supervised connection, see client::supervisor.
+ */
+struct reconnect_options
+{
+    /**
+     * Upper bound of the delay before the first reconnect attempt.
+     */
+    std::chrono::milliseconds initial_delay{100};
+
+    /**
+     * The delay bound is multiplied by this after every failed attempt.
+     */
+    double multiplier = 2.0;
+
+    /**
+     * Highest delay bound.
+     */
+    std::chrono::milliseconds max_delay{30000};
+
+    /**
+     * Topic and payload bytes of publishes buffered while disconnected.
+     *
+     * QoS 1 and 2 publishes that don't fit complete with done, QoS 0 publishes
+     * that don't fit are dropped.
+     */
+    std::size_t offline_buffer_size = 1024 * 1024;
+};
+} // namespace mqtt5
@@ -0,0 +1,214 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "mqtt5/protocol/publish.hpp"
+#include "mqtt5/topic_filter.hpp"
+
+#include <boost/utility/string_view.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace mqtt5
+{
+/**
+ * @brief Retained messages indexed by topic level.
+ *
+ * Topics are stored in a trie with one node per level, so a filter like
+ * "sensors/+/temp" only visits the branches it can match. Messages are immutable
+ * and shared, handing one out never copies its payload.
+ */
+class retained_store
+{
+public:
+    using message_ptr = std::shared_ptr<const protocol::publish>;
+
+private:
+    struct node
+    {
+        // Keys point into the level stored in each child
+        std::unordered_map<std::string_view, std::unique_ptr<node>> children;
+        std::string level;
+        message_ptr message;
+    };
+
+    node root_;
+    std::size_t size_ = 0;
+    std::vector<boost::string_view> levels_;
+
+    static std::string_view to_std(boost::string_view v) {
+        return std::string_view(v.data(), v.size());
+    }
+
+    static bool is_system(const node &n) {
+        return !n.level.empty() && n.level.front() == '$';
+    }
+
+    template <class F>
+    static void visit_all(const node &n, F &f) {
+        if (n.message) {
+            f(n.message);
+        }
+        for (auto &[level, child] : n.children) {
+            visit_all(*child, f);
+        }
+    }
+
+    template <class F>
+    void match(const node &n, std::size_t index, F &f) const {
+        if (index == levels_.size()) {
+            if (n.message) {
+                f(n.message);
+            }
+            return;
+        }
+        const auto &level = levels_[index];
+        // Wildcards at the first level don't match topics starting with '$'
+        const bool skip_system = &n == &root_;
+        if (level == "#") {
+            // "a/#" also matches "a"
+            if (n.message && &n != &root_) {
+                f(n.message);
+            }
+            for (auto &[name, child] : n.children) {
+                if (!skip_system || !is_system(*child)) {
+                    visit_all(*child, f);
+                }
+            }
+        }
+        else if (level == "+") {
+            for (auto &[name, child] : n.children) {
+                if (!skip_system || !is_system(*child)) {
+                    match(*child, index + 1, f);
+                }
+            }
+        }
+        else if (auto iter = n.children.find(to_std(level)); iter != n.children.end()) {
+            match(*iter->second, index + 1, f);
+        }
+    }
+
+public:
+    /**
+     * @brief Copy a publish into the shared form kept by the store.
+     */
+    static message_ptr make_message(const protocol::publish &publish) {
+        auto retval = std::make_shared<protocol::publish>(publish);
+        retval->payload.shrink_to_fit();
+        retval->properties.topic_alias = 0;
+        retval->packet_identifier = 0;
+        retval->set_duplicate(false);
+        retval->set_retain(true);
+        return retval;
+    }
+
+    retained_store() = default;
+    retained_store(const retained_store &) = delete;
+    retained_store &operator=(const retained_store &) = delete;
+
+    /**
+     * @brief Store a retained publish, an empty payload removes the topic instead.
+     */
+    void store(const protocol::publish &publish) {
+        if (publish.payload.empty()) {
+            erase(publish.topic);
+            return;
+        }
+        store(make_message(publish));
+    }
+
+    /**
+     * @brief Store a message created by make_message, which must have a payload.
+     */
+    void store(message_ptr message) {
+        split_topic_levels(message->topic, levels_);
+        node *current = &root_;
+        for (auto level : levels_) {
+            auto iter = current->children.find(to_std(level));
+            if (iter == current->children.end()) {
+                auto created = std::make_unique<node>();
+                created->level = std::string(level.data(), level.size());
+                auto key = std::string_view(created->level);
+                iter = current->children.emplace(key, std::move(created)).first;
+            }
+            current = iter->second.get();
+        }
+        if (!current->message) {
+            size_++;
+        }
+        current->message = std::move(message);
+    }
+
+    /**
+     * @return true if a message was stored for the topic.
+     */
+    bool erase(boost::string_view topic) {
+        split_topic_levels(topic, levels_);
+        std::vector<node *> path{&root_};
+        for (auto level : levels_) {
+            auto iter = path.back()->children.find(to_std(level));
+            if (iter == path.back()->children.end()) {
+                return false;
+            }
+            path.push_back(iter->second.get());
+        }
+        if (!path.back()->message) {
+            return false;
+        }
+        path.back()->message.reset();
+        size_--;
+
+        // Remove the nodes that no longer lead to a message
+        while (path.size() > 1 && !path.back()->message && path.back()->children.empty()) {
+            auto *child = path.back();
+            path.pop_back();
+            path.back()->children.erase(std::string_view(child->level));
+        }
+        return true;
+    }
+
+    /**
+     * @brief The message retained for a topic name, or nullptr.
+     */
+    [[nodiscard]] message_ptr find(boost::string_view topic) {
+        split_topic_levels(topic, levels_);
+        const node *current = &root_;
+        for (auto level : levels_) {
+            auto iter = current->children.find(to_std(level));
+            if (iter == current->children.end()) {
+                return nullptr;
+            }
+            current = iter->second.get();
+        }
+        return current->message;
+    }
+
+    /**
+     * @brief Call f(const message_ptr&) for every message matching a topic filter.
+     *
+     * Messages are visited as they are found, nothing is collected first. The store
+     * must not be modified from f.
+     */
+    template <class F>
+    void for_each_match(boost::string_view filter, F &&f) {
+        split_topic_levels(filter, levels_);
+        match(root_, 0, f);
+    }
+
+    [[nodiscard]] std::size_t size() const {
+        return size_;
+    }
+
+    [[nodiscard]] bool empty() const {
+        return size_ == 0;
+    }
+};
+} // namespace mqtt5
@@ -0,0 +1,44 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace mqtt5
+{
+struct server_options
+{
+    /**
+     * Time a client has to send CONNECT after the connection is accepted.
+     */
+    std::chrono::seconds connect_timeout{10};
+
+    /**
+     * Keep alive imposed on clients, 0 uses the keep alive the client requested.
+     */
+    std::chrono::duration<std::uint16_t> server_keep_alive{0};
+
+    /**
+     * Incoming QoS 2 publishes a client may have waiting for PUBREL. QoS 1 publishes
+     * are acknowledged as soon as they have been handled, so they are never
+     * outstanding and don't count against it.
+     */
+    std::uint16_t receive_maximum = 1024;
+
+    /**
+     * Highest topic alias a client may use, 0 disables topic aliases.
+     */
+    std::uint16_t topic_alias_maximum = 0;
+
+    /**
+     * Outgoing QoS 1 and 2 publishes queued per session while the client's receive
+     * maximum is exhausted. Publishes beyond this are dropped.
+     */
+    std::size_t max_queued_publishes = 1000;
+};
+} // namespace mqtt5
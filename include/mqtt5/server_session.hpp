@@ -0,0 +1,834 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "connection.hpp"
+#include "detail/inbound_topic_aliases.hpp"
+#include "detail/intrusive_list.hpp"
+
+#include "mqtt5/connect_reason_code.hpp"
+#include "mqtt5/disconnect_reason.hpp"
+#include "mqtt5/protocol/connect.hpp"
+#include "mqtt5/protocol/control_packet.hpp"
+#include "mqtt5/protocol/disconnect.hpp"
+#include "mqtt5/protocol/ping.hpp"
+#include "mqtt5/protocol/publish.hpp"
+#include "mqtt5/protocol/publish_frame.hpp"
+#include "mqtt5/protocol/subscribe.hpp"
+#include "mqtt5/protocol/unsubscribe.hpp"
+#include "mqtt5/quality_of_service.hpp"
+#include "mqtt5/server_options.hpp"
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <p0443_v2/asio/timer.hpp>
+#include <p0443_v2/asio/write_all.hpp>
+#include <p0443_v2/submit.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace mqtt5
+{
+class server_session_base;
+
+/**
+ * @brief Receives the events of server sessions, implemented by the application or a broker.
+ *
+ * All functions are called on the executor of the session.
+ */
+class session_handler
+{
+public:
+    virtual ~session_handler() = default;
+
+    /**
+     * @brief A client sent CONNECT.
+     *
+     * @return Anything but success rejects the client with that reason code.
+     */
+    virtual connect_reason_code on_connect(server_session_base &session,
+                                           const protocol::connect &connect) {
+        return connect_reason_code::success;
+    }
+
+    /**
+     * @brief A publish was received.
+     *
+     * QoS 2 publishes are passed on once, when the PUBLISH is received. The will
+     * message of a client that disconnects without DISCONNECT is passed on as well.
+     */
+    virtual void on_publish(server_session_base &session, const protocol::publish &publish) = 0;
+
+    /**
+     * @return One SUBACK reason code per topic filter.
+     */
+    virtual std::vector<std::uint8_t> on_subscribe(server_session_base &session,
+                                                   const protocol::subscribe &subscribe) = 0;
+
+    /**
+     * @return One UNSUBACK reason code per topic filter.
+     */
+    virtual std::vector<std::uint8_t> on_unsubscribe(server_session_base &session,
+                                                     const protocol::unsubscribe &unsubscribe) = 0;
+
+    /**
+     * @brief A connected session was closed, nothing is delivered to it after this.
+     */
+    virtual void on_close(server_session_base &session) {
+    }
+};
+
+/**
+ * @brief The part of a server session that doesn't depend on the stream type.
+ */
+class server_session_base : public detail::intrusive_list_node<server_session_base>
+{
+protected:
+    std::string client_id_;
+
+public:
+    virtual ~server_session_base() = default;
+
+    /**
+     * @brief The client identifier, assigned by the server if the client sent none.
+     */
+    [[nodiscard]] const std::string &client_id() const {
+        return client_id_;
+    }
+
+    /**
+     * @brief Send an encoded publish to the client, must be called on the session's executor.
+     *
+     * QoS 1 and 2 publishes get a packet identifier assigned. They are queued while
+     * the client's receive maximum is exhausted, and dropped if the queue is full or
+     * the session is closed.
+     *
+     * @param qos QoS to send with, the QoS of the frame is ignored.
+     * @param subscription_identifier Identifier of the matching subscription, 0 for none.
+     */
+    virtual void deliver(const protocol::publish_frame &frame, quality_of_service qos,
+                         bool retain, std::uint32_t subscription_identifier) = 0;
+
+    /**
+     * @brief Send a publish to the client, must be called on the session's executor.
+     */
+    void deliver(const protocol::publish &publish) {
+        deliver(protocol::publish_frame(publish), publish.quality_of_service(),
+                publish.retain_flag(), publish.properties.subscription_identifier);
+    }
+
+    /**
+     * @brief Close the connection.
+     */
+    virtual void close() = 0;
+
+    /**
+     * @brief Number of outgoing publishes that are queued or waiting for acknowledgement.
+     */
+    [[nodiscard]] virtual std::size_t backlog() const = 0;
+};
+
+namespace detail
+{
+/**
+ * @brief Owns server sessions and destroys them once they are finished.
+ */
+class session_owner
+{
+public:
+    virtual ~session_owner() = default;
+    virtual void release(server_session_base &session) = 0;
+};
+
+inline std::string assign_client_id() {
+    static std::atomic<std::uint64_t> next_id{1};
+    return "mqtt5-" + std::to_string(next_id.fetch_add(1, std::memory_order_relaxed));
+}
+} // namespace detail
+
+/**
+ * @brief The server side of an MQTT connection.
+ *
+ * Handles the CONNECT handshake, keep alive enforcement and the QoS 1 and 2 flows in
+ * both directions. Everything else is left to a session_handler.
+ *
+ * Outgoing packets are serialized into a buffer that is written with a single write,
+ * packets added while a write is in progress go into the next one. Sessions don't
+ * support session resumption, CONNACK never has session present set.
+ *
+ * The session is started by its owner and released to it once it is closed and has
+ * no operations in progress.
+ */
+template <class Stream>
+class server_session : public server_session_base
+{
+public:
+    using executor_type = typename connection<Stream>::executor_type;
+
+private:
+    using timer_type = boost::asio::basic_waitable_timer<
+        std::chrono::steady_clock, boost::asio::wait_traits<std::chrono::steady_clock>,
+        executor_type>;
+
+    enum class state_type { waiting_connect, connected, closed };
+
+    struct queued_publish
+    {
+        protocol::publish_frame frame;
+        quality_of_service qos;
+        bool retain;
+        std::uint32_t subscription_identifier;
+        std::chrono::steady_clock::time_point queued_at;
+    };
+
+    // A piece of a write, either a range of the session's own buffer or of a shared frame
+    struct write_segment
+    {
+        protocol::publish_frame::data_ptr shared;
+        std::size_t begin;
+        std::size_t end;
+    };
+
+    // Frames smaller than this are copied instead of referenced
+    static constexpr std::size_t min_shared_frame_size = 256;
+
+    struct outgoing_publish
+    {
+        enum class state_type { waiting_puback, waiting_pubrec, waiting_pubcomp };
+        std::uint16_t packet_identifier_;
+        state_type state_;
+    };
+
+    connection<Stream> connection_;
+    session_handler *handler_;
+    detail::session_owner *owner_;
+    const server_options *options_;
+    state_type state_ = state_type::waiting_connect;
+
+    // Read, write and timer operations in progress
+    int pending_operations_ = 0;
+
+    std::vector<std::uint8_t> pending_writes_;
+    std::vector<write_segment> pending_segments_;
+    std::vector<std::uint8_t> writing_;
+    std::vector<write_segment> writing_segments_;
+    std::vector<boost::asio::const_buffer> write_buffers_;
+    bool write_in_progress_ = false;
+    bool close_after_write_ = false;
+
+    timer_type keep_alive_timer_;
+    // Lets a cancelled wait that completes with a value be told apart from the current one
+    std::uint32_t timer_generation_ = 0;
+    std::chrono::steady_clock::duration keep_alive_limit_{0};
+    std::chrono::steady_clock::time_point last_received_;
+
+    detail::inbound_topic_aliases inbound_topic_aliases_;
+    std::vector<std::uint16_t> incoming_qos2_;
+
+    std::vector<outgoing_publish> outgoing_;
+    // Allocated on first use, an empty std::deque already allocates
+    std::unique_ptr<std::deque<queued_publish>> queued_;
+    std::uint16_t send_quota_ = 0;
+    std::uint16_t next_packet_identifier_ = 1;
+
+    std::unique_ptr<protocol::publish> will_;
+
+    struct read_receiver
+    {
+        server_session *session_;
+        void set_value(protocol::control_packet &&packet) {
+            auto *session = session_;
+            session->pending_operations_--;
+            if (session->state_ != state_type::closed) {
+                session->handle_packet(packet);
+            }
+            if (session->state_ != state_type::closed) {
+                session->start_read();
+            }
+            else {
+                session->maybe_release();
+            }
+        }
+        void set_done() {
+            auto *session = session_;
+            session->pending_operations_--;
+            session->close();
+            session->maybe_release();
+        }
+        void set_error(std::exception_ptr) {
+            // Malformed packets end up here as well
+            set_done();
+        }
+    };
+
+    struct write_receiver
+    {
+        server_session *session_;
+        template <class... Values>
+        void set_value(Values &&...) {
+            auto *session = session_;
+            session->pending_operations_--;
+            session->write_in_progress_ = false;
+            session->writing_.clear();
+            session->writing_segments_.clear();
+            if (session->state_ != state_type::closed) {
+                if (!session->pending_segments_.empty()) {
+                    session->start_write();
+                }
+                else if (session->close_after_write_) {
+                    session->close();
+                }
+            }
+            session->maybe_release();
+        }
+        void set_done() {
+            auto *session = session_;
+            session->pending_operations_--;
+            session->write_in_progress_ = false;
+            session->close();
+            session->maybe_release();
+        }
+        void set_error(std::exception_ptr) {
+            set_done();
+        }
+    };
+
+    struct timer_receiver
+    {
+        server_session *session_;
+        std::uint32_t generation_;
+        template <class... Values>
+        void set_value(Values &&...) {
+            auto *session = session_;
+            session->pending_operations_--;
+            if (session->state_ != state_type::closed &&
+                generation_ == session->timer_generation_) {
+                session->check_keep_alive();
+            }
+            session->maybe_release();
+        }
+        void set_done() {
+            auto *session = session_;
+            session->pending_operations_--;
+            session->maybe_release();
+        }
+        void set_error(std::exception_ptr) {
+            set_done();
+        }
+    };
+
+    void start_read() {
+        pending_operations_++;
+        p0443_v2::submit(connection_.control_packet_reader(), read_receiver{this});
+    }
+
+    /**
+     * Mark the bytes written to pending_writes_ since begin as part of the next write.
+     */
+    void add_local_segment(std::size_t begin) {
+        const auto end = pending_writes_.size();
+        if (!pending_segments_.empty() && !pending_segments_.back().shared &&
+            pending_segments_.back().end == begin) {
+            pending_segments_.back().end = end;
+        }
+        else {
+            pending_segments_.push_back(write_segment{nullptr, begin, end});
+        }
+    }
+
+    void flush() {
+        if (!write_in_progress_) {
+            start_write();
+        }
+    }
+
+    template <class Packet>
+    void send(const Packet &packet) {
+        if (state_ == state_type::closed || close_after_write_) {
+            return;
+        }
+        const auto begin = pending_writes_.size();
+        packet.serialize([this](std::uint8_t b) { pending_writes_.push_back(b); });
+        add_local_segment(begin);
+        flush();
+    }
+
+    /**
+     * Large frames are written straight from the shared buffer, only the fixed header
+     * and packet identifier are written to the session's own buffer.
+     */
+    void send(const protocol::publish_frame &frame, quality_of_service qos, bool retain,
+              std::uint16_t packet_identifier,
+              std::chrono::duration<std::uint32_t> remaining_expiry,
+              std::uint32_t subscription_identifier) {
+        if (state_ == state_type::closed || close_after_write_) {
+            return;
+        }
+        auto writer = [this](std::uint8_t b) { pending_writes_.push_back(b); };
+        auto begin = pending_writes_.size();
+        if (frame.size() < min_shared_frame_size) {
+            frame.serialize(qos, retain, false, packet_identifier, remaining_expiry,
+                            subscription_identifier, writer);
+            add_local_segment(begin);
+        }
+        else {
+            frame.serialize_header(qos, retain, false, subscription_identifier, writer);
+            add_local_segment(begin);
+            pending_segments_.push_back(write_segment{frame.data(), 0, frame.topic_size()});
+            begin = pending_writes_.size();
+            if (qos != 0_qos) {
+                protocol::fixed_int<std::uint16_t>::serialize(packet_identifier, writer);
+            }
+            auto rest = frame.topic_size();
+            if (subscription_identifier != 0) {
+                // The property length differs too, written along with the identifier
+                frame.serialize_subscription_identifier(subscription_identifier, writer);
+                rest = frame.properties_offset();
+            }
+            if (pending_writes_.size() != begin) {
+                add_local_segment(begin);
+            }
+            if (frame.expiry_offset() != 0 &&
+                remaining_expiry != frame.message_expiry_interval()) {
+                // Only the interval differs, the rest of the frame is still shared
+                pending_segments_.push_back(
+                    write_segment{frame.data(), rest, frame.expiry_offset()});
+                begin = pending_writes_.size();
+                protocol::fixed_int<std::uint32_t>::serialize(remaining_expiry.count(), writer);
+                add_local_segment(begin);
+                rest = frame.expiry_offset() + 4;
+            }
+            pending_segments_.push_back(write_segment{frame.data(), rest, frame.size()});
+        }
+        flush();
+    }
+
+    void send(const protocol::publish_frame &frame, quality_of_service qos, bool retain,
+              std::uint16_t packet_identifier, std::uint32_t subscription_identifier) {
+        send(frame, qos, retain, packet_identifier, frame.message_expiry_interval(),
+             subscription_identifier);
+    }
+
+    /**
+     * Interval left of a queued publish, or nullopt if it has expired.
+     */
+    static std::optional<std::chrono::duration<std::uint32_t>>
+    remaining_expiry(const queued_publish &queued, std::chrono::steady_clock::time_point now) {
+        const auto interval = queued.frame.message_expiry_interval();
+        if (interval.count() == 0) {
+            return interval;
+        }
+        const auto waited =
+            std::chrono::duration_cast<std::chrono::seconds>(now - queued.queued_at).count();
+        if (waited >= interval.count()) {
+            return std::nullopt;
+        }
+        return std::chrono::duration<std::uint32_t>{
+            interval.count() - static_cast<std::uint32_t>(waited)};
+    }
+
+    void start_write() {
+        std::swap(writing_, pending_writes_);
+        std::swap(writing_segments_, pending_segments_);
+        // Don't keep the buffer of a burst around for the lifetime of the session
+        if (pending_writes_.capacity() > 64 * 1024) {
+            pending_writes_ = std::vector<std::uint8_t>();
+        }
+        write_buffers_.clear();
+        for (auto &segment : writing_segments_) {
+            const auto *base = segment.shared ? segment.shared->data() : writing_.data();
+            write_buffers_.emplace_back(base + segment.begin, segment.end - segment.begin);
+        }
+        write_in_progress_ = true;
+        pending_operations_++;
+        p0443_v2::submit(p0443_v2::asio::write_all(connection_.next_layer(), write_buffers_),
+                         write_receiver{this});
+    }
+
+    /**
+     * Sends a DISCONNECT and closes the connection once it is written.
+     */
+    void disconnect(disconnect_reason reason) {
+        send(protocol::disconnect(reason));
+        close_after_write_ = true;
+    }
+
+    void start_timer(std::chrono::steady_clock::duration timeout) {
+        pending_operations_++;
+        p0443_v2::submit(p0443_v2::asio::timer::wait_for(keep_alive_timer_, timeout),
+                         timer_receiver{this, ++timer_generation_});
+    }
+
+    void check_keep_alive() {
+        if (state_ == state_type::waiting_connect) {
+            close();
+            return;
+        }
+        if (keep_alive_limit_.count() == 0) {
+            return;
+        }
+        // The timer isn't restarted for every packet, it checks when the last one arrived
+        const auto idle = std::chrono::steady_clock::now() - last_received_;
+        if (idle >= keep_alive_limit_) {
+            disconnect(disconnect_reason::keep_alive_timeout);
+        }
+        else {
+            start_timer(keep_alive_limit_ - idle);
+        }
+    }
+
+    void maybe_release() {
+        if (state_ == state_type::closed && pending_operations_ == 0 && owner_) {
+            owner_->release(*this);
+        }
+    }
+
+    void handle_packet(protocol::control_packet &packet) {
+        last_received_ = std::chrono::steady_clock::now();
+        if (state_ == state_type::waiting_connect) {
+            if (auto *connect = packet.body_as<protocol::connect>()) {
+                handle_connect(*connect);
+            }
+            else {
+                close();
+            }
+            return;
+        }
+
+        if (auto *publish = packet.body_as<protocol::publish>()) {
+            handle_publish(*publish);
+        }
+        else if (auto *puback = packet.body_as<protocol::puback>()) {
+            complete_outgoing(puback->packet_identifier,
+                              outgoing_publish::state_type::waiting_puback);
+        }
+        else if (auto *pubrec = packet.body_as<protocol::pubrec>()) {
+            handle_pubrec(*pubrec);
+        }
+        else if (auto *pubrel = packet.body_as<protocol::pubrel>()) {
+            handle_pubrel(*pubrel);
+        }
+        else if (auto *pubcomp = packet.body_as<protocol::pubcomp>()) {
+            complete_outgoing(pubcomp->packet_identifier,
+                              outgoing_publish::state_type::waiting_pubcomp);
+        }
+        else if (auto *subscribe = packet.body_as<protocol::subscribe>()) {
+            protocol::suback suback;
+            suback.packet_identifier = subscribe->packet_identifier;
+            suback.reason_codes = handler_->on_subscribe(*this, *subscribe);
+            send(suback);
+        }
+        else if (auto *unsubscribe = packet.body_as<protocol::unsubscribe>()) {
+            protocol::unsuback unsuback;
+            unsuback.packet_identifier = unsubscribe->packet_identifier;
+            unsuback.reason_codes = handler_->on_unsubscribe(*this, *unsubscribe);
+            send(unsuback);
+        }
+        else if (packet.is<protocol::pingreq>()) {
+            send(protocol::pingresp{});
+        }
+        else if (auto *disconnect_packet = packet.body_as<protocol::disconnect>()) {
+            if (disconnect_packet->reason != disconnect_reason::with_will) {
+                will_.reset();
+            }
+            close();
+        }
+        else {
+            disconnect(disconnect_reason::protocol_error);
+        }
+    }
+
+    void handle_connect(protocol::connect &connect) {
+        protocol::connack connack;
+        connack.flags = 0;
+        connack.reason_code = 0;
+        if (connect.version != 5) {
+            connack.reason_code =
+                static_cast<std::uint8_t>(connect_reason_code::unsupported_protocol_version);
+            send(connack);
+            close_after_write_ = true;
+            return;
+        }
+
+        client_id_ = std::move(connect.client_id);
+        if (client_id_.empty()) {
+            client_id_ = detail::assign_client_id();
+            connack.properties.assigned_client_id = client_id_;
+        }
+
+        const auto reason = handler_->on_connect(*this, connect);
+        if (reason != connect_reason_code::success) {
+            connack.reason_code = static_cast<std::uint8_t>(reason);
+            send(connack);
+            close_after_write_ = true;
+            return;
+        }
+
+        auto keep_alive = connect.keep_alive;
+        if (options_->server_keep_alive.count() != 0) {
+            keep_alive = options_->server_keep_alive;
+            connack.properties.server_keep_alive = keep_alive;
+        }
+        // The client has one and a half times the keep alive to send something
+        keep_alive_limit_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                std::chrono::seconds(keep_alive.count())) *
+                            3 / 2;
+
+        send_quota_ = connect.connect_properties.receive_maximum;
+        inbound_topic_aliases_.reset(options_->topic_alias_maximum);
+        connack.properties.topic_alias_maximum = options_->topic_alias_maximum;
+        connack.properties.receive_maximum = options_->receive_maximum;
+
+        if (connect.flags & protocol::connect::will_flag) {
+            will_ = std::make_unique<protocol::publish>();
+            will_->topic = std::move(connect.will_topic);
+            will_->payload = std::move(connect.will_payload);
+            will_->set_quality_of_service(
+                static_cast<quality_of_service>((connect.flags >> 3) & 0x03));
+            will_->set_retain(connect.flags & protocol::connect::will_retain_flag);
+            will_->properties.content_type = std::move(connect.will_properties.content_type);
+            will_->properties.response_topic = std::move(connect.will_properties.response_topic);
+            will_->properties.correlation_data =
+                std::move(connect.will_properties.correlation_data);
+            will_->properties.message_expiry_interval =
+                connect.will_properties.message_expiry_interval;
+            will_->properties.payload_format_indicator =
+                connect.will_properties.payload_format_indicator;
+        }
+
+        state_ = state_type::connected;
+        send(connack);
+
+        // Replaces the connect timeout
+        keep_alive_timer_.cancel();
+        if (keep_alive_limit_.count() != 0) {
+            start_timer(keep_alive_limit_);
+        }
+    }
+
+    void handle_publish(protocol::publish &publish) {
+        if (!inbound_topic_aliases_.resolve(publish)) {
+            disconnect(disconnect_reason::topic_alias_invalid);
+            return;
+        }
+        publish.properties.topic_alias = 0;
+
+        const auto qos = publish.quality_of_service();
+        if (qos == 0_qos) {
+            handler_->on_publish(*this, publish);
+        }
+        else if (qos == 1_qos) {
+            handler_->on_publish(*this, publish);
+            protocol::puback puback;
+            puback.packet_identifier = publish.packet_identifier;
+            send(puback);
+        }
+        else {
+            protocol::pubrec pubrec;
+            pubrec.packet_identifier = publish.packet_identifier;
+            const bool duplicate =
+                std::find(incoming_qos2_.begin(), incoming_qos2_.end(),
+                          publish.packet_identifier) != incoming_qos2_.end();
+            if (!duplicate) {
+                if (incoming_qos2_.size() >= options_->receive_maximum) {
+                    disconnect(disconnect_reason::receiver_maximum_exceeded);
+                    return;
+                }
+                incoming_qos2_.push_back(publish.packet_identifier);
+                handler_->on_publish(*this, publish);
+            }
+            send(pubrec);
+        }
+    }
+
+    void handle_pubrel(const protocol::pubrel &pubrel) {
+        protocol::pubcomp pubcomp;
+        pubcomp.packet_identifier = pubrel.packet_identifier;
+        auto iter =
+            std::find(incoming_qos2_.begin(), incoming_qos2_.end(), pubrel.packet_identifier);
+        if (iter != incoming_qos2_.end()) {
+            incoming_qos2_.erase(iter);
+        }
+        else {
+            pubcomp.reason_code = pubcomp_reason_code::packet_identifier_not_found;
+        }
+        send(pubcomp);
+    }
+
+    void handle_pubrec(const protocol::pubrec &pubrec) {
+        protocol::pubrel pubrel;
+        pubrel.packet_identifier = pubrec.packet_identifier;
+        auto iter = find_outgoing(pubrec.packet_identifier);
+        if (iter == outgoing_.end() ||
+            iter->state_ != outgoing_publish::state_type::waiting_pubrec) {
+            pubrel.reason_code = pubrel_reason_code::packet_identifier_not_found;
+        }
+        else if (static_cast<std::uint8_t>(pubrec.reason_code) >= 0x80) {
+            complete_outgoing(pubrec.packet_identifier,
+                              outgoing_publish::state_type::waiting_pubrec);
+            return;
+        }
+        else {
+            iter->state_ = outgoing_publish::state_type::waiting_pubcomp;
+        }
+        send(pubrel);
+    }
+
+    auto find_outgoing(std::uint16_t packet_identifier) {
+        return std::find_if(outgoing_.begin(), outgoing_.end(), [&](const outgoing_publish &out) {
+            return out.packet_identifier_ == packet_identifier;
+        });
+    }
+
+    void complete_outgoing(std::uint16_t packet_identifier,
+                           typename outgoing_publish::state_type expected) {
+        auto iter = find_outgoing(packet_identifier);
+        if (iter == outgoing_.end() || iter->state_ != expected) {
+            return;
+        }
+        outgoing_.erase(iter);
+        send_quota_++;
+        const auto now = std::chrono::steady_clock::now();
+        while (queued_ && !queued_->empty()) {
+            auto next = std::move(queued_->front());
+            queued_->pop_front();
+            // Expired messages are dropped instead of being sent
+            if (auto remaining = remaining_expiry(next, now)) {
+                send_outgoing(next.frame, next.qos, next.retain, *remaining,
+                              next.subscription_identifier);
+                break;
+            }
+        }
+    }
+
+    std::uint16_t allocate_packet_identifier() {
+        while (true) {
+            const auto id = next_packet_identifier_++;
+            if (next_packet_identifier_ == 0) {
+                next_packet_identifier_ = 1;
+            }
+            if (find_outgoing(id) == outgoing_.end()) {
+                return id;
+            }
+        }
+    }
+
+    void send_outgoing(const protocol::publish_frame &frame, quality_of_service qos,
+                       bool retain, std::chrono::duration<std::uint32_t> remaining_expiry,
+                       std::uint32_t subscription_identifier) {
+        send_quota_--;
+        const auto packet_identifier = allocate_packet_identifier();
+        outgoing_.push_back(outgoing_publish{packet_identifier,
+                                             qos == 1_qos
+                                                 ? outgoing_publish::state_type::waiting_puback
+                                                 : outgoing_publish::state_type::waiting_pubrec});
+        send(frame, qos, retain, packet_identifier, remaining_expiry, subscription_identifier);
+    }
+
+public:
+    /**
+     * @brief Create a session for an accepted stream.
+     *
+     * handler, owner and options must outlive the session.
+     */
+    server_session(Stream stream, session_handler &handler, detail::session_owner &owner,
+                   const server_options &options)
+        : connection_(std::move(stream)), handler_(&handler), owner_(&owner), options_(&options),
+          keep_alive_timer_(connection_.get_executor()) {
+    }
+
+    server_session(const server_session &) = delete;
+    server_session &operator=(const server_session &) = delete;
+
+    [[nodiscard]] executor_type get_executor() {
+        return connection_.get_executor();
+    }
+
+    template <int N>
+    [[nodiscard]] auto &get_nth_layer() {
+        return detail::get_nth_layer<N>(connection_);
+    }
+
+    /**
+     * @brief Start reading, the client must send CONNECT within the connect timeout.
+     */
+    void start() {
+        start_timer(options_->connect_timeout);
+        start_read();
+    }
+
+    using server_session_base::deliver;
+
+    void deliver(const protocol::publish_frame &frame, quality_of_service qos, bool retain,
+                 std::uint32_t subscription_identifier) override {
+        if (state_ != state_type::connected || close_after_write_) {
+            return;
+        }
+        if (qos == 0_qos) {
+            send(frame, qos, retain, 0, subscription_identifier);
+            return;
+        }
+        if (send_quota_ == 0) {
+            if (!queued_) {
+                queued_ = std::make_unique<std::deque<queued_publish>>();
+            }
+            const auto now = std::chrono::steady_clock::now();
+            // Make room by dropping what has expired at the front
+            while (queued_->size() >= options_->max_queued_publishes && !queued_->empty() &&
+                   !remaining_expiry(queued_->front(), now)) {
+                queued_->pop_front();
+            }
+            if (queued_->size() < options_->max_queued_publishes) {
+                queued_->push_back(
+                    queued_publish{frame, qos, retain, subscription_identifier, now});
+            }
+            return;
+        }
+        send_outgoing(frame, qos, retain, frame.message_expiry_interval(),
+                      subscription_identifier);
+    }
+
+    [[nodiscard]] std::size_t backlog() const override {
+        return outgoing_.size() + (queued_ ? queued_->size() : 0);
+    }
+
+    void close() override {
+        if (state_ == state_type::closed) {
+            return;
+        }
+        const bool was_connected = state_ == state_type::connected;
+        state_ = state_type::closed;
+        keep_alive_timer_.cancel();
+        try {
+            connection_.lowest_layer().cancel();
+        }
+        catch (std::exception &) {
+        }
+        try {
+            connection_.lowest_layer().close();
+        }
+        catch (std::exception &) {
+        }
+        if (was_connected) {
+            if (will_) {
+                auto will = std::move(will_);
+                handler_->on_publish(*this, *will);
+            }
+            handler_->on_close(*this);
+        }
+    }
+};
+} // namespace mqtt5
@@ -0,0 +1,77 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "mqtt5/protocol/publish.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace mqtt5
+{
+/**
+ * @brief Session state recovered from a session store.
+ */
+struct stored_session
+{
+    // Outgoing QoS 1 and 2 publishes that are not complete, in the order they were sent
+    std::vector<protocol::publish> outgoing;
+    // Packet identifiers of outgoing QoS 2 publishes that have received PUBREC
+    std::vector<std::uint16_t> released;
+    // Incoming QoS 2 publishes waiting for PUBREL
+    std::vector<protocol::publish> incoming;
+};
+
+/**
+ * @brief Persists the in-flight QoS 1 and 2 state of a session.
+ *
+ * The client reports every state transition to the store while a session store
+ * is set. When reconnecting with clean_start set to false the stored state is
+ * recovered and resent if the server still has the session.
+ *
+ * All functions are called on the client executor.
+ */
+class session_store
+{
+public:
+    virtual ~session_store() = default;
+
+    /**
+     * @brief An outgoing QoS 1 or 2 publish was sent.
+     */
+    virtual void publish_sent(const protocol::publish &publish) = 0;
+
+    /**
+     * @brief PUBREC was received for an outgoing QoS 2 publish.
+     */
+    virtual void publish_released(std::uint16_t packet_identifier) = 0;
+
+    /**
+     * @brief An outgoing publish is complete, successfully or not.
+     */
+    virtual void publish_completed(std::uint16_t packet_identifier) = 0;
+
+    /**
+     * @brief An incoming QoS 2 publish was received and PUBREC sent.
+     */
+    virtual void publish_received(const protocol::publish &publish) = 0;
+
+    /**
+     * @brief PUBREL was received for an incoming QoS 2 publish.
+     */
+    virtual void receive_completed(std::uint16_t packet_identifier) = 0;
+
+    /**
+     * @brief Get the stored session state.
+     */
+    virtual stored_session recover() = 0;
+
+    /**
+     * @brief Discard all stored state.
+     */
+    virtual void clear() = 0;
+};
+} // namespace mqtt5
@@ -0,0 +1,406 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "broker.hpp"
+#include "detail/intrusive_list.hpp"
+#include "detail/mpsc_queue.hpp"
+#include "detail/shard_replica.hpp"
+#include "retained_store.hpp"
+#include "server_options.hpp"
+#include "server_session.hpp"
+
+#include <boost/asio/basic_socket_acceptor.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/post.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace mqtt5
+{
+struct sharded_broker_options
+{
+    /**
+     * How a member of a shared subscription group is picked.
+     */
+    shared_subscription_policy shared_policy = shared_subscription_policy::round_robin;
+
+    /**
+     * Options for every session.
+     */
+    server_options session;
+};
+
+/**
+ * @brief A broker spread over several executors, one shard per executor.
+ *
+ * Accepted connections are assigned to the shards in turn and stay there. Each shard
+ * keeps its own replica of the subscription index and the retained messages, so
+ * routing a publish never takes a lock: the receiving shard matches it against its
+ * replica and hands it to every other shard with matching subscribers through that
+ * shard's lock-free mailbox. The message is encoded once and shared by all receivers.
+ *
+ * Subscription and retained changes are applied to the local replica at once and
+ * sent to the other shards through the same mailboxes, so they take effect there
+ * shortly after. Retained changes are numbered by a shared atomic counter and the
+ * last one wins, so the replicas agree even when two shards retain the same topic at
+ * the same time. Only client id takeover goes through a mutex, once per CONNECT.
+ *
+ * Passing one executor per thread lets the broker scale with the number of cores.
+ */
+template <class Stream>
+class sharded_broker
+{
+public:
+    using session_type = server_session<Stream>;
+    using executor_type = typename session_type::executor_type;
+
+private:
+    using socket_type = std::remove_reference_t<
+        decltype(std::declval<connection<Stream> &>().lowest_layer())>;
+    using protocol_type = typename socket_type::protocol_type;
+    using acceptor_type = boost::asio::basic_socket_acceptor<protocol_type, executor_type>;
+    using message_ptr = retained_store::message_ptr;
+    using subscriber_ref = detail::shard_subscriber;
+    using target = detail::shard_target;
+    using mail = detail::shard_mail;
+
+    class shard : public session_handler, private detail::session_owner
+    {
+    private:
+        struct local_session
+        {
+            server_session_base *session;
+            subscriber_ref ref;
+            std::vector<std::string> filters;
+        };
+
+        sharded_broker *broker_;
+        std::uint32_t id_;
+        executor_type executor_;
+        detail::mpsc_queue<mail> mailbox_;
+
+        detail::shard_replica replica_;
+
+        detail::intrusive_list<server_session_base> sessions_;
+        std::unordered_map<std::uint64_t, local_session> by_id_;
+        std::unordered_map<server_session_base *, std::uint64_t> ids_;
+
+        // Reused per publish, one target list per shard
+        std::vector<std::vector<target>> targets_;
+
+        void release(server_session_base &session) override {
+            // Sessions that never got to CONNECT are released without on_close
+            if (auto iter = ids_.find(&session); iter != ids_.end()) {
+                by_id_.erase(iter->second);
+                ids_.erase(iter);
+            }
+            sessions_.erase(session);
+            delete static_cast<session_type *>(&session);
+        }
+
+        local_session *find(server_session_base &session) {
+            auto iter = ids_.find(&session);
+            return iter == ids_.end() ? nullptr : &by_id_.at(iter->second);
+        }
+
+        void deliver_local(const target &to, const protocol::publish_frame &frame) {
+            auto iter = by_id_.find(to.session);
+            if (iter == by_id_.end()) {
+                // Closed after the publish was routed
+                return;
+            }
+            auto &local = iter->second;
+            detail::forward_frame(*local.session, frame, to.options, to.identifier);
+            local.ref.load->store(local.session->backlog(), std::memory_order_relaxed);
+        }
+
+        void drain() {
+            mailbox_.consume_all([this](mail &&item) {
+                std::visit([this](auto &m) { handle(m); }, item);
+            });
+        }
+
+        void handle(detail::deliver_mail &m) {
+            for (auto &to : m.targets) {
+                deliver_local(to, m.frame);
+            }
+        }
+        template <class Update>
+        void handle(Update &m) {
+            replica_.apply(m);
+        }
+        void handle(detail::close_mail &m) {
+            if (auto iter = by_id_.find(m.session); iter != by_id_.end()) {
+                iter->second.session->close();
+            }
+        }
+
+        void broadcast(const mail &m) {
+            for (auto &other : broker_->shards_) {
+                if (other.get() != this) {
+                    other->post(m);
+                }
+            }
+        }
+
+    public:
+        shard(sharded_broker &broker, std::uint32_t id, executor_type executor)
+            : broker_(&broker), id_(id), executor_(std::move(executor)), replica_(id) {
+        }
+
+        ~shard() {
+            // Only safe once the executor won't run any more session handlers
+            while (!sessions_.empty()) {
+                delete static_cast<session_type *>(&sessions_.pop_front());
+            }
+        }
+
+        executor_type &get_executor() {
+            return executor_;
+        }
+
+        /**
+         * Push to the mailbox, safe to call from any thread.
+         */
+        void post(mail m) {
+            if (mailbox_.push(std::move(m))) {
+                boost::asio::post(executor_, [this] { drain(); });
+            }
+        }
+
+        void adopt(socket_type socket) {
+            auto *session = new session_type(Stream(std::move(socket)), *this, *this,
+                                             broker_->options_.session);
+            sessions_.push_back(*session);
+            const auto id = broker_->next_session_id_.fetch_add(1, std::memory_order_relaxed);
+            ids_.emplace(session, id);
+            auto queued = std::make_shared<std::atomic<std::size_t>>(0);
+            by_id_.emplace(id,
+                           local_session{session, subscriber_ref{id_, id, std::move(queued)}, {}});
+            session->start();
+        }
+
+        void close_all() {
+            for (auto &session : sessions_) {
+                session.close();
+            }
+        }
+
+        connect_reason_code on_connect(server_session_base &session,
+                                       const protocol::connect &) override {
+            const auto id = ids_.at(&session);
+            std::pair<std::uint32_t, std::uint64_t> previous{0, 0};
+            {
+                std::lock_guard<std::mutex> lock(broker_->clients_mutex_);
+                auto &current = broker_->clients_[session.client_id()];
+                previous = current;
+                current = {id_, id};
+            }
+            if (previous.second != 0 && previous.second != id) {
+                // Closing calls on_close, which only forgets the client id if it's still ours
+                broker_->shards_[previous.first]->post(detail::close_mail{previous.second});
+            }
+            return connect_reason_code::success;
+        }
+
+        void on_publish(server_session_base &session, const protocol::publish &publish) override {
+            const auto *sender = find(session);
+            const auto sender_id = sender ? sender->ref.session : 0;
+
+            if (publish.retain_flag()) {
+                const auto sequence =
+                    broker_->next_retain_sequence_.fetch_add(1, std::memory_order_relaxed);
+                broadcast(replica_.retain(publish, sequence));
+            }
+
+            targets_.resize(broker_->shards_.size());
+            replica_.route(publish.topic, sender_id, broker_->options_.shared_policy, targets_);
+
+            // Encoded once and shared by the receivers of all shards
+            protocol::publish_frame frame;
+            for (std::uint32_t i = 0; i < targets_.size(); i++) {
+                if (targets_[i].empty()) {
+                    continue;
+                }
+                if (frame.empty()) {
+                    frame = protocol::publish_frame(publish);
+                }
+                if (i == id_) {
+                    for (auto &to : targets_[i]) {
+                        deliver_local(to, frame);
+                    }
+                    continue;
+                }
+                broker_->shards_[i]->post(detail::deliver_mail{frame, std::move(targets_[i])});
+            }
+        }
+
+        std::vector<std::uint8_t> on_subscribe(server_session_base &session,
+                                               const protocol::subscribe &subscribe) override {
+            std::vector<std::uint8_t> codes;
+            codes.reserve(subscribe.topics.size());
+            auto *local = find(session);
+            const auto identifier = subscribe.properties.subscription_identifier;
+            for (auto &topic : subscribe.topics) {
+                detail::parsed_filter parsed;
+                if (!local || !detail::valid_subscription(topic, parsed)) {
+                    codes.push_back(0x8f); // Topic filter invalid
+                    continue;
+                }
+
+                bool existed = false;
+                replica_.index().insert(topic.topic, local->ref, topic.options, &existed,
+                                        identifier);
+                broadcast(
+                    detail::subscribe_mail{topic.topic, local->ref, topic.options, identifier});
+                if (!existed) {
+                    local->filters.push_back(topic.topic);
+                }
+                codes.push_back(topic.options & detail::subscription_qos_mask);
+
+                if (detail::sends_retained(parsed, topic.options, existed)) {
+                    replica_.retained().for_each_match(
+                        parsed.filter, [&](const message_ptr &message) {
+                            detail::forward_retained(session, *message, topic.options,
+                                                     identifier);
+                        });
+                }
+            }
+            return codes;
+        }
+
+        std::vector<std::uint8_t>
+        on_unsubscribe(server_session_base &session,
+                       const protocol::unsubscribe &unsubscribe) override {
+            std::vector<std::uint8_t> codes;
+            codes.reserve(unsubscribe.topics.size());
+            auto *local = find(session);
+            for (auto &topic : unsubscribe.topics) {
+                if (local && replica_.index().erase(topic, local->ref)) {
+                    broadcast(detail::unsubscribe_mail{topic, local->ref});
+                    auto &filters = local->filters;
+                    filters.erase(std::find(filters.begin(), filters.end(), topic));
+                    codes.push_back(0x00);
+                }
+                else {
+                    codes.push_back(0x11); // No subscription existed
+                }
+            }
+            return codes;
+        }
+
+        void on_close(server_session_base &session) override {
+            auto *local = find(session);
+            if (!local) {
+                return;
+            }
+            const auto id = local->ref.session;
+            for (auto &filter : local->filters) {
+                replica_.index().erase(filter, local->ref);
+                broadcast(detail::unsubscribe_mail{filter, local->ref});
+            }
+            local->filters.clear();
+            {
+                std::lock_guard<std::mutex> lock(broker_->clients_mutex_);
+                auto client = broker_->clients_.find(session.client_id());
+                if (client != broker_->clients_.end() && client->second.second == id) {
+                    broker_->clients_.erase(client);
+                }
+            }
+            // Its id is forgotten in release, the closed session drops deliveries until then
+        }
+    };
+
+    sharded_broker_options options_;
+    std::vector<std::unique_ptr<shard>> shards_;
+    acceptor_type acceptor_;
+    std::size_t next_shard_ = 0;
+    std::atomic<std::uint64_t> next_session_id_{1};
+    std::atomic<std::uint64_t> next_retain_sequence_{1};
+
+    std::mutex clients_mutex_;
+    // Client id to shard and session id
+    std::unordered_map<std::string, std::pair<std::uint32_t, std::uint64_t>> clients_;
+
+    void accept() {
+        auto &target = *shards_[next_shard_];
+        next_shard_ = (next_shard_ + 1) % shards_.size();
+        acceptor_.async_accept(target.get_executor(), [this, &target](
+                                                          const boost::system::error_code &ec,
+                                                          socket_type socket) {
+            if (ec == boost::asio::error::operation_aborted || !acceptor_.is_open()) {
+                return;
+            }
+            if (!ec) {
+                boost::asio::post(target.get_executor(),
+                                  [&target, socket = std::move(socket)]() mutable {
+                                      target.adopt(std::move(socket));
+                                  });
+            }
+            accept();
+        });
+    }
+
+public:
+    /**
+     * @brief Create one shard per executor and listen on an endpoint.
+     *
+     * Connections are accepted on the first executor.
+     */
+    sharded_broker(const std::vector<executor_type> &executors,
+                   const typename protocol_type::endpoint &endpoint,
+                   sharded_broker_options options = {})
+        : options_(options), acceptor_(executors.at(0), endpoint) {
+        shards_.reserve(executors.size());
+        for (std::uint32_t i = 0; i < executors.size(); i++) {
+            shards_.emplace_back(std::make_unique<shard>(*this, i, executors[i]));
+        }
+    }
+
+    sharded_broker(const sharded_broker &) = delete;
+    sharded_broker &operator=(const sharded_broker &) = delete;
+
+    [[nodiscard]] std::size_t size() const {
+        return shards_.size();
+    }
+
+    [[nodiscard]] typename protocol_type::endpoint local_endpoint() const {
+        return acceptor_.local_endpoint();
+    }
+
+    /**
+     * @brief Start accepting connections.
+     */
+    void start() {
+        boost::asio::post(acceptor_.get_executor(), [this] { accept(); });
+    }
+
+    /**
+     * @brief Stop accepting and close all sessions, safe to call from any thread.
+     */
+    void close() {
+        boost::asio::post(acceptor_.get_executor(), [this] {
+            boost::system::error_code ec;
+            acceptor_.close(ec);
+        });
+        for (auto &s : shards_) {
+            boost::asio::post(s->get_executor(), [shard = s.get()] { shard->close_all(); });
+        }
+    }
+};
+} // namespace mqtt5
@@ -0,0 +1,115 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <boost/asio/ssl/stream.hpp>
+
+#include <p0443_v2/asio/handshake.hpp>
+#include <p0443_v2/just.hpp>
+#include <p0443_v2/then.hpp>
+#include <p0443_v2/transform.hpp>
+
+#include <openssl/ssl.h>
+
+#include <memory>
+
+namespace mqtt5
+{
+/**
+ * @brief Keeps the TLS session of a connection so reconnects can resume it.
+ *
+ * A resumed session skips the certificate exchange and key agreement of a full
+ * handshake, both with session IDs and with session tickets.
+ *
+ * The same SSL stream object is reused for every connection. Before each handshake
+ * its state from the previous connection is discarded and the last session is offered
+ * to the server.
+ */
+class tls_session
+{
+private:
+    struct session_deleter
+    {
+        void operator()(SSL_SESSION *session) const {
+            SSL_SESSION_free(session);
+        }
+    };
+    std::unique_ptr<SSL_SESSION, session_deleter> session_;
+
+public:
+    /**
+     * @brief Reset the stream for a new connection and offer the stored session.
+     */
+    template <class SslStream>
+    void prepare(SslStream &stream) {
+        SSL *ssl = stream.native_handle();
+        if (SSL_get_session(ssl)) {
+            // TLS 1.3 tickets arrive after the handshake, take the session as it is now
+            update(stream);
+            // Discard anything left in the BIO pair by the lost connection
+            BIO *bio = SSL_get_rbio(ssl);
+            char discard[1024];
+            while (BIO_ctrl_pending(bio) > 0 && BIO_read(bio, discard, sizeof(discard)) > 0) {
+            }
+            (void)BIO_reset(bio);
+            // Pretend the connection was shut down properly, SSL_clear would otherwise
+            // mark the session as not resumable
+            SSL_set_shutdown(ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+            SSL_clear(ssl);
+        }
+        if (session_) {
+            SSL_set_session(ssl, session_.get());
+        }
+    }
+
+    /**
+     * @brief Store the current session of the stream if it can be resumed.
+     *
+     * Also done by prepare, since TLS 1.3 session tickets are only received after
+     * the handshake.
+     */
+    template <class SslStream>
+    void update(SslStream &stream) {
+        SSL_SESSION *session = SSL_get1_session(stream.native_handle());
+        if (session && SSL_SESSION_is_resumable(session)) {
+            session_.reset(session);
+        }
+        else if (session) {
+            SSL_SESSION_free(session);
+        }
+    }
+
+    /**
+     * @brief Check if the last handshake resumed the stored session.
+     */
+    template <class SslStream>
+    [[nodiscard]] bool resumed(SslStream &stream) const {
+        return SSL_session_reused(stream.native_handle()) == 1;
+    }
+
+    /**
+     * @brief Create a sender doing a client handshake that resumes the stored session.
+     *
+     * The session is stored once the handshake is done. Can be used as the stream
+     * handshake of client::supervisor.
+     *
+     * Sender value: void
+     * Sender error: std::exception_ptr
+     * Sender sets done: yes
+     */
+    template <class SslStream>
+    [[nodiscard]] auto handshaker(SslStream &stream) {
+        return p0443_v2::transform(
+            p0443_v2::then(p0443_v2::just(),
+                           [this, &stream]() {
+                               prepare(stream);
+                               return p0443_v2::asio::handshake(
+                                   stream, boost::asio::ssl::stream_base::client);
+                           }),
+            [this, &stream](auto...) { update(stream); });
+    }
+};
+} // namespace mqtt5
@@ -15,6 +15,41 @@
 
 namespace mqtt5
 {
+/**
+ * Splits a topic name into its levels without copying.
+ *
+ * The views are written to retval, reusing its storage, and point into the storage of
+ * topic_name.
+ */
+inline void split_topic_levels(boost::string_view topic_name,
+                               std::vector<boost::string_view> &retval) {
+    retval.clear();
+    while (!topic_name.empty()) {
+        auto next_separator = std::find(topic_name.begin(), topic_name.end(), '/');
+        retval.emplace_back(topic_name.data(), next_separator - topic_name.begin());
+        if (next_separator != topic_name.end()) {
+            topic_name.remove_prefix(1 + next_separator - topic_name.begin());
+            if (topic_name.empty()) {
+                retval.emplace_back();
+            }
+        }
+        else {
+            topic_name = boost::string_view{};
+        }
+    }
+}
+
+/**
+ * Splits a topic name into its levels without copying.
+ *
+ * The returned views point into the storage of topic_name.
+ */
+inline std::vector<boost::string_view> split_topic_levels(boost::string_view topic_name) {
+    std::vector<boost::string_view> retval;
+    split_topic_levels(topic_name, retval);
+    return retval;
+}
+
 class topic_filter
 {
 private:
@@ -111,10 +146,19 @@ public:
         assert(std::find_if(topic_name.begin(), topic_name.end(),
                             [](auto ch) { return ch == '+' || ch == '#'; }) == topic_name.end());
 
-        if(topic_name.starts_with("$") && levels_.front()[0] != '$') {
+        return matches(split_topic_levels(topic_name));
+    }
+
+    /**
+     * Checks if this topic filter matches a topic name already split into levels.
+     *
+     * @see split_topic_levels
+     */
+    bool matches(const std::vector<boost::string_view> &name_levels) const {
+        if (!name_levels.empty() && name_levels.front().starts_with("$") &&
+            levels_.front()[0] != '$') {
             return false;
         }
-        auto name_as_filter = from_string(topic_name);
 
         auto matches_n_levels = [&](const std::size_t n) {
             for (std::size_t i = 0; i < n; i++) {
@@ -124,7 +168,7 @@ public:
                     }
                 }
                 if (levels_[i] != "+") {
-                    if (levels_[i] != name_as_filter.levels_[i]) {
+                    if (levels_[i] != name_levels[i]) {
                         return false;
                     }
                 }
@@ -132,11 +176,11 @@ public:
             return true;
         };
 
-        if (name_as_filter.levels_.size() < levels_.size()) {
+        if (name_levels.size() < levels_.size()) {
             // If the name has fewer levels than the filter,
             // the only way to match is if the filter contains a
             // '#' wildcard and is exactly one level greater (wild card level)
-            if (name_as_filter.levels_.size() != levels_.size() - 1) {
+            if (name_levels.size() != levels_.size() - 1) {
                 return false;
             }
 
@@ -144,9 +188,9 @@ public:
                 return false;
             }
 
-            return matches_n_levels(name_as_filter.levels_.size());
+            return matches_n_levels(name_levels.size());
         }
-        else if (name_as_filter.levels_.size() > levels_.size()) {
+        else if (name_levels.size() > levels_.size()) {
             // Only way to match is if levels_.back() == "#" and all preceeding levels matches
             if (levels_.back() == "#") {
                 return matches_n_levels(levels_.size() - 1);
@@ -158,6 +202,36 @@ public:
         return matches_n_levels(levels_.size());
     }
 
+    /**
+     * Checks if there is a topic name matched by both this filter and other
+     */
+    bool overlaps(const topic_filter &other) const {
+        const auto &lhs = levels_;
+        const auto &rhs = other.levels_;
+        auto is_wildcard = [](const std::string &level) { return level == "+" || level == "#"; };
+        // Topic names starting with $ are never matched by a leading wildcard
+        if ((is_wildcard(lhs.front()) && rhs.front()[0] == '$') ||
+            (is_wildcard(rhs.front()) && lhs.front()[0] == '$')) {
+            return false;
+        }
+
+        const auto common = std::min(lhs.size(), rhs.size());
+        for (std::size_t i = 0; i < common; i++) {
+            if (lhs[i] == "#" || rhs[i] == "#") {
+                return true;
+            }
+            if (lhs[i] != "+" && rhs[i] != "+" && lhs[i] != rhs[i]) {
+                return false;
+            }
+        }
+        if (lhs.size() == rhs.size()) {
+            return true;
+        }
+        // "sport/#" also matches "sport"
+        const auto &longer = lhs.size() > rhs.size() ? lhs : rhs;
+        return longer.size() == common + 1 && longer.back() == "#";
+    }
+
     friend bool operator==(const topic_filter &lhs, const topic_filter &rhs) {
         return lhs.levels_ == rhs.levels_;
     }
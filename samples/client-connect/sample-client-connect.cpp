@@ -50,12 +50,10 @@ p0443_v2::immediate_task run_tcp_client(mqtt5::client<tcp::socket> &client) {
 
     int packet_number = 1;
     // A reusable_publisher can be used multiple times.
+    // The client assigns a topic alias automatically if the server allows it.
     auto publisher = client.reusable_publisher(
-        "mqtt5/telemetry/hello_world", "hello world from TCP client! ", 1_qos, pubopt::topic_alias(1),
+        "mqtt5/telemetry/hello_world", "hello world from TCP client! ", 1_qos,
         [&packet_number](mqtt5::protocol::publish &pub) mutable {
-            if (packet_number > 1) {
-                pub.topic.clear();
-            }
             auto packet_nr_string = std::to_string(packet_number);
             packet_number++;
             pub.payload.insert(pub.payload.end(), packet_nr_string.begin(), packet_nr_string.end());
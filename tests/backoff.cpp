@@ -0,0 +1,43 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include <mqtt5/detail/backoff.hpp>
+
+#include <doctest/doctest.h>
+
+using namespace std::chrono_literals;
+
+TEST_CASE("backoff: delays grow up to the maximum") {
+    mqtt5::reconnect_options opts;
+    opts.initial_delay = 100ms;
+    opts.multiplier = 2.0;
+    opts.max_delay = 1000ms;
+    mqtt5::detail::backoff backoff(opts);
+
+    const std::chrono::milliseconds bounds[] = {100ms, 200ms, 400ms, 800ms, 1000ms, 1000ms};
+    for (auto bound : bounds) {
+        auto delay = backoff.next();
+        REQUIRE(delay <= bound);
+        REQUIRE(delay >= bound / 2);
+    }
+}
+
+TEST_CASE("backoff: reset starts over") {
+    mqtt5::reconnect_options opts;
+    opts.initial_delay = 10ms;
+    mqtt5::detail::backoff backoff(opts);
+    for (int i = 0; i < 10; i++) {
+        backoff.next();
+    }
+    backoff.reset();
+    REQUIRE(backoff.next() <= 10ms);
+}
+
+TEST_CASE("backoff: a zero initial delay still waits") {
+    mqtt5::reconnect_options opts;
+    opts.initial_delay = 0ms;
+    mqtt5::detail::backoff backoff(opts);
+    REQUIRE(backoff.next() >= 1ms);
+}
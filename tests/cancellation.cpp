@@ -0,0 +1,75 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include <mqtt5/cancellation.hpp>
+
+#include <doctest/doctest.h>
+
+#include <memory>
+#include <optional>
+
+TEST_CASE("cancellation: emit calls the assigned handler once") {
+    mqtt5::cancellation_signal signal;
+    auto slot = signal.slot();
+    REQUIRE(slot.is_connected());
+    REQUIRE_FALSE(mqtt5::cancellation_slot().is_connected());
+
+    int calls = 0;
+    slot.assign([&] { calls++; });
+    signal.emit();
+    signal.emit();
+    REQUIRE(calls == 1);
+}
+
+TEST_CASE("cancellation: a cleared slot is not cancelled") {
+    mqtt5::cancellation_signal signal;
+    auto slot = signal.slot();
+    int calls = 0;
+    slot.assign([&] { calls++; });
+    slot.clear();
+    signal.emit();
+    REQUIRE(calls == 0);
+
+    // Reused by the next operation
+    slot.assign([&] { calls++; });
+    signal.emit();
+    REQUIRE(calls == 1);
+}
+
+TEST_CASE("cancellation: a destroyed slot removes its handler") {
+    mqtt5::cancellation_signal signal;
+    int calls = 0;
+    {
+        auto slot = signal.slot();
+        slot.assign([&] { calls++; });
+    }
+    signal.emit();
+    REQUIRE(calls == 0);
+}
+
+TEST_CASE("cancellation: a slot may outlive its signal") {
+    auto signal = std::make_unique<mqtt5::cancellation_signal>();
+    auto slot = signal->slot();
+    slot.assign([] {});
+    signal.reset();
+    slot.clear();
+    REQUIRE(slot.is_connected());
+}
+
+TEST_CASE("cancellation: a slot cleared after emit keeps the next operation's handler") {
+    mqtt5::cancellation_signal signal;
+    std::optional<mqtt5::cancellation_slot> first(signal.slot());
+    int calls = 0;
+    first->assign([] {});
+    signal.emit();
+
+    auto second = signal.slot();
+    second.assign([&] { calls++; });
+    // The first operation completes with done after being cancelled
+    first->clear();
+    first.reset();
+    signal.emit();
+    REQUIRE(calls == 1);
+}
@@ -0,0 +1,211 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include <mqtt5/client.hpp>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+#include <doctest/doctest.h>
+
+#include "client_peer.hpp"
+
+#include <optional>
+#include <string>
+
+namespace
+{
+using client_type = mqtt5::client<boost::asio::ip::tcp::socket>;
+
+struct completion
+{
+    bool value = false;
+    bool done = false;
+};
+
+struct recording_receiver
+{
+    completion *completion_;
+
+    template <class... Values>
+    void set_value(Values &&...) {
+        completion_->value = true;
+    }
+    void set_done() {
+        completion_->done = true;
+    }
+    template <class E>
+    void set_error(E &&) {
+    }
+};
+} // namespace
+
+TEST_CASE("client: cancelled operations complete with done") {
+    using namespace mqtt5::literals;
+    boost::asio::io_context io;
+    client_type client(io.get_executor());
+    // The supervisor is never started, the client stays offline and holds everything
+    auto supervisor = client.supervisor("localhost", "1883", {});
+
+    mqtt5::cancellation_signal publish_signal, subscribe_signal, filter_signal;
+    completion published, subscribed, filtered;
+    auto publish = client.publisher("a/b", std::string("payload"), 1_qos)
+                       .with_cancellation(publish_signal.slot())
+                       .connect(recording_receiver{&published});
+    auto subscribe = client.subscriber("a/#", 1_qos)
+                         .with_cancellation(subscribe_signal.slot())
+                         .connect(recording_receiver{&subscribed});
+    auto filter = client.filtered_subscriber("a/b")
+                      .with_cancellation(filter_signal.slot())
+                      .connect(recording_receiver{&filtered});
+    publish.start();
+    subscribe.start();
+    filter.start();
+    REQUIRE_FALSE(published.done);
+    REQUIRE_FALSE(subscribed.done);
+    REQUIRE_FALSE(filtered.done);
+
+    publish_signal.emit();
+    subscribe_signal.emit();
+    filter_signal.emit();
+    REQUIRE(published.done);
+    REQUIRE(subscribed.done);
+    REQUIRE(filtered.done);
+    REQUIRE_FALSE(published.value);
+    REQUIRE_FALSE(subscribed.value);
+    REQUIRE_FALSE(filtered.value);
+
+    // Already completed, a second emit does nothing
+    filtered.done = false;
+    filter_signal.emit();
+    REQUIRE_FALSE(filtered.done);
+}
+
+TEST_CASE("client: cancelling one filtered subscriber keeps the others") {
+    boost::asio::io_context io;
+    client_type client(io.get_executor());
+    auto supervisor = client.supervisor("localhost", "1883", {});
+
+    mqtt5::cancellation_signal first_signal, second_signal;
+    completion first, second;
+    auto first_op = client.filtered_subscriber("a/+")
+                        .with_cancellation(first_signal.slot())
+                        .connect(recording_receiver{&first});
+    auto second_op = client.filtered_subscriber("a/+")
+                         .with_cancellation(second_signal.slot())
+                         .connect(recording_receiver{&second});
+    first_op.start();
+    second_op.start();
+
+    first_signal.emit();
+    REQUIRE(first.done);
+    REQUIRE_FALSE(second.done);
+
+    // The last receiver of the filter removes its entry
+    second_signal.emit();
+    REQUIRE(second.done);
+
+    // A new subscriber for the same filter starts a new entry
+    mqtt5::cancellation_signal third_signal;
+    completion third;
+    auto third_op = client.filtered_subscriber("a/+")
+                        .with_cancellation(third_signal.slot())
+                        .connect(recording_receiver{&third});
+    third_op.start();
+    third_signal.emit();
+    REQUIRE(third.done);
+}
+
+TEST_CASE("client: destroyed pending operations are forgotten") {
+    using namespace mqtt5::literals;
+    boost::asio::io_context io;
+    client_peer peer(io);
+    client_type client(io.get_executor());
+    completion connected;
+    p0443_v2::submit(client.supervisor("127.0.0.1", peer.port(), {}),
+                     recording_receiver{&connected});
+    REQUIRE(peer.accept());
+    REQUIRE(peer.receive_as<mqtt5::protocol::connect>());
+    peer.send(mqtt5::protocol::connack{});
+    REQUIRE(run_until(io, [&] { return connected.value; }));
+
+    completion published, subscribed;
+    mqtt5::protocol::puback puback;
+    mqtt5::protocol::suback suback;
+    {
+        auto publish = client.publisher("a/b", std::string("payload"), 1_qos)
+                           .connect(recording_receiver{&published});
+        auto subscribe =
+            client.subscriber("a/#", 1_qos).connect(recording_receiver{&subscribed});
+        publish.start();
+        subscribe.start();
+        auto sent_publish = peer.receive_as<mqtt5::protocol::publish>();
+        auto sent_subscribe = peer.receive_as<mqtt5::protocol::subscribe>();
+        REQUIRE(sent_publish);
+        REQUIRE(sent_subscribe);
+        puback.packet_identifier = sent_publish->packet_identifier;
+        suback.packet_identifier = sent_subscribe->packet_identifier;
+        suback.reason_codes.push_back(0x01);
+    }
+
+    // Acknowledgements of the destroyed operations find nothing to complete
+    peer.send({puback, suback});
+    completion next;
+    auto publish = client.publisher("a/b", std::string("payload"), 1_qos)
+                       .connect(recording_receiver{&next});
+    publish.start();
+    auto sent = peer.receive_as<mqtt5::protocol::publish>();
+    REQUIRE(sent);
+    puback.packet_identifier = sent->packet_identifier;
+    peer.send(puback);
+    REQUIRE(run_until(io, [&] { return next.value; }));
+    REQUIRE_FALSE(published.value);
+    REQUIRE_FALSE(subscribed.value);
+    client.close();
+}
+
+TEST_CASE("client: pending operations may outlive the client") {
+    using namespace mqtt5::literals;
+    boost::asio::io_context io;
+    std::optional<client_type> client(std::in_place, io.get_executor());
+    auto supervisor = client->supervisor("localhost", "1883", {});
+
+    completion published;
+    // Queued in the offline client, which is gone before the operation
+    auto *op = new auto(client->publisher("a/b", std::string("payload"), 1_qos)
+                            .connect(recording_receiver{&published}));
+    op->start();
+    client.reset();
+    delete op;
+    REQUIRE_FALSE(published.value);
+    REQUIRE_FALSE(published.done);
+}
+
+TEST_CASE("client: a destroyed operation is not cancelled by its signal") {
+    using namespace mqtt5::literals;
+    boost::asio::io_context io;
+    client_type client(io.get_executor());
+    auto supervisor = client.supervisor("localhost", "1883", {});
+
+    mqtt5::cancellation_signal signal;
+    completion published;
+    {
+        auto publish = client.publisher("a/b", std::string("payload"), 1_qos)
+                           .with_cancellation(signal.slot())
+                           .connect(recording_receiver{&published});
+        publish.start();
+    }
+    // The handler left with the operation, the signal can be used again
+    signal.emit();
+    REQUIRE_FALSE(published.done);
+
+    completion filtered;
+    auto filter = client.filtered_subscriber("a/b")
+                      .with_cancellation(signal.slot())
+                      .connect(recording_receiver{&filtered});
+    filter.start();
+    signal.emit();
+    REQUIRE(filtered.done);
+}
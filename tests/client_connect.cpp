@@ -0,0 +1,313 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include <mqtt5/client.hpp>
+#include <mqtt5/mapped_session_store.hpp>
+
+#include <doctest/doctest.h>
+
+#include "client_peer.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+
+namespace
+{
+using client_type = mqtt5::client<boost::asio::ip::tcp::socket>;
+
+struct connect_result
+{
+    bool value = false;
+    bool done = false;
+    std::exception_ptr error;
+
+    bool completed() const {
+        return value || done || error;
+    }
+};
+
+struct publish_receiver
+{
+    std::optional<mqtt5::publish_result> *result_;
+
+    void set_value(mqtt5::publish_result result) {
+        result_->emplace(result);
+    }
+    void set_done() {
+    }
+    void set_error(std::exception_ptr) {
+    }
+};
+
+struct connect_receiver
+{
+    connect_result *result_;
+
+    void set_value() {
+        result_->value = true;
+    }
+    void set_done() {
+        result_->done = true;
+    }
+    void set_error(std::exception_ptr e) {
+        result_->error = std::move(e);
+    }
+};
+
+/**
+ * Records how an operation completed, whatever its value.
+ */
+struct outcome_receiver
+{
+    connect_result *result_;
+
+    template <class... Values>
+    void set_value(Values &&...) {
+        result_->value = true;
+    }
+    void set_done() {
+        result_->done = true;
+    }
+    void set_error(std::exception_ptr e) {
+        result_->error = std::move(e);
+    }
+};
+
+mqtt5::protocol::connack make_connack(mqtt5::connect_reason_code reason, bool session_present) {
+    mqtt5::protocol::connack retval;
+    retval.flags = session_present ? 0x01 : 0x00;
+    retval.reason_code = static_cast<std::uint8_t>(reason);
+    return retval;
+}
+
+bool connect_socket(boost::asio::io_context &io, client_type &client, client_peer &peer) {
+    connect_result connected;
+    p0443_v2::submit(client.socket_connector("127.0.0.1", peer.port()),
+                     connect_receiver{&connected});
+    return peer.accept() && run_until(io, [&] { return connected.completed(); }) &&
+           connected.value;
+}
+
+/**
+ * Starts a QoS 1 publish, a subscribe and an unsubscribe and waits until the peer
+ * received all of them.
+ */
+void start_operations(client_type &client, client_peer &peer, connect_result &published,
+                      connect_result &subscribed, connect_result &unsubscribed) {
+    using namespace mqtt5::literals;
+    p0443_v2::submit(client.publisher("a/b", std::string("payload"), 1_qos),
+                     outcome_receiver{&published});
+    p0443_v2::submit(client.subscriber("a/#", 1_qos), outcome_receiver{&subscribed});
+    p0443_v2::submit(client.unsubscriber({"c/#"}), outcome_receiver{&unsubscribed});
+    REQUIRE(peer.receive_as<mqtt5::protocol::publish>());
+    REQUIRE(peer.receive_as<mqtt5::protocol::subscribe>());
+    REQUIRE(peer.receive_as<mqtt5::protocol::unsubscribe>());
+}
+
+mqtt5::connect_reason_code refusal_reason(const std::exception_ptr &error) {
+    try {
+        std::rethrow_exception(error);
+    }
+    catch (const mqtt5::connect_error &e) {
+        return e.reason_code();
+    }
+    catch (...) {
+    }
+    return mqtt5::connect_reason_code::success;
+}
+} // namespace
+
+TEST_CASE("client: refused connack leaves the stored session") {
+    using namespace mqtt5::literals;
+    auto path = (std::filesystem::temp_directory_path() / "mqtt5-client-refused.journal").string();
+    std::filesystem::remove(path);
+    auto store = std::make_shared<mqtt5::mapped_session_store>(path, 4096);
+    mqtt5::protocol::publish stored;
+    stored.topic = "a/b";
+    stored.packet_identifier = 5;
+    stored.set_quality_of_service(1_qos);
+    stored.set_payload(std::string("payload"));
+    store->publish_sent(stored);
+
+    boost::asio::io_context io;
+    client_peer peer(io);
+    client_type client(io.get_executor());
+    client.set_session_store(store);
+    mqtt5::connect_options opts;
+    opts.clean_start = false;
+
+    REQUIRE(connect_socket(io, client, peer));
+    connect_result refused;
+    p0443_v2::submit(client.handshaker(opts), connect_receiver{&refused});
+    REQUIRE(peer.receive_as<mqtt5::protocol::connect>());
+    peer.send(make_connack(mqtt5::connect_reason_code::not_authorized, false));
+    REQUIRE(run_until(io, [&] { return refused.completed(); }));
+    REQUIRE(refusal_reason(refused.error) == mqtt5::connect_reason_code::not_authorized);
+    REQUIRE_FALSE(client.is_connected());
+    // The client closed the connection
+    REQUIRE_FALSE(peer.receive());
+    REQUIRE(store->recover().outgoing.size() == 1);
+
+    // Handlers of the closed connection run before it is connected again
+    io.restart();
+    io.poll();
+    REQUIRE(connect_socket(io, client, peer));
+    connect_result accepted;
+    p0443_v2::submit(client.handshaker(opts), connect_receiver{&accepted});
+    REQUIRE(peer.receive_as<mqtt5::protocol::connect>());
+    peer.send(make_connack(mqtt5::connect_reason_code::success, true));
+    REQUIRE(run_until(io, [&] { return accepted.completed(); }));
+    REQUIRE(accepted.value);
+
+    // The session was still there to be resumed
+    auto resent = peer.receive_as<mqtt5::protocol::publish>();
+    REQUIRE(resent);
+    REQUIRE(resent->packet_identifier == 5);
+    REQUIRE(resent->duplicate_flag());
+
+    client.close();
+    store.reset();
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("client: refused connack takes the next backoff step") {
+    using namespace mqtt5::literals;
+    using namespace std::chrono_literals;
+    boost::asio::io_context io;
+    client_peer peer(io);
+    client_type client(io.get_executor());
+
+    mqtt5::reconnect_options reconnect;
+    reconnect.initial_delay = 200ms;
+    reconnect.multiplier = 4.0;
+    connect_result supervised;
+    p0443_v2::submit(client.supervisor("127.0.0.1", peer.port(), {}, reconnect),
+                     connect_receiver{&supervised});
+    // Held until the client is online
+    std::optional<mqtt5::publish_result> published;
+    p0443_v2::submit(client.publisher("a/b", std::string("payload"), 1_qos),
+                     publish_receiver{&published});
+
+    std::chrono::steady_clock::time_point refused_at;
+    for (int attempt = 0; attempt < 3; attempt++) {
+        REQUIRE(peer.accept());
+        if (attempt == 2) {
+            // The second retry waits for the grown bound, [400, 800] ms, not the initial one
+            REQUIRE(std::chrono::steady_clock::now() - refused_at >= 350ms);
+        }
+        REQUIRE(peer.receive_as<mqtt5::protocol::connect>());
+        peer.send(make_connack(mqtt5::connect_reason_code::server_busy, false));
+        refused_at = std::chrono::steady_clock::now();
+        // Nothing held is sent on a refused connection
+        REQUIRE_FALSE(peer.receive());
+        REQUIRE_FALSE(supervised.completed());
+    }
+
+    REQUIRE(peer.accept());
+    REQUIRE(peer.receive_as<mqtt5::protocol::connect>());
+    peer.send(make_connack(mqtt5::connect_reason_code::success, false));
+    auto publish = peer.receive_as<mqtt5::protocol::publish>();
+    REQUIRE(publish);
+    REQUIRE(publish->topic == "a/b");
+    REQUIRE(supervised.value);
+
+    mqtt5::protocol::puback puback;
+    puback.packet_identifier = publish->packet_identifier;
+    peer.send(puback);
+    REQUIRE(run_until(io, [&] { return published.has_value(); }));
+    REQUIRE(*published == mqtt5::publish_result::success);
+    client.close();
+}
+
+TEST_CASE("client: a lost connection fails pending operations with its error") {
+    boost::asio::io_context io;
+    client_peer peer(io);
+    client_type client(io.get_executor());
+    REQUIRE(connect_socket(io, client, peer));
+    connect_result connected;
+    p0443_v2::submit(client.handshaker({}), connect_receiver{&connected});
+    REQUIRE(peer.receive_as<mqtt5::protocol::connect>());
+    peer.send(mqtt5::protocol::connack{});
+    REQUIRE(run_until(io, [&] { return connected.completed(); }));
+
+    connect_result published, subscribed, unsubscribed;
+    start_operations(client, peer, published, subscribed, unsubscribed);
+    peer.close();
+    REQUIRE(run_until(io, [&] {
+        return published.completed() && subscribed.completed() && unsubscribed.completed();
+    }));
+    REQUIRE(published.error);
+    // All of them get the error the connection was lost with
+    REQUIRE(subscribed.error == published.error);
+    REQUIRE(unsubscribed.error == published.error);
+    try {
+        std::rethrow_exception(published.error);
+    }
+    catch (const boost::system::system_error &e) {
+        REQUIRE(e.code() == boost::asio::error::eof);
+    }
+}
+
+TEST_CASE("client: a supervised client keeps pending operations when the connection is lost") {
+    boost::asio::io_context io;
+    client_peer peer(io);
+    client_type client(io.get_executor());
+    connect_result supervised;
+    p0443_v2::submit(client.supervisor("127.0.0.1", peer.port(), {}),
+                     connect_receiver{&supervised});
+    REQUIRE(peer.accept());
+    REQUIRE(peer.receive_as<mqtt5::protocol::connect>());
+    peer.send(mqtt5::protocol::connack{});
+    REQUIRE(run_until(io, [&] { return supervised.completed(); }));
+
+    connect_result published, subscribed, unsubscribed;
+    start_operations(client, peer, published, subscribed, unsubscribed);
+    peer.close();
+
+    // Sent again on the next connection, the server had no session
+    REQUIRE(peer.accept());
+    REQUIRE(peer.receive_as<mqtt5::protocol::connect>());
+    REQUIRE_FALSE(published.completed());
+    REQUIRE_FALSE(subscribed.completed());
+    REQUIRE_FALSE(unsubscribed.completed());
+    peer.send(mqtt5::protocol::connack{});
+    std::optional<mqtt5::protocol::publish> publish;
+    std::optional<mqtt5::protocol::subscribe> subscribe;
+    std::optional<mqtt5::protocol::unsubscribe> unsubscribe;
+    for (int i = 0; i < 3; i++) {
+        auto packet = peer.receive();
+        REQUIRE(packet);
+        if (auto *body = packet->body_as<mqtt5::protocol::publish>()) {
+            publish = *body;
+        }
+        else if (auto *body = packet->body_as<mqtt5::protocol::subscribe>()) {
+            subscribe = *body;
+        }
+        else if (auto *body = packet->body_as<mqtt5::protocol::unsubscribe>()) {
+            unsubscribe = *body;
+        }
+    }
+    REQUIRE(publish);
+    REQUIRE(subscribe);
+    REQUIRE(unsubscribe);
+
+    mqtt5::protocol::puback puback;
+    puback.packet_identifier = publish->packet_identifier;
+    mqtt5::protocol::suback suback;
+    suback.packet_identifier = subscribe->packet_identifier;
+    suback.reason_codes.push_back(0x01);
+    mqtt5::protocol::unsuback unsuback;
+    unsuback.packet_identifier = unsubscribe->packet_identifier;
+    unsuback.reason_codes.push_back(0x00);
+    peer.send({puback, suback, unsuback});
+    REQUIRE(run_until(io, [&] {
+        return published.completed() && subscribed.completed() && unsubscribed.completed();
+    }));
+    REQUIRE(published.value);
+    REQUIRE(subscribed.value);
+    REQUIRE(unsubscribed.value);
+    client.close();
+}
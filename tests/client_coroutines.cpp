@@ -0,0 +1,199 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include <mqtt5/client.hpp>
+
+#include <doctest/doctest.h>
+
+#ifdef MQTT5_HAS_COROUTINES
+
+#include "client_peer.hpp"
+
+#include <exception>
+#include <optional>
+#include <string>
+
+namespace
+{
+using client_type = mqtt5::client<boost::asio::ip::tcp::socket>;
+namespace coro = mqtt5::detail::coro;
+
+/**
+ * Starts eagerly and keeps its frame until destroyed.
+ */
+struct task
+{
+    struct promise_type
+    {
+        bool finished = false;
+
+        task get_return_object() {
+            return task{coro::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        auto initial_suspend() noexcept {
+            return suspend{false};
+        }
+        auto final_suspend() noexcept {
+            finished = true;
+            return suspend{true};
+        }
+        void return_void() {
+        }
+        void unhandled_exception() {
+            std::terminate();
+        }
+    };
+
+    struct suspend
+    {
+        bool suspends;
+        bool await_ready() const noexcept {
+            return !suspends;
+        }
+        void await_suspend(coro::coroutine_handle<>) const noexcept {
+        }
+        void await_resume() const noexcept {
+        }
+    };
+
+    coro::coroutine_handle<promise_type> handle_;
+
+    explicit task(coro::coroutine_handle<promise_type> handle) : handle_(handle) {
+    }
+    task(const task &) = delete;
+    ~task() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    bool finished() const {
+        return handle_.promise().finished;
+    }
+};
+
+struct outcome
+{
+    std::optional<mqtt5::publish_result> published;
+    std::optional<mqtt5::subscribe_result> subscribed;
+    std::optional<mqtt5::protocol::publish> received;
+};
+
+task publish_subscribe_receive(client_type &client, outcome &out) {
+    using namespace mqtt5::literals;
+    out.published = co_await client.async_publish("a/b", std::string("payload"), 1_qos);
+    out.subscribed = co_await client.async_subscribe("c/#", 1_qos);
+    out.received = co_await client.async_receive("c/#");
+}
+
+task cancellable_publish(client_type &client, mqtt5::cancellation_signal &signal,
+                         outcome &out) {
+    using namespace mqtt5::literals;
+    out.published = co_await client.async_publish("a/b", std::string("payload"), 1_qos)
+                        .with_cancellation(signal.slot());
+    out.received = co_await client.async_receive("c/#").with_cancellation(signal.slot());
+}
+
+task receive(client_type &client, outcome &out) {
+    out.received = co_await client.async_receive("c/#");
+}
+
+bool connect(boost::asio::io_context &io, client_type &client, client_peer &peer) {
+    bool connected = false;
+    struct receiver
+    {
+        bool *connected_;
+        void set_value() {
+            *connected_ = true;
+        }
+        void set_done() {
+        }
+        void set_error(std::exception_ptr) {
+        }
+    };
+    p0443_v2::submit(client.supervisor("127.0.0.1", peer.port(), {}), receiver{&connected});
+    if (!peer.accept() || !peer.receive_as<mqtt5::protocol::connect>()) {
+        return false;
+    }
+    peer.send(mqtt5::protocol::connack{});
+    return run_until(io, [&] { return connected; });
+}
+} // namespace
+
+TEST_CASE("client: awaited operations resume with their results") {
+    boost::asio::io_context io;
+    client_peer peer(io);
+    client_type client(io.get_executor());
+    REQUIRE(connect(io, client, peer));
+
+    outcome out;
+    task t = publish_subscribe_receive(client, out);
+    auto publish = peer.receive_as<mqtt5::protocol::publish>();
+    REQUIRE(publish);
+    mqtt5::protocol::puback puback;
+    puback.packet_identifier = publish->packet_identifier;
+    peer.send(puback);
+
+    auto subscribe = peer.receive_as<mqtt5::protocol::subscribe>();
+    REQUIRE(subscribe);
+    REQUIRE(out.published == mqtt5::publish_result::success);
+    mqtt5::protocol::suback suback;
+    suback.packet_identifier = subscribe->packet_identifier;
+    suback.reason_codes.push_back(0x01);
+    peer.send(suback);
+    REQUIRE(run_until(io, [&] { return out.subscribed.has_value(); }));
+    REQUIRE(out.subscribed->codes.size() == 1);
+
+    mqtt5::protocol::publish incoming;
+    incoming.topic = "c/d";
+    peer.send(incoming);
+    REQUIRE(run_until(io, [&] { return t.finished(); }));
+    REQUIRE(out.received);
+    REQUIRE(out.received->topic == "c/d");
+    client.close();
+}
+
+TEST_CASE("client: cancelled awaits resume with an empty result") {
+    boost::asio::io_context io;
+    client_type client(io.get_executor());
+    // Never started, the publish is held by the offline client
+    auto supervisor = client.supervisor("localhost", "1883", {});
+
+    mqtt5::cancellation_signal signal;
+    outcome out;
+    task t = cancellable_publish(client, signal, out);
+    REQUIRE_FALSE(t.finished());
+
+    signal.emit();
+    REQUIRE_FALSE(out.published);
+    REQUIRE_FALSE(t.finished());
+    // The signal is free again once the cancelled operation completed
+    signal.emit();
+    REQUIRE(t.finished());
+    REQUIRE_FALSE(out.received);
+}
+
+TEST_CASE("client: a destroyed suspended coroutine is never resumed") {
+    boost::asio::io_context io;
+    client_peer peer(io);
+    client_type client(io.get_executor());
+    REQUIRE(connect(io, client, peer));
+
+    outcome destroyed, alive;
+    {
+        task t = receive(client, destroyed);
+        REQUIRE_FALSE(t.finished());
+    }
+    task t = receive(client, alive);
+    mqtt5::protocol::publish incoming;
+    incoming.topic = "c/d";
+    peer.send(incoming);
+    REQUIRE(run_until(io, [&] { return t.finished(); }));
+    REQUIRE(alive.received);
+    REQUIRE_FALSE(destroyed.received);
+    client.close();
+}
+
+#endif
@@ -0,0 +1,147 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <mqtt5/connection.hpp>
+
+#include <p0443_v2/submit.hpp>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/write.hpp>
+
+#include <chrono>
+#include <exception>
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * Runs handlers until pred returns true, false if that did not happen within a few seconds.
+ */
+template <class Predicate>
+bool run_until(boost::asio::io_context &io, Predicate pred) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    io.restart();
+    while (!pred()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        if (io.run_one_for(std::chrono::milliseconds(10)) == 0) {
+            io.restart();
+        }
+    }
+    return true;
+}
+
+/**
+ * The server end of client connections on the loopback interface.
+ *
+ * Reads and writes whole control packets, handlers of the client and the peer run on
+ * the same io_context.
+ */
+class client_peer
+{
+    using socket_type = boost::asio::ip::tcp::socket;
+
+    struct read_receiver
+    {
+        client_peer *peer_;
+        void set_value(mqtt5::protocol::control_packet packet) {
+            peer_->received_.emplace(std::move(packet));
+            peer_->reading_ = false;
+        }
+        void set_done() {
+            peer_->reading_ = false;
+        }
+        void set_error(std::exception_ptr) {
+            peer_->reading_ = false;
+        }
+    };
+
+    boost::asio::io_context &io_;
+    boost::asio::ip::tcp::acceptor acceptor_;
+    std::optional<mqtt5::connection<socket_type>> connection_;
+    std::optional<mqtt5::protocol::control_packet> received_;
+    bool reading_ = false;
+
+public:
+    explicit client_peer(boost::asio::io_context &io)
+        : io_(io), acceptor_(io, {boost::asio::ip::address_v4::loopback(), 0}) {
+    }
+
+    std::string port() const {
+        return std::to_string(acceptor_.local_endpoint().port());
+    }
+
+    /**
+     * @brief Accept the next connection from a client, replacing the current one.
+     */
+    bool accept() {
+        std::optional<socket_type> accepted;
+        acceptor_.async_accept([&](const boost::system::error_code &ec, socket_type socket) {
+            if (!ec) {
+                accepted.emplace(std::move(socket));
+            }
+        });
+        if (!run_until(io_, [&] { return accepted.has_value(); })) {
+            acceptor_.cancel();
+            return false;
+        }
+        connection_.emplace(std::move(*accepted));
+        reading_ = false;
+        return true;
+    }
+
+    /**
+     * @brief Close the connection, the client reads an end of file.
+     */
+    void close() {
+        connection_->next_layer().close();
+    }
+
+    /**
+     * @brief Read the next packet the client sent.
+     *
+     * @return An empty optional if the connection was closed or nothing arrived in time.
+     */
+    std::optional<mqtt5::protocol::control_packet> receive() {
+        received_.reset();
+        if (!reading_) {
+            reading_ = true;
+            p0443_v2::submit(connection_->control_packet_reader(), read_receiver{this});
+        }
+        run_until(io_, [this] { return received_.has_value() || !reading_; });
+        return std::exchange(received_, std::nullopt);
+    }
+
+    /**
+     * @brief Read the next packet, expecting it to be a T.
+     */
+    template <class T>
+    std::optional<T> receive_as() {
+        auto packet = receive();
+        if (!packet) {
+            return {};
+        }
+        return std::move(*packet).template body_as<T>();
+    }
+
+    /**
+     * @brief Write packets to the client with a single write.
+     */
+    void send(const std::vector<mqtt5::protocol::control_packet> &packets) {
+        std::vector<std::uint8_t> buffer;
+        for (auto &packet : packets) {
+            packet.serialize([&](auto b) { buffer.push_back(b); });
+        }
+        boost::asio::write(connection_->next_layer(), boost::asio::buffer(buffer));
+    }
+
+    void send(const mqtt5::protocol::control_packet &packet) {
+        send(std::vector<mqtt5::protocol::control_packet>{packet});
+    }
+};
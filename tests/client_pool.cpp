@@ -0,0 +1,179 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include <mqtt5/client_pool.hpp>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+#include <doctest/doctest.h>
+
+#include "client_peer.hpp"
+
+#include <string>
+
+namespace
+{
+using pool_type = mqtt5::client_pool<boost::asio::ip::tcp::socket>;
+
+struct completion
+{
+    bool value = false;
+    bool done = false;
+    std::optional<mqtt5::protocol::publish> publish;
+};
+
+struct recording_receiver
+{
+    completion *completion_;
+
+    void set_value(mqtt5::protocol::publish publish) {
+        completion_->value = true;
+        completion_->publish.emplace(std::move(publish));
+    }
+    template <class... Values>
+    void set_value(Values &&...) {
+        completion_->value = true;
+    }
+    void set_done() {
+        completion_->done = true;
+    }
+    void set_error(std::exception_ptr) {
+    }
+};
+
+void connect_client(boost::asio::io_context &io, pool_type &pool, std::size_t index,
+                    client_peer &peer) {
+    completion connected;
+    p0443_v2::submit(pool.supervisor(index, "127.0.0.1", peer.port(), {}),
+                     recording_receiver{&connected});
+    REQUIRE(peer.accept());
+    REQUIRE(peer.receive_as<mqtt5::protocol::connect>());
+    peer.send(mqtt5::protocol::connack{});
+    REQUIRE(run_until(io, [&] { return connected.value; }));
+}
+
+std::vector<pool_type::executor_type> executors(boost::asio::io_context &io, std::size_t count) {
+    return std::vector<pool_type::executor_type>(count, io.get_executor());
+}
+} // namespace
+
+TEST_CASE("client_pool: filters without subscriptions are hashed like topics") {
+    boost::asio::io_context io;
+    pool_type pool(executors(io, 4));
+    REQUIRE(pool.size() == 4);
+    for (const char *topic : {"a/b", "a/c", "sensors/1", "x"}) {
+        REQUIRE(&pool.client_for_filter(topic) == &pool.client_for(topic));
+    }
+}
+
+TEST_CASE("client_pool: filters wait on the client of an overlapping subscription") {
+    using namespace mqtt5::literals;
+    boost::asio::io_context io;
+    pool_type pool(executors(io, 4));
+
+    auto subscribe = pool.subscriber("sensors/#", 1_qos);
+    auto &owner = pool.client_for_filter("sensors/#");
+    for (const char *filter : {"sensors/1", "sensors/+/temperature", "sensors", "+/2", "#"}) {
+        REQUIRE(&pool.client_for_filter(filter) == &owner);
+    }
+
+    // An overlapping subscription is made on the same client
+    auto overlapping = pool.subscriber("+/1", 1_qos);
+    REQUIRE(&pool.client_for_filter("+/1") == &owner);
+    REQUIRE(&pool.client_for_filter("other/1") == &owner);
+
+    REQUIRE(&pool.client_for_filter("other/2") == &pool.client_for("other/2"));
+}
+
+TEST_CASE("client_pool: unsubscribing stops routing to the subscription") {
+    using namespace mqtt5::literals;
+    boost::asio::io_context io;
+    pool_type pool(executors(io, 4));
+
+    auto subscribe = pool.subscriber("sensors/#", 1_qos);
+    auto unsubscribe = pool.unsubscriber("sensors/#");
+    for (const char *filter : {"sensors/1", "sensors/2", "sensors/3/temperature"}) {
+        REQUIRE(&pool.client_for_filter(filter) == &pool.client_for(filter));
+    }
+}
+
+TEST_CASE("client_pool: operations start on the client executor") {
+    using namespace mqtt5::literals;
+    boost::asio::io_context io;
+    pool_type pool(executors(io, 2));
+    // Never started, the clients stay offline and buffer publishes
+    auto first = pool.supervisor(0, "localhost", "1883", {});
+    auto second = pool.supervisor(1, "localhost", "1883", {});
+
+    completion published;
+    auto publish = pool.publisher("a/b", std::string("payload"), 0_qos)
+                       .connect(recording_receiver{&published});
+    publish.start();
+    // Nothing ran on the calling thread
+    REQUIRE_FALSE(published.value);
+    io.poll();
+    REQUIRE(published.value);
+}
+
+TEST_CASE("client_pool: filters wait on every overlapping subscription") {
+    using namespace mqtt5::literals;
+    boost::asio::io_context io;
+    pool_type pool(executors(io, 4));
+
+    // Two filters that don't overlap and hash to different clients
+    std::string first_topic = "a/0", second_topic;
+    for (int i = 1; second_topic.empty(); i++) {
+        auto topic = "a/" + std::to_string(i);
+        if (&pool.client_for_filter(topic.c_str()) !=
+            &pool.client_for_filter(first_topic.c_str())) {
+            second_topic = topic;
+        }
+    }
+    auto first_subscribe = pool.subscriber(first_topic.c_str(), 1_qos);
+    auto second_subscribe = pool.subscriber(second_topic.c_str(), 1_qos);
+    std::size_t second_index = 0;
+    while (&pool[second_index] != &pool.client_for_filter(second_topic.c_str())) {
+        second_index++;
+    }
+    client_peer peer(io);
+    connect_client(io, pool, second_index, peer);
+
+    completion filtered;
+    auto filter = pool.filtered_subscriber("a/+").connect(recording_receiver{&filtered});
+    filter.start();
+    io.poll();
+
+    // Delivered by the client of the second subscription
+    mqtt5::protocol::publish publish;
+    publish.topic = second_topic;
+    peer.send(publish);
+    REQUIRE(run_until(io, [&] { return filtered.value || filtered.done; }));
+    REQUIRE(filtered.publish);
+    REQUIRE(filtered.publish->topic == second_topic);
+    pool.close();
+}
+
+TEST_CASE("client_pool: cancelling a filter stops every client") {
+    using namespace mqtt5::literals;
+    boost::asio::io_context io;
+    pool_type pool(executors(io, 4));
+    auto first_subscribe = pool.subscriber("a/0", 1_qos);
+    auto second_subscribe = pool.subscriber("b/0", 1_qos);
+
+    mqtt5::cancellation_signal signal;
+    completion filtered;
+    auto filter = pool.filtered_subscriber("#")
+                      .with_cancellation(signal.slot())
+                      .connect(recording_receiver{&filtered});
+    filter.start();
+    io.poll();
+    signal.emit();
+    REQUIRE_FALSE(filtered.done);
+    io.restart();
+    io.poll();
+    REQUIRE(filtered.done);
+    REQUIRE_FALSE(filtered.value);
+}
@@ -0,0 +1,46 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include <mqtt5/detail/endpoint_cache.hpp>
+
+#include <doctest/doctest.h>
+
+using namespace std::chrono_literals;
+using cache_t = mqtt5::detail::endpoint_cache<int>;
+
+TEST_CASE("endpoint_cache: entries expire after the ttl") {
+    cache_t cache(10s);
+    const auto now = cache_t::clock::now();
+    REQUIRE(cache.find("host", "1883", now) == nullptr);
+
+    cache.store("host", "1883", 42, now);
+    REQUIRE(cache.find("host", "1883", now + 9s) != nullptr);
+    REQUIRE(*cache.find("host", "1883", now + 9s) == 42);
+    REQUIRE(cache.find("host", "8883", now) == nullptr);
+    REQUIRE(cache.find("host", "1883", now + 10s) == nullptr);
+    // Expired entries are dropped
+    REQUIRE(cache.find("host", "1883", now) == nullptr);
+}
+
+TEST_CASE("endpoint_cache: store replaces and evict removes") {
+    cache_t cache(10s);
+    const auto now = cache_t::clock::now();
+    cache.store("host", "1883", 1, now);
+    cache.store("host", "1883", 2, now + 5s);
+    REQUIRE(*cache.find("host", "1883", now + 12s) == 2);
+
+    cache.evict("host", "1883");
+    REQUIRE(cache.find("host", "1883", now) == nullptr);
+}
+
+TEST_CASE("endpoint_cache: zero ttl disables caching") {
+    cache_t cache(10s);
+    const auto now = cache_t::clock::now();
+    cache.store("host", "1883", 1, now);
+    cache.set_ttl(0s);
+    REQUIRE(cache.find("host", "1883", now) == nullptr);
+    cache.store("host", "1883", 1, now);
+    REQUIRE(cache.find("host", "1883", now) == nullptr);
+}
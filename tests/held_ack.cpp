@@ -0,0 +1,65 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include <mqtt5/detail/held_ack.hpp>
+
+#include <doctest/doctest.h>
+
+namespace
+{
+using kind_type = mqtt5::detail::held_ack::kind_type;
+
+std::shared_ptr<mqtt5::detail::held_ack> make_ack(kind_type kind, std::uint16_t id) {
+    auto retval = std::make_shared<mqtt5::detail::held_ack>();
+    retval->kind_ = kind;
+    retval->packet_identifier_ = id;
+    retval->remaining_ = 1;
+    return retval;
+}
+
+mqtt5::ack_token make_token(mqtt5::quality_of_service qos, std::uint16_t id) {
+    mqtt5::ack_token retval;
+    retval.qos = qos;
+    retval.packet_identifier = id;
+    return retval;
+}
+} // namespace
+
+TEST_CASE("held_ack: tokens release the matching ack once") {
+    using namespace mqtt5::literals;
+    mqtt5::detail::manual_ack_table table;
+    auto puback = make_ack(kind_type::puback, 7);
+    auto pubcomp = make_ack(kind_type::pubcomp, 7);
+    table.hold(puback);
+    table.hold(pubcomp);
+    REQUIRE(table.size() == 2);
+
+    REQUIRE(table.release(make_token(2_qos, 7)) == pubcomp);
+    REQUIRE(table.release(make_token(2_qos, 7)) == nullptr);
+    REQUIRE(table.release(make_token(1_qos, 8)) == nullptr);
+    REQUIRE(table.release(make_token(1_qos, 7)) == puback);
+    REQUIRE(table.size() == 0);
+}
+
+TEST_CASE("held_ack: acks added before a flush are written together") {
+    mqtt5::detail::ack_batch batch;
+    REQUIRE(batch.add(*make_ack(kind_type::puback, 1)));
+    REQUIRE_FALSE(batch.add(*make_ack(kind_type::pubcomp, 2)));
+    REQUIRE_FALSE(batch.add(*make_ack(kind_type::puback, 3)));
+    REQUIRE_FALSE(batch.add(*make_ack(kind_type::none, 4)));
+
+    auto packets = batch.take();
+    REQUIRE(batch.empty());
+    REQUIRE(packets.size() == 3);
+    REQUIRE(packets[0].body_as<mqtt5::protocol::puback>()->packet_identifier == 1);
+    REQUIRE(packets[1].body_as<mqtt5::protocol::pubcomp>()->packet_identifier == 2);
+    REQUIRE(packets[2].body_as<mqtt5::protocol::puback>()->packet_identifier == 3);
+
+    // The next ack starts a new batch
+    REQUIRE(batch.add(*make_ack(kind_type::pubcomp, 5)));
+    batch.clear();
+    REQUIRE(batch.empty());
+    REQUIRE_FALSE(batch.add(*make_ack(kind_type::none, 6)));
+}
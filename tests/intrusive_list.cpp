@@ -0,0 +1,115 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include <mqtt5/detail/intrusive_list.hpp>
+
+#include <doctest/doctest.h>
+
+#include <vector>
+
+namespace
+{
+struct item : mqtt5::detail::intrusive_list_node<item>
+{
+    int value;
+    explicit item(int v) : value(v) {
+    }
+};
+
+std::vector<int> values(mqtt5::detail::intrusive_list<item> &list) {
+    std::vector<int> retval;
+    for (auto &i : list) {
+        retval.push_back(i.value);
+    }
+    return retval;
+}
+} // namespace
+
+TEST_CASE("intrusive_list: push, erase and pop") {
+    item a(1), b(2), c(3);
+    mqtt5::detail::intrusive_list<item> list;
+    REQUIRE(list.empty());
+
+    list.push_back(a);
+    list.push_back(b);
+    list.push_back(c);
+    REQUIRE(list.size() == 3);
+    REQUIRE(values(list) == std::vector<int>{1, 2, 3});
+    REQUIRE(b.is_linked());
+
+    list.erase(b);
+    REQUIRE_FALSE(b.is_linked());
+    REQUIRE(values(list) == std::vector<int>{1, 3});
+
+    REQUIRE(&list.pop_front() == &a);
+    list.erase(c);
+    REQUIRE(list.empty());
+    REQUIRE(list.size() == 0);
+}
+
+TEST_CASE("intrusive_list: find and move") {
+    item a(1), b(2);
+    mqtt5::detail::intrusive_list<item> list;
+    list.push_back(a);
+    list.push_back(b);
+
+    REQUIRE(list.find_if([](const item &i) { return i.value == 2; }) == &b);
+    REQUIRE(list.find_if([](const item &i) { return i.value == 3; }) == nullptr);
+
+    auto moved = std::move(list);
+    REQUIRE(list.empty());
+    REQUIRE(values(moved) == std::vector<int>{1, 2});
+
+    // Copies of a node are never linked
+    item copy(a);
+    REQUIRE_FALSE(copy.is_linked());
+
+    moved.pop_front();
+    moved.pop_front();
+}
+
+TEST_CASE("intrusive_list: replace keeps the position") {
+    item a(1), b(2), c(3), d(4), e(5);
+    mqtt5::detail::intrusive_list<item> list;
+    list.push_back(a);
+    list.push_back(b);
+    list.push_back(c);
+
+    list.replace(b, d);
+    REQUIRE_FALSE(b.is_linked());
+    REQUIRE(d.is_linked());
+    REQUIRE(values(list) == std::vector<int>{1, 4, 3});
+
+    // Head and tail
+    list.replace(a, b);
+    list.replace(c, e);
+    REQUIRE(values(list) == std::vector<int>{2, 4, 5});
+    REQUIRE(list.size() == 3);
+
+    list.erase(e);
+    REQUIRE(values(list) == std::vector<int>{2, 4});
+    list.pop_front();
+    list.pop_front();
+}
+
+TEST_CASE("intrusive_list: destroyed nodes unlink themselves") {
+    mqtt5::detail::intrusive_list<item> list;
+    item a(1), c(3);
+    list.push_back(a);
+    {
+        item b(2);
+        list.push_back(b);
+        list.push_back(c);
+    }
+    REQUIRE(values(list) == std::vector<int>{1, 3});
+    REQUIRE(list.size() == 2);
+
+    // Nodes outliving their list are left unlinked
+    {
+        mqtt5::detail::intrusive_list<item> other = std::move(list);
+    }
+    REQUIRE_FALSE(a.is_linked());
+    REQUIRE_FALSE(c.is_linked());
+}
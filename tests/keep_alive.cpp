@@ -0,0 +1,31 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include <mqtt5/detail/keep_alive.hpp>
+
+#include <doctest/doctest.h>
+
+using namespace std::chrono_literals;
+
+TEST_CASE("keep_alive: timer re-armed for what is left") {
+    const auto start = mqtt5::detail::keep_alive_clock::now();
+
+    // Received something since the timer was armed
+    REQUIRE(mqtt5::detail::keep_alive_remaining(start + 4s, 10s, start + 10s) == 4s);
+    // Silent for exactly the keep-alive
+    REQUIRE(mqtt5::detail::keep_alive_remaining(start, 10s, start + 10s) == 0s);
+    REQUIRE(mqtt5::detail::keep_alive_remaining(start, 10s, start + 11s) < 0s);
+}
+
+TEST_CASE("keep_alive: ping skipped while there is traffic both ways") {
+    const auto start = mqtt5::detail::keep_alive_clock::now();
+
+    // Sent and received within half the keep-alive
+    REQUIRE(mqtt5::detail::ping_remaining(start + 3s, start + 2s, 10s, start + 5s) == 2s);
+    // Only sending doesn't tell if the server is there
+    REQUIRE(mqtt5::detail::ping_remaining(start + 5s, start, 10s, start + 5s) == 0s);
+    // Only receiving doesn't keep the server's keep-alive of this client going
+    REQUIRE(mqtt5::detail::ping_remaining(start, start + 5s, 10s, start + 6s) < 0s);
+}
@@ -0,0 +1,148 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include <mqtt5/client.hpp>
+#include <mqtt5/keep_alive_manager.hpp>
+
+#include <boost/asio/io_context.hpp>
+
+#include <doctest/doctest.h>
+
+#include "client_peer.hpp"
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+namespace
+{
+struct watch : mqtt5::detail::keep_alive_watch
+{
+    std::vector<std::uint64_t> expired;
+
+    void keep_alive_expired(std::uint64_t registration) override {
+        expired.push_back(registration);
+    }
+};
+
+struct connect_receiver
+{
+    bool *connected_;
+
+    void set_value() {
+        *connected_ = true;
+    }
+    void set_done() {
+    }
+    void set_error(std::exception_ptr) {
+    }
+};
+} // namespace
+
+TEST_CASE("keep_alive_wheel: silent connection expires after its limit") {
+    mqtt5::detail::keep_alive_wheel wheel;
+    watch w;
+    wheel.watch(w, 3);
+    REQUIRE(wheel.size() == 1);
+
+    wheel.advance(3);
+    REQUIRE(w.expired.empty());
+    wheel.advance(4);
+    REQUIRE(w.expired == std::vector<std::uint64_t>{1});
+    REQUIRE(wheel.empty());
+}
+
+TEST_CASE("keep_alive_wheel: touch moves the deadline") {
+    mqtt5::detail::keep_alive_wheel wheel;
+    watch w;
+    wheel.watch(w, 3);
+
+    wheel.advance(2);
+    w.touch();
+    // Deadline reached, rescheduled to the last activity plus the limit
+    wheel.advance(4);
+    REQUIRE(w.expired.empty());
+    REQUIRE(wheel.size() == 1);
+
+    wheel.advance(5);
+    REQUIRE(w.expired.empty());
+    wheel.advance(6);
+    REQUIRE(w.expired == std::vector<std::uint64_t>{1});
+
+    // Checked late, the connection was silent the whole time
+    wheel.watch(w, 2);
+    wheel.advance(100);
+    REQUIRE(w.expired == std::vector<std::uint64_t>{1, 2});
+}
+
+TEST_CASE("keep_alive_wheel: registrations identify the current watch") {
+    mqtt5::detail::keep_alive_wheel wheel;
+    watch a, b;
+    wheel.watch(a, 2);
+    wheel.watch(b, 2);
+    REQUIRE(a.registration() == 1);
+
+    // Watching again restarts the deadline, a timeout reported for the old one is stale
+    wheel.advance(1);
+    wheel.watch(a, 2);
+    REQUIRE(a.registration() == 2);
+    REQUIRE(wheel.size() == 2);
+
+    wheel.unwatch(b);
+    wheel.advance(3);
+    REQUIRE(a.expired.empty());
+    REQUIRE(b.expired.empty());
+    wheel.advance(4);
+    REQUIRE(a.expired == std::vector<std::uint64_t>{2});
+    REQUIRE(b.expired.empty());
+    REQUIRE(wheel.empty());
+}
+
+TEST_CASE("keep_alive_manager: a pending check keeps the manager alive") {
+    using namespace std::chrono_literals;
+    using manager_type = mqtt5::keep_alive_manager<boost::asio::io_context::executor_type>;
+    boost::asio::io_context io;
+    auto manager = std::make_shared<manager_type>(io.get_executor(), 10ms);
+    std::weak_ptr<manager_type> weak = manager;
+    watch w;
+    manager->watch(w, 20ms);
+
+    // The last owner is gone, the manager lives until its executor is done with it
+    manager.reset();
+    REQUIRE_FALSE(weak.expired());
+    const auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (w.expired.empty() && std::chrono::steady_clock::now() < deadline) {
+        io.run_one_for(10ms);
+    }
+    REQUIRE(w.expired == std::vector<std::uint64_t>{1});
+    io.run();
+    REQUIRE(weak.expired());
+}
+
+TEST_CASE("keep_alive_manager: a client watches its connection with the manager") {
+    using namespace std::chrono_literals;
+    using client_type = mqtt5::client<boost::asio::ip::tcp::socket>;
+    boost::asio::io_context io;
+    client_peer peer(io);
+    auto manager =
+        std::make_shared<mqtt5::keep_alive_manager<client_type::executor_type>>(io.get_executor());
+    client_type client(io.get_executor());
+    client.set_keep_alive_manager(manager);
+
+    mqtt5::connect_options opts;
+    opts.keep_alive = std::chrono::duration<std::uint16_t>{60};
+    bool connected = false;
+    p0443_v2::submit(client.supervisor("127.0.0.1", peer.port(), opts),
+                     connect_receiver{&connected});
+    REQUIRE(peer.accept());
+    REQUIRE(peer.receive_as<mqtt5::protocol::connect>());
+    peer.send(mqtt5::protocol::connack{});
+    REQUIRE(run_until(io, [&] { return connected; }));
+    REQUIRE(manager->size() == 1);
+
+    // Unwatched when the closed socket is noticed
+    client.close();
+    REQUIRE(run_until(io, [&] { return manager->size() == 0; }));
+}
@@ -0,0 +1,146 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include <mqtt5/mapped_session_store.hpp>
+
+#include <doctest/doctest.h>
+
+#include <filesystem>
+#include <string>
+
+namespace
+{
+std::string journal_path(const char *name) {
+    auto path = std::filesystem::temp_directory_path() / name;
+    std::filesystem::remove(path);
+    return path.string();
+}
+
+mqtt5::protocol::publish make_publish(std::uint16_t id, mqtt5::quality_of_service qos) {
+    mqtt5::protocol::publish retval;
+    retval.topic = "a/" + std::to_string(id);
+    retval.packet_identifier = id;
+    retval.set_quality_of_service(qos);
+    retval.set_payload(std::string("payload"));
+    return retval;
+}
+} // namespace
+
+TEST_CASE("mapped_session_store: recovers live state after reopening") {
+    using namespace mqtt5::literals;
+    auto path = journal_path("mqtt5-session-recover.journal");
+    {
+        mqtt5::mapped_session_store store(path, 4096);
+        store.publish_sent(make_publish(1, 1_qos));
+        store.publish_sent(make_publish(2, 2_qos));
+        store.publish_sent(make_publish(3, 2_qos));
+        store.publish_completed(1);
+        store.publish_released(3);
+        store.publish_received(make_publish(7, 2_qos));
+        store.publish_received(make_publish(8, 2_qos));
+        store.receive_completed(7);
+    }
+
+    mqtt5::mapped_session_store store(path, 4096);
+    auto session = store.recover();
+    REQUIRE(session.outgoing.size() == 2);
+    REQUIRE(session.outgoing[0].packet_identifier == 2);
+    REQUIRE(session.outgoing[0].topic == "a/2");
+    REQUIRE(session.outgoing[0].quality_of_service() == 2_qos);
+    REQUIRE(session.outgoing[1].packet_identifier == 3);
+    REQUIRE(session.released == std::vector<std::uint16_t>{3});
+    REQUIRE(session.incoming.size() == 1);
+    REQUIRE(session.incoming[0].packet_identifier == 8);
+    REQUIRE(session.incoming[0].payload.size() == 7);
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("mapped_session_store: clear discards everything") {
+    using namespace mqtt5::literals;
+    auto path = journal_path("mqtt5-session-clear.journal");
+    {
+        mqtt5::mapped_session_store store(path, 4096);
+        store.publish_sent(make_publish(1, 1_qos));
+        store.clear();
+        store.publish_sent(make_publish(2, 1_qos));
+    }
+    mqtt5::mapped_session_store store(path, 4096);
+    auto session = store.recover();
+    REQUIRE(session.outgoing.size() == 1);
+    REQUIRE(session.outgoing[0].packet_identifier == 2);
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("mapped_session_store: compacts when full") {
+    using namespace mqtt5::literals;
+    auto path = journal_path("mqtt5-session-compact.journal");
+    {
+        mqtt5::mapped_session_store store(path, 1024);
+        for (std::uint16_t i = 1; i < 2000; i++) {
+            store.publish_sent(make_publish(i, 2_qos));
+            if (i % 10 != 0) {
+                store.publish_completed(i);
+            }
+            else {
+                store.publish_released(i);
+            }
+        }
+    }
+    mqtt5::mapped_session_store store(path, 1024);
+    auto session = store.recover();
+    REQUIRE(session.outgoing.size() == 199);
+    REQUIRE(session.released.size() == 199);
+    REQUIRE(session.outgoing.front().packet_identifier == 10);
+    REQUIRE(session.outgoing.back().packet_identifier == 1990);
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("mapped_session_store: compaction keeps the live state") {
+    using namespace mqtt5::literals;
+    auto path = journal_path("mqtt5-session-roundtrip.journal");
+    std::vector<std::uint16_t> outgoing, released, incoming;
+    {
+        mqtt5::mapped_session_store store(path, 1024);
+        store.publish_sent(make_publish(1, 2_qos));
+        store.publish_released(1);
+        store.publish_received(make_publish(2, 2_qos));
+        // Completed flows, several times what fits in the journal, so it is compacted
+        for (std::uint16_t i = 3; i < 200; i++) {
+            store.publish_sent(make_publish(i, 1_qos));
+            store.publish_completed(i);
+        }
+        REQUIRE_FALSE(std::filesystem::exists(path + ".compact"));
+        store.publish_sent(make_publish(200, 1_qos));
+
+        auto session = store.recover();
+        for (auto &publish : session.outgoing) {
+            outgoing.push_back(publish.packet_identifier);
+        }
+        released = session.released;
+        for (auto &publish : session.incoming) {
+            incoming.push_back(publish.packet_identifier);
+        }
+        REQUIRE(outgoing == std::vector<std::uint16_t>{1, 200});
+        REQUIRE(released == std::vector<std::uint16_t>{1});
+        REQUIRE(incoming == std::vector<std::uint16_t>{2});
+    }
+
+    // What was appended after compaction went to the file that replaced the journal
+    mqtt5::mapped_session_store store(path, 1024);
+    auto session = store.recover();
+    REQUIRE(session.outgoing.size() == 2);
+    REQUIRE(session.outgoing[0].packet_identifier == 1);
+    REQUIRE(session.outgoing[0].topic == "a/1");
+    REQUIRE(session.outgoing[1].packet_identifier == 200);
+    REQUIRE(session.released == released);
+    REQUIRE(session.incoming.size() == 1);
+    REQUIRE(session.incoming[0].packet_identifier == 2);
+    REQUIRE(session.incoming[0].payload.size() == 7);
+
+    std::filesystem::remove(path);
+}
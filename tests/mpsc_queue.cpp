@@ -0,0 +1,57 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include <mqtt5/detail/mpsc_queue.hpp>
+
+#include <doctest/doctest.h>
+
+#include <thread>
+#include <vector>
+
+TEST_CASE("mpsc_queue: consumed in push order") {
+    mqtt5::detail::mpsc_queue<int> queue;
+    REQUIRE(queue.empty());
+    REQUIRE(queue.push(1));
+    REQUIRE_FALSE(queue.push(2));
+    REQUIRE_FALSE(queue.push(3));
+
+    std::vector<int> consumed;
+    REQUIRE(queue.consume_all([&](int v) { consumed.push_back(v); }) == 3);
+    REQUIRE(consumed == std::vector<int>{1, 2, 3});
+    REQUIRE(queue.empty());
+
+    // Empty again, next push must wake the consumer
+    REQUIRE(queue.push(4));
+}
+
+TEST_CASE("mpsc_queue: multiple producers") {
+    mqtt5::detail::mpsc_queue<int> queue;
+    constexpr int per_thread = 10000;
+    std::vector<std::thread> producers;
+    for (int t = 0; t < 4; t++) {
+        producers.emplace_back([&queue, t] {
+            for (int i = 0; i < per_thread; i++) {
+                queue.push(t * per_thread + i);
+            }
+        });
+    }
+
+    std::vector<int> last_seen(4, -1);
+    std::size_t total = 0;
+    bool ordered = true;
+    auto consume = [&](int v) {
+        auto &last = last_seen[v / per_thread];
+        ordered = ordered && v > last;
+        last = v;
+    };
+    while (total < 4 * per_thread) {
+        total += queue.consume_all(consume);
+    }
+    for (auto &p : producers) {
+        p.join();
+    }
+    REQUIRE(ordered);
+    REQUIRE(queue.empty());
+}
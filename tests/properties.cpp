@@ -28,4 +28,13 @@ TEST_CASE("property: string deserializer")
     REQUIRE(prop.identifier == 0x3);
     REQUIRE(prop.value_.index() == 4);
     REQUIRE(prop.value_as<std::string>() == "hello");
-}
\ No newline at end of file
+}
+
+TEST_CASE("property: variable length integer deserializer")
+{
+    std::vector<std::uint8_t> data{0x0b, 0xac, 0x02};
+    auto prop = mqtt5::protocol::property::deserialize(mqtt5::transport::buffer_data_fetcher(data));
+    REQUIRE(prop.identifier == 0x0b);
+    REQUIRE(prop.value_.index() == 3);
+    REQUIRE(prop.value_as<std::uint32_t>() == 300);
+}
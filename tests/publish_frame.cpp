@@ -0,0 +1,123 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include <mqtt5/protocol/publish_frame.hpp>
+
+#include <doctest/doctest.h>
+
+#include "vector_serialize.hpp"
+
+using namespace mqtt5::literals;
+
+namespace
+{
+std::vector<std::uint8_t> frame_serialize(const mqtt5::protocol::publish_frame &frame,
+                                          mqtt5::quality_of_service qos, bool retain,
+                                          std::uint16_t packet_identifier) {
+    std::vector<std::uint8_t> retval;
+    frame.serialize(qos, retain, false, packet_identifier,
+                    [&](std::uint8_t b) { retval.push_back(b); });
+    return retval;
+}
+
+mqtt5::protocol::publish make_publish() {
+    mqtt5::protocol::publish retval;
+    retval.topic = "sensors/1/temp";
+    retval.set_payload(std::string("21.5"));
+    retval.properties.content_type = "text/plain";
+    return retval;
+}
+} // namespace
+
+TEST_CASE("publish_frame: matches publish serialization") {
+    auto publish = make_publish();
+    publish.set_quality_of_service(1_qos);
+    publish.set_retain(true);
+    mqtt5::protocol::publish_frame frame(publish);
+    REQUIRE(frame.quality_of_service() == 1_qos);
+    REQUIRE(frame.retain_flag());
+
+    publish.packet_identifier = 1234;
+    REQUIRE(frame_serialize(frame, 1_qos, true, 1234) == vector_serialize(publish));
+
+    publish.set_quality_of_service(0_qos);
+    publish.set_retain(false);
+    publish.packet_identifier = 0;
+    REQUIRE(frame_serialize(frame, 0_qos, false, 0) == vector_serialize(publish));
+}
+
+TEST_CASE("publish_frame: topic alias is not encoded") {
+    auto publish = make_publish();
+    mqtt5::protocol::publish_frame plain(publish);
+    publish.properties.topic_alias = 3;
+    mqtt5::protocol::publish_frame aliased(publish);
+    REQUIRE(*plain.data() == *aliased.data());
+}
+
+TEST_CASE("publish_frame: long remaining length") {
+    auto publish = make_publish();
+    publish.payload.assign(200, 'x');
+    publish.set_quality_of_service(2_qos);
+    publish.packet_identifier = 7;
+    mqtt5::protocol::publish_frame frame(publish);
+
+    const auto bytes = frame_serialize(frame, 2_qos, false, 7);
+    REQUIRE(bytes == vector_serialize(publish));
+    // Two byte remaining length
+    REQUIRE((bytes[1] & 0x80) != 0);
+    REQUIRE(bytes.size() == 3 + frame.size() + 2);
+}
+
+TEST_CASE("publish_frame: remaining message expiry interval") {
+    auto publish = make_publish();
+    publish.properties.message_expiry_interval = std::chrono::seconds{100000};
+    mqtt5::protocol::publish_frame frame(publish);
+    REQUIRE(frame.message_expiry_interval().count() == 100000);
+    REQUIRE(frame.expiry_offset() != 0);
+
+    auto bytes = frame_serialize(frame, 0_qos, false, 0);
+    mqtt5::protocol::publish decoded;
+    // QoS 0 and a one byte remaining length
+    auto body = nonstd::span<const std::uint8_t>(bytes).subspan(2);
+    decoded.deserialize(mqtt5::transport::span_byte_data_fetcher_t{body});
+    REQUIRE(decoded.properties.message_expiry_interval.count() == 100000);
+    REQUIRE(decoded.properties.content_type == "text/plain");
+    REQUIRE(decoded.payload == publish.payload);
+
+    std::vector<std::uint8_t> remaining;
+    frame.serialize(0_qos, false, false, 0, std::chrono::duration<std::uint32_t>{70000}, 0,
+                    [&](std::uint8_t b) { remaining.push_back(b); });
+    publish.properties.message_expiry_interval = std::chrono::seconds{70000};
+    REQUIRE(remaining.size() == bytes.size());
+    REQUIRE(remaining == frame_serialize(mqtt5::protocol::publish_frame(publish), 0_qos, false, 0));
+}
+
+TEST_CASE("publish_frame: subscription identifier is written per receiver") {
+    auto publish = make_publish();
+    // The publisher's own identifier must not reach the receivers
+    publish.properties.subscription_identifier = 99;
+    publish.properties.message_expiry_interval = std::chrono::seconds{100};
+    mqtt5::protocol::publish_frame frame(publish);
+
+    auto decode = [&](std::uint32_t identifier) {
+        std::vector<std::uint8_t> bytes;
+        frame.serialize(0_qos, false, false, 0, std::chrono::duration<std::uint32_t>{60},
+                        identifier, [&](std::uint8_t b) { bytes.push_back(b); });
+        // QoS 0 and a one byte remaining length
+        REQUIRE(bytes[1] == bytes.size() - 2);
+        REQUIRE(bytes.size() == 2 + frame.size() + frame.subscription_identifier_size(identifier));
+        mqtt5::protocol::publish decoded;
+        auto body = nonstd::span<const std::uint8_t>(bytes).subspan(2);
+        decoded.deserialize(mqtt5::transport::span_byte_data_fetcher_t{body});
+        REQUIRE(decoded.properties.message_expiry_interval.count() == 60);
+        REQUIRE(decoded.properties.content_type == "text/plain");
+        REQUIRE(decoded.payload == publish.payload);
+        return decoded.properties.subscription_identifier;
+    };
+    REQUIRE(decode(0) == 0);
+    REQUIRE(decode(7) == 7);
+    // Two byte identifier
+    REQUIRE(decode(300) == 300);
+}
@@ -0,0 +1,76 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include <mqtt5/retained_store.hpp>
+
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace
+{
+mqtt5::protocol::publish make_publish(const std::string &topic, const std::string &payload) {
+    mqtt5::protocol::publish retval;
+    retval.topic = topic;
+    retval.set_payload(payload);
+    retval.set_retain(true);
+    return retval;
+}
+
+std::vector<std::string> matching(mqtt5::retained_store &store, const char *filter) {
+    std::vector<std::string> retval;
+    store.for_each_match(filter, [&](const mqtt5::retained_store::message_ptr &message) {
+        retval.push_back(message->topic);
+    });
+    std::sort(retval.begin(), retval.end());
+    return retval;
+}
+} // namespace
+
+TEST_CASE("retained_store: store, replace and find") {
+    mqtt5::retained_store store;
+    store.store(make_publish("a/b", "1"));
+    store.store(make_publish("a/b", "2"));
+    REQUIRE(store.size() == 1);
+    auto message = store.find("a/b");
+    REQUIRE(message);
+    REQUIRE(message->payload == std::vector<std::uint8_t>{'2'});
+    REQUIRE(message->retain_flag());
+    REQUIRE_FALSE(store.find("a"));
+}
+
+TEST_CASE("retained_store: empty payload erases") {
+    mqtt5::retained_store store;
+    store.store(make_publish("a/b/c", "1"));
+    store.store(make_publish("a", "1"));
+    store.store(make_publish("a/b/c", ""));
+    REQUIRE(store.size() == 1);
+    REQUIRE_FALSE(store.find("a/b/c"));
+    REQUIRE(store.erase("a"));
+    REQUIRE_FALSE(store.erase("a"));
+    REQUIRE(store.empty());
+}
+
+TEST_CASE("retained_store: wildcard lookup") {
+    mqtt5::retained_store store;
+    for (auto topic : {"sensors/1/temp", "sensors/2/temp", "sensors/2/humidity", "sensors",
+                       "plant/a/b/c", "$SYS/uptime"}) {
+        store.store(make_publish(topic, "x"));
+    }
+
+    REQUIRE(matching(store, "sensors/+/temp") ==
+            std::vector<std::string>{"sensors/1/temp", "sensors/2/temp"});
+    REQUIRE(matching(store, "sensors/#") ==
+            std::vector<std::string>{"sensors", "sensors/1/temp", "sensors/2/humidity",
+                                     "sensors/2/temp"});
+    REQUIRE(matching(store, "plant/#") == std::vector<std::string>{"plant/a/b/c"});
+    REQUIRE(matching(store, "+/+/+") ==
+            std::vector<std::string>{"sensors/1/temp", "sensors/2/humidity", "sensors/2/temp"});
+    REQUIRE(matching(store, "#").size() == 5);
+    REQUIRE(matching(store, "$SYS/#") == std::vector<std::string>{"$SYS/uptime"});
+    REQUIRE(matching(store, "sensors/3/temp").empty());
+}
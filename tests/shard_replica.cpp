@@ -0,0 +1,174 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include <mqtt5/detail/mpsc_queue.hpp>
+#include <mqtt5/detail/shard_replica.hpp>
+
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <thread>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+namespace
+{
+using mqtt5::detail::shard_subscriber;
+using mqtt5::detail::shard_target;
+using targets_type = std::vector<std::vector<shard_target>>;
+
+shard_subscriber make_subscriber(std::uint32_t shard, std::uint64_t session) {
+    return shard_subscriber{shard, session, std::make_shared<std::atomic<std::size_t>>(0)};
+}
+
+std::vector<std::uint64_t> sessions(const std::vector<shard_target> &targets) {
+    std::vector<std::uint64_t> retval;
+    for (auto &t : targets) {
+        retval.push_back(t.session);
+    }
+    std::sort(retval.begin(), retval.end());
+    return retval;
+}
+
+mqtt5::protocol::publish make_publish(const std::string &topic, const std::string &payload) {
+    mqtt5::protocol::publish retval;
+    retval.topic = topic;
+    retval.set_payload(payload);
+    retval.set_retain(true);
+    return retval;
+}
+} // namespace
+
+TEST_CASE("shard_replica: subscriptions of other shards arrive as mails") {
+    mqtt5::detail::shard_replica first(0), second(1);
+    targets_type targets(2);
+
+    mqtt5::detail::subscribe_mail subscribe{"sensors/+", make_subscriber(0, 7), 1};
+    REQUIRE(first.index().insert(subscribe.filter, subscribe.subscriber, subscribe.options));
+    second.route("sensors/1", 9, mqtt5::shared_subscription_policy::round_robin, targets);
+    REQUIRE(targets[0].empty());
+
+    second.apply(subscribe);
+    second.route("sensors/1", 9, mqtt5::shared_subscription_policy::round_robin, targets);
+    REQUIRE(sessions(targets[0]) == std::vector<std::uint64_t>{7});
+    REQUIRE(targets[0].front().options == 1);
+    REQUIRE(targets[1].empty());
+
+    mqtt5::detail::unsubscribe_mail unsubscribe{"sensors/+", make_subscriber(0, 7)};
+    second.apply(unsubscribe);
+    second.route("sensors/1", 9, mqtt5::shared_subscription_policy::round_robin, targets);
+    REQUIRE(targets[0].empty());
+    REQUIRE(second.index().empty());
+}
+
+TEST_CASE("shard_replica: no local only skips the sender") {
+    mqtt5::detail::shard_replica replica(1);
+    targets_type targets(2);
+    const std::uint8_t no_local = mqtt5::detail::subscription_no_local_flag;
+    REQUIRE(replica.index().insert("a", make_subscriber(1, 3), no_local));
+    REQUIRE(replica.index().insert("a", make_subscriber(0, 4), no_local));
+
+    replica.route("a", 3, mqtt5::shared_subscription_policy::round_robin, targets);
+    REQUIRE(sessions(targets[0]) == std::vector<std::uint64_t>{4});
+    REQUIRE(targets[1].empty());
+
+    replica.route("a", 5, mqtt5::shared_subscription_policy::round_robin, targets);
+    REQUIRE(sessions(targets[0]) == std::vector<std::uint64_t>{4});
+    REQUIRE(sessions(targets[1]) == std::vector<std::uint64_t>{3});
+}
+
+TEST_CASE("shard_replica: retained messages are replicated") {
+    mqtt5::detail::shard_replica first(0), second(1);
+
+    auto store = first.retain(make_publish("a/b", "value"), 1);
+    REQUIRE(first.retained().find("a/b"));
+    REQUIRE_FALSE(second.retained().find("a/b"));
+    second.apply(store);
+    auto message = second.retained().find("a/b");
+    REQUIRE(message);
+    REQUIRE(message == first.retained().find("a/b"));
+
+    auto erase = first.retain(make_publish("a/b", ""), 2);
+    REQUIRE_FALSE(first.retained().find("a/b"));
+    second.apply(erase);
+    REQUIRE_FALSE(second.retained().find("a/b"));
+}
+
+TEST_CASE("shard_replica: the last retained change wins") {
+    mqtt5::detail::shard_replica first(0), second(1);
+
+    // Both shards retain the topic before the other's mail arrives
+    auto later = first.retain(make_publish("a/b", "first"), 2);
+    auto earlier = second.retain(make_publish("a/b", "second"), 1);
+    first.apply(earlier);
+    second.apply(later);
+    REQUIRE(first.retained().find("a/b")->payload == second.retained().find("a/b")->payload);
+    REQUIRE(first.retained().find("a/b") == second.retained().find("a/b"));
+    const std::vector<std::uint8_t> first_payload{'f', 'i', 'r', 's', 't'};
+    REQUIRE(first.retained().find("a/b")->payload == first_payload);
+
+    // An erase that lost the race leaves the message too
+    auto erase = second.retain(make_publish("a/b", ""), 3);
+    auto store = first.retain(make_publish("a/b", "again"), 4);
+    REQUIRE(first.retained().find("a/b"));
+    REQUIRE_FALSE(second.retained().find("a/b"));
+    first.apply(erase);
+    second.apply(store);
+    REQUIRE(second.retained().find("a/b"));
+    REQUIRE(first.retained().find("a/b") == second.retained().find("a/b"));
+}
+
+TEST_CASE("shard_replica: mailbox from several shards") {
+    mqtt5::detail::mpsc_queue<mqtt5::detail::shard_mail> mailbox;
+    mqtt5::detail::shard_replica replica(0);
+    constexpr std::uint32_t shards = 4;
+    constexpr std::uint64_t per_shard = 1000;
+
+    std::vector<std::thread> senders;
+    for (std::uint32_t s = 1; s <= shards; s++) {
+        senders.emplace_back([&mailbox, s] {
+            for (std::uint64_t i = 0; i < per_shard; i++) {
+                const auto session = s * per_shard + i;
+                mailbox.push(mqtt5::detail::subscribe_mail{"t", make_subscriber(s, session), 0});
+                if (i % 2) {
+                    mailbox.push(mqtt5::detail::unsubscribe_mail{"t", make_subscriber(s, session)});
+                }
+            }
+            mailbox.push(mqtt5::detail::close_mail{s});
+        });
+    }
+
+    std::uint32_t closed = 0;
+    while (closed < shards) {
+        mailbox.consume_all([&](mqtt5::detail::shard_mail &&item) {
+            std::visit(
+                [&](auto &m) {
+                    using mail_type = std::decay_t<decltype(m)>;
+                    if constexpr (std::is_same_v<mail_type, mqtt5::detail::close_mail>) {
+                        closed++;
+                    }
+                    else if constexpr (!std::is_same_v<mail_type, mqtt5::detail::deliver_mail>) {
+                        replica.apply(m);
+                    }
+                },
+                item);
+        });
+    }
+    for (auto &s : senders) {
+        s.join();
+    }
+
+    // Every unsubscribe was applied after the subscribe it belongs to
+    REQUIRE(replica.index().size() == shards * per_shard / 2);
+    targets_type targets(shards + 1);
+    replica.route("t", 0, mqtt5::shared_subscription_policy::round_robin, targets);
+    REQUIRE(targets[0].empty());
+    for (std::uint32_t s = 1; s <= shards; s++) {
+        REQUIRE(targets[s].size() == per_shard / 2);
+        REQUIRE(std::all_of(targets[s].begin(), targets[s].end(),
+                            [](const shard_target &t) { return t.session % 2 == 0; }));
+    }
+}
@@ -0,0 +1,203 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include <mqtt5/client.hpp>
+#include <mqtt5/sharded_broker.hpp>
+
+#include <doctest/doctest.h>
+
+#include "client_peer.hpp"
+
+#include <optional>
+#include <string>
+
+namespace
+{
+using client_type = mqtt5::client<boost::asio::ip::tcp::socket>;
+using broker_type = mqtt5::sharded_broker<boost::asio::ip::tcp::socket>;
+
+struct result
+{
+    bool value = false;
+    bool done = false;
+    std::exception_ptr error;
+    std::optional<mqtt5::protocol::publish> publish;
+
+    bool completed() const {
+        return value || done || error;
+    }
+};
+
+struct recording_receiver
+{
+    result *result_;
+
+    void set_value(mqtt5::protocol::publish publish) {
+        result_->value = true;
+        result_->publish.emplace(std::move(publish));
+    }
+    template <class... Values>
+    void set_value(Values &&...) {
+        result_->value = true;
+    }
+    void set_done() {
+        result_->done = true;
+    }
+    void set_error(std::exception_ptr e) {
+        result_->error = std::move(e);
+    }
+};
+
+/**
+ * Runs a sender to completion on io.
+ */
+template <class Sender>
+result run(boost::asio::io_context &io, Sender &&sender) {
+    result retval;
+    p0443_v2::submit(std::forward<Sender>(sender), recording_receiver{&retval});
+    run_until(io, [&] { return retval.completed(); });
+    return retval;
+}
+
+bool connect(boost::asio::io_context &io, client_type &client, broker_type &broker,
+             std::string client_id) {
+    const auto port = std::to_string(broker.local_endpoint().port());
+    if (!run(io, client.socket_connector("127.0.0.1", port)).value) {
+        return false;
+    }
+    mqtt5::connect_options opts;
+    opts.client_id = std::move(client_id);
+    return run(io, client.handshaker(std::move(opts))).value;
+}
+
+broker_type make_broker(boost::asio::io_context &io) {
+    return broker_type({io.get_executor(), io.get_executor()},
+                       {boost::asio::ip::address_v4::loopback(), 0});
+}
+} // namespace
+
+TEST_CASE("sharded_broker: publishes reach subscribers on other shards") {
+    using namespace mqtt5::literals;
+    boost::asio::io_context io;
+    auto broker = make_broker(io);
+    broker.start();
+
+    // Connections are assigned to the shards in turn
+    client_type subscriber(io.get_executor()), publisher(io.get_executor());
+    REQUIRE(connect(io, subscriber, broker, "subscriber"));
+    REQUIRE(connect(io, publisher, broker, "publisher"));
+    REQUIRE(run(io, subscriber.subscriber("sensors/+", 1_qos)).value);
+
+    result received;
+    p0443_v2::submit(subscriber.filtered_subscriber("sensors/+"), recording_receiver{&received});
+    REQUIRE(run(io, publisher.publisher("sensors/1", std::string("21.5"), 1_qos)).value);
+    REQUIRE(run_until(io, [&] { return received.completed(); }));
+    REQUIRE(received.publish);
+    REQUIRE(received.publish->topic == "sensors/1");
+
+    subscriber.close();
+    publisher.close();
+    broker.close();
+    io.restart();
+    io.poll();
+}
+
+TEST_CASE("sharded_broker: a client id taken over on another shard closes the old session") {
+    boost::asio::io_context io;
+    auto broker = make_broker(io);
+    broker.start();
+
+    client_type first(io.get_executor()), second(io.get_executor());
+    REQUIRE(connect(io, first, broker, "client"));
+    REQUIRE(connect(io, second, broker, "client"));
+    // The close is sent to the first session's shard through its mailbox
+    REQUIRE(run_until(io, [&] { return !first.is_connected(); }));
+    REQUIRE(second.is_connected());
+
+    second.close();
+    broker.close();
+    io.restart();
+    io.poll();
+}
+
+TEST_CASE("sharded_broker: retained messages are replicated to every shard") {
+    using namespace mqtt5::literals;
+    boost::asio::io_context io;
+    auto broker = make_broker(io);
+    broker.start();
+
+    client_type publisher(io.get_executor()), subscriber(io.get_executor());
+    REQUIRE(connect(io, publisher, broker, "publisher"));
+    REQUIRE(connect(io, subscriber, broker, "subscriber"));
+    REQUIRE(run(io, publisher.publisher("status", std::string("old"), 1_qos,
+                                        mqtt5::publish_options::retain(true)))
+                .value);
+    REQUIRE(run(io, publisher.publisher("status", std::string("online"), 1_qos,
+                                        mqtt5::publish_options::retain(true)))
+                .value);
+
+    // Subscribed on the other shard, which has the latest message in its replica
+    result received;
+    p0443_v2::submit(subscriber.filtered_subscriber("status"), recording_receiver{&received});
+    REQUIRE(run(io, subscriber.subscriber("status", 1_qos)).value);
+    REQUIRE(run_until(io, [&] { return received.completed(); }));
+    REQUIRE(received.publish);
+    REQUIRE(received.publish->retain_flag());
+    REQUIRE(received.publish->payload == std::vector<std::uint8_t>{'o', 'n', 'l', 'i', 'n', 'e'});
+
+    publisher.close();
+    subscriber.close();
+    broker.close();
+    io.restart();
+    io.poll();
+}
+
+TEST_CASE("sharded_broker: receivers get the identifier of their own subscription") {
+    using namespace mqtt5::literals;
+    boost::asio::io_context io;
+    auto broker = make_broker(io);
+    broker.start();
+
+    client_type identified(io.get_executor()), publisher(io.get_executor()),
+        plain(io.get_executor());
+    REQUIRE(connect(io, identified, broker, "identified"));
+    REQUIRE(connect(io, publisher, broker, "publisher"));
+    REQUIRE(connect(io, plain, broker, "plain"));
+    mqtt5::single_subscription subscription;
+    subscription.topic = "ids/+";
+    subscription.quality_of_service = 1_qos;
+    REQUIRE(run(io, identified.subscriber({subscription},
+                                          [](mqtt5::protocol::subscribe &subscribe) {
+                                              subscribe.properties.subscription_identifier = 7;
+                                          }))
+                .value);
+    REQUIRE(run(io, plain.subscriber("ids/+", 1_qos)).value);
+
+    result identified_received, plain_received;
+    p0443_v2::submit(identified.filtered_subscriber("ids/+"),
+                     recording_receiver{&identified_received});
+    p0443_v2::submit(plain.filtered_subscriber("ids/+"), recording_receiver{&plain_received});
+    // Large enough to be written from the shared frame
+    REQUIRE(run(io, publisher.publisher("ids/1", std::string(300, 'x'), 1_qos,
+                                        [](mqtt5::protocol::publish &publish) {
+                                            publish.properties.subscription_identifier = 99;
+                                        }))
+                .value);
+    REQUIRE(run_until(io, [&] {
+        return identified_received.completed() && plain_received.completed();
+    }));
+    REQUIRE(identified_received.publish);
+    REQUIRE(identified_received.publish->properties.subscription_identifier == 7);
+    REQUIRE(identified_received.publish->payload.size() == 300);
+    REQUIRE(plain_received.publish);
+    REQUIRE(plain_received.publish->properties.subscription_identifier == 0);
+
+    identified.close();
+    publisher.close();
+    plain.close();
+    broker.close();
+    io.restart();
+    io.poll();
+}
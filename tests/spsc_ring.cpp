@@ -0,0 +1,91 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include <mqtt5/detail/spsc_ring.hpp>
+#include <mqtt5/detail/worker_channel.hpp>
+
+#include <doctest/doctest.h>
+
+#include <thread>
+#include <vector>
+
+TEST_CASE("spsc_ring: bounded push and pop") {
+    mqtt5::detail::spsc_ring<int> ring(3);
+    REQUIRE(ring.capacity() == 4);
+    REQUIRE(ring.empty());
+
+    for (int i = 0; i < 4; i++) {
+        REQUIRE(ring.try_push(i));
+    }
+    int extra = 4;
+    REQUIRE_FALSE(ring.try_push(extra));
+    REQUIRE(ring.size() == 4);
+
+    REQUIRE(*ring.try_pop() == 0);
+    REQUIRE(ring.try_push(extra));
+
+    std::vector<int> consumed;
+    REQUIRE(ring.consume_all([&](int v) { consumed.push_back(v); }) == 4);
+    REQUIRE(consumed == std::vector<int>{1, 2, 3, 4});
+    REQUIRE(!ring.try_pop());
+}
+
+TEST_CASE("spsc_ring: producer and consumer threads") {
+    mqtt5::detail::spsc_ring<int> ring(64);
+    constexpr int count = 100000;
+    std::thread producer([&ring] {
+        for (int i = 0; i < count; i++) {
+            int value = i;
+            while (!ring.try_push(value)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    int expected = 0;
+    bool ordered = true;
+    while (expected < count) {
+        ring.consume_all([&](int v) {
+            ordered = ordered && v == expected;
+            expected++;
+        });
+    }
+    producer.join();
+    REQUIRE(ordered);
+    REQUIRE(ring.empty());
+}
+
+TEST_CASE("worker_channel: backlog is flushed after the consumer makes room") {
+    using mqtt5::detail::held_ack;
+    auto state = std::make_shared<mqtt5::detail::worker_channel_state>("a/#", 1);
+    int wakeups = 0;
+    state->wake_ = [&] { wakeups++; };
+    mqtt5::worker_channel channel(state);
+
+    mqtt5::protocol::publish pub;
+    pub.topic = "a/1";
+    REQUIRE(state->offer(pub));
+
+    auto ack = std::make_shared<held_ack>(held_ack{held_ack::kind_type::puback, 1, 1});
+    mqtt5::protocol::publish second;
+    second.topic = "a/2";
+    REQUIRE_FALSE(state->offer(second));
+    state->backlog_.push_back({second, ack});
+
+    std::vector<std::uint16_t> accepted;
+    auto on_accepted = [&](held_ack &a) { accepted.push_back(a.packet_identifier_); };
+    state->flush_backlog(on_accepted);
+    REQUIRE(accepted.empty());
+    REQUIRE(state->backlog_.size() == 1);
+
+    REQUIRE(channel.try_pop()->topic == "a/1");
+    REQUIRE(wakeups == 1);
+
+    state->flush_backlog(on_accepted);
+    REQUIRE(accepted == std::vector<std::uint16_t>{1});
+    REQUIRE(state->backlog_.empty());
+    REQUIRE(channel.try_pop()->topic == "a/2");
+    REQUIRE(wakeups == 1);
+}
@@ -0,0 +1,112 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include <mqtt5/detail/subscription_index.hpp>
+
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <map>
+
+namespace
+{
+std::vector<int> matching(mqtt5::detail::subscription_index<int> &index, const char *topic) {
+    std::vector<int> retval;
+    index.match(mqtt5::split_topic_levels(topic),
+                [&](const auto &subscription) { retval.push_back(subscription.subscriber); });
+    std::sort(retval.begin(), retval.end());
+    return retval;
+}
+} // namespace
+
+TEST_CASE("subscription_index: wildcards") {
+    mqtt5::detail::subscription_index<int> index;
+    REQUIRE(index.insert("sensors/+/temp", 1, 0));
+    REQUIRE(index.insert("sensors/#", 2, 0));
+    REQUIRE(index.insert("sensors/1/temp", 3, 0));
+    REQUIRE(index.insert("#", 4, 0));
+    REQUIRE(index.insert("+/+", 5, 0));
+
+    REQUIRE(matching(index, "sensors/1/temp") == std::vector<int>{1, 2, 3, 4});
+    REQUIRE(matching(index, "sensors/2/temp") == std::vector<int>{1, 2, 4});
+    REQUIRE(matching(index, "sensors") == std::vector<int>{2, 4});
+    REQUIRE(matching(index, "sensors/x") == std::vector<int>{2, 4, 5});
+    REQUIRE(matching(index, "other/x/y") == std::vector<int>{4});
+    REQUIRE(matching(index, "$SYS/x").empty());
+    REQUIRE(index.size() == 5);
+}
+
+TEST_CASE("subscription_index: invalid filters are rejected") {
+    mqtt5::detail::subscription_index<int> index;
+    REQUIRE_FALSE(index.insert("", 1, 0));
+    REQUIRE_FALSE(index.insert("a/#/b", 1, 0));
+    REQUIRE_FALSE(index.insert("a/b#", 1, 0));
+    REQUIRE_FALSE(index.insert("a+/b", 1, 0));
+    REQUIRE_FALSE(index.insert("$share/group", 1, 0));
+    REQUIRE_FALSE(index.insert("$share//a", 1, 0));
+    REQUIRE(index.empty());
+}
+
+TEST_CASE("subscription_index: insert updates and erase prunes") {
+    mqtt5::detail::subscription_index<int> index;
+    bool existed = true;
+    REQUIRE(index.insert("a/b", 1, 1, &existed));
+    REQUIRE_FALSE(existed);
+    REQUIRE(index.insert("a/b", 1, 2, &existed));
+    REQUIRE(existed);
+    REQUIRE(index.size() == 1);
+
+    std::uint8_t options = 0;
+    index.match(mqtt5::split_topic_levels("a/b"),
+                [&](const auto &subscription) { options = subscription.options; });
+    REQUIRE(options == 2);
+
+    REQUIRE_FALSE(index.erase("a/b", 2));
+    REQUIRE(index.erase("a/b", 1));
+    REQUIRE_FALSE(index.erase("a/b", 1));
+    REQUIRE(index.empty());
+    REQUIRE(matching(index, "a/b").empty());
+}
+
+TEST_CASE("subscription_index: shared subscriptions take turns") {
+    mqtt5::detail::subscription_index<int> index;
+    REQUIRE(index.insert("$share/g/jobs/+", 1, 0));
+    REQUIRE(index.insert("$share/g/jobs/+", 2, 0));
+    REQUIRE(index.insert("$share/other/jobs/+", 3, 0));
+    REQUIRE(index.insert("jobs/#", 4, 0));
+
+    std::map<int, int> counts;
+    for (int i = 0; i < 10; i++) {
+        for (auto s : matching(index, "jobs/1")) {
+            counts[s]++;
+        }
+    }
+    REQUIRE(counts[1] == 5);
+    REQUIRE(counts[2] == 5);
+    REQUIRE(counts[3] == 10);
+    REQUIRE(counts[4] == 10);
+
+    REQUIRE(index.erase("$share/g/jobs/+", 1));
+    REQUIRE(matching(index, "jobs/1") == std::vector<int>{2, 3, 4});
+}
+
+TEST_CASE("subscription_index: least loaded shared member") {
+    mqtt5::detail::subscription_index<int> index;
+    index.insert("$share/g/a", 1, 0);
+    index.insert("$share/g/a", 2, 0);
+    index.insert("$share/g/a", 3, 0);
+    std::map<int, std::size_t> load{{1, 5}, {2, 1}, {3, 5}};
+
+    int picked = 0;
+    auto pick = [&] {
+        index.match(
+            mqtt5::split_topic_levels("a"), [&](const auto &s) { picked = s.subscriber; },
+            mqtt5::shared_subscription_policy::least_loaded, [&](int s) { return load[s]; });
+        return picked;
+    };
+    REQUIRE(pick() == 2);
+    load[2] = 10;
+    REQUIRE(pick() == 3);
+}
@@ -0,0 +1,252 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include <mqtt5/client.hpp>
+
+#include <doctest/doctest.h>
+
+#include "client_peer.hpp"
+
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace
+{
+using client_type = mqtt5::client<boost::asio::ip::tcp::socket>;
+using stream_type = mqtt5::subscription_stream<client_type>;
+
+struct connect_receiver
+{
+    bool *connected_;
+
+    void set_value() {
+        *connected_ = true;
+    }
+    void set_done() {
+    }
+    void set_error(std::exception_ptr) {
+    }
+};
+
+void connect_client(boost::asio::io_context &io, client_type &client, client_peer &peer) {
+    bool connected = false;
+    p0443_v2::submit(client.supervisor("127.0.0.1", peer.port(), {}),
+                     connect_receiver{&connected});
+    REQUIRE(peer.accept());
+    REQUIRE(peer.receive_as<mqtt5::protocol::connect>());
+    peer.send(mqtt5::protocol::connack{});
+    REQUIRE(run_until(io, [&] { return connected; }));
+}
+
+mqtt5::protocol::publish make_publish(std::string topic) {
+    mqtt5::protocol::publish retval;
+    retval.topic = std::move(topic);
+    return retval;
+}
+
+/**
+ * Records every batch a stream completes with.
+ */
+struct batch_receiver
+{
+    std::vector<std::vector<mqtt5::protocol::publish>> *batches_;
+    bool *done_ = nullptr;
+
+    void set_value(std::vector<mqtt5::protocol::publish> pubs) {
+        batches_->push_back(std::move(pubs));
+    }
+    void set_done() {
+        if (done_) {
+            *done_ = true;
+        }
+    }
+    void set_error(std::exception_ptr) {
+    }
+};
+
+/**
+ * Destroys a stream when the publish it waits for arrives.
+ */
+struct destroying_receiver
+{
+    std::optional<stream_type> *stream_;
+    bool *received_;
+
+    void set_value(mqtt5::protocol::publish) {
+        *received_ = true;
+        stream_->reset();
+    }
+    void set_done() {
+    }
+    void set_error(std::exception_ptr) {
+    }
+};
+
+/**
+ * Sends publishes to the client and runs it until all of them were dispatched.
+ */
+void deliver(boost::asio::io_context &io, client_type &client, client_peer &peer,
+             std::vector<std::string> topics) {
+    std::vector<mqtt5::protocol::control_packet> packets;
+    for (auto &topic : topics) {
+        packets.emplace_back(make_publish(std::move(topic)));
+    }
+    // Publishes are dispatched in order, the last one is seen after all others
+    packets.emplace_back(make_publish("sync"));
+    std::vector<std::vector<mqtt5::protocol::publish>> synced;
+    auto sync = client.stream_subscriber("sync");
+    p0443_v2::submit(sync.receive_many(1), batch_receiver{&synced});
+    peer.send(packets);
+    REQUIRE(run_until(io, [&] { return !synced.empty(); }));
+}
+} // namespace
+
+TEST_CASE("subscription_stream: buffers publishes between receives") {
+    boost::asio::io_context io;
+    client_peer peer(io);
+    client_type client(io.get_executor());
+    connect_client(io, client, peer);
+    auto stream = client.stream_subscriber("a/#", 16);
+
+    deliver(io, client, peer, {"a/1", "a/2", "a/3"});
+    std::vector<std::vector<mqtt5::protocol::publish>> batches;
+    p0443_v2::submit(stream.receive_many(2), batch_receiver{&batches});
+    REQUIRE(batches.size() == 1);
+    REQUIRE(batches[0].size() == 2);
+    REQUIRE(batches[0][0].topic == "a/1");
+    REQUIRE(batches[0][1].topic == "a/2");
+
+    p0443_v2::submit(stream.receive_many(8), batch_receiver{&batches});
+    REQUIRE(batches.size() == 2);
+    REQUIRE(batches[1].size() == 1);
+    REQUIRE(batches[1][0].topic == "a/3");
+    client.close();
+}
+
+TEST_CASE("subscription_stream: stays registered after a receive completes") {
+    boost::asio::io_context io;
+    client_peer peer(io);
+    client_type client(io.get_executor());
+    connect_client(io, client, peer);
+    auto stream = client.stream_subscriber("a/#", 16);
+
+    std::vector<std::vector<mqtt5::protocol::publish>> batches;
+    p0443_v2::submit(stream.receive_many(8), batch_receiver{&batches});
+    deliver(io, client, peer, {"a/1"});
+    REQUIRE(batches.size() == 1);
+
+    // Buffered without a pending receive, unlike a filtered subscriber
+    deliver(io, client, peer, {"a/2"});
+    p0443_v2::submit(stream.receive_many(8), batch_receiver{&batches});
+    REQUIRE(batches.size() == 2);
+    REQUIRE(batches[1][0].topic == "a/2");
+    client.close();
+}
+
+TEST_CASE("subscription_stream: drops oldest when full") {
+    boost::asio::io_context io;
+    client_peer peer(io);
+    client_type client(io.get_executor());
+    connect_client(io, client, peer);
+    auto stream = client.stream_subscriber("a/#", 2);
+
+    deliver(io, client, peer, {"a/1", "a/2", "a/3"});
+    REQUIRE(stream.dropped() == 1);
+
+    std::vector<std::vector<mqtt5::protocol::publish>> batches;
+    p0443_v2::submit(stream.receive_many(8), batch_receiver{&batches});
+    REQUIRE(batches.size() == 1);
+    REQUIRE(batches[0].size() == 2);
+    REQUIRE(batches[0][0].topic == "a/2");
+    REQUIRE(batches[0][1].topic == "a/3");
+    client.close();
+}
+
+TEST_CASE("subscription_stream: cancel completes pending receive with done") {
+    boost::asio::io_context io;
+    client_peer peer(io);
+    client_type client(io.get_executor());
+    connect_client(io, client, peer);
+
+    std::vector<std::vector<mqtt5::protocol::publish>> batches;
+    bool done = false;
+    {
+        auto stream = client.stream_subscriber("a/#", 16);
+        p0443_v2::submit(stream.receive_many(8), batch_receiver{&batches, &done});
+        stream.cancel();
+        REQUIRE(done);
+
+        done = false;
+        p0443_v2::submit(stream.receive_many(8), batch_receiver{&batches, &done});
+        REQUIRE(done);
+    }
+    // Nothing is buffered for the removed stream
+    deliver(io, client, peer, {"a/1"});
+    REQUIRE(batches.empty());
+    client.close();
+}
+
+TEST_CASE("subscription_stream: a stream destroyed before its deferred completion gets done") {
+    boost::asio::io_context io;
+    client_peer peer(io);
+    client_type client(io.get_executor());
+    connect_client(io, client, peer);
+    std::optional<stream_type> stream(client.stream_subscriber("a/#", 16));
+
+    std::vector<std::vector<mqtt5::protocol::publish>> batches;
+    bool done = false;
+    bool received = false;
+    p0443_v2::submit(stream->receive_many(8), batch_receiver{&batches, &done});
+    p0443_v2::submit(client.filtered_subscriber("b/1"), destroying_receiver{&stream, &received});
+    // a/1 is buffered for the stream, b/1 destroys it before the read buffer runs dry
+    peer.send({make_publish("a/1"), make_publish("b/1")});
+    REQUIRE(run_until(io, [&] { return received; }));
+    REQUIRE(done);
+    deliver(io, client, peer, {"a/2"});
+    REQUIRE(batches.empty());
+    client.close();
+}
+
+TEST_CASE("subscription_stream: publishes from one read complete a single receive") {
+    boost::asio::io_context io;
+    client_peer peer(io);
+    client_type client(io.get_executor());
+    connect_client(io, client, peer);
+    auto stream = client.stream_subscriber("a/#", 16);
+
+    std::vector<std::vector<mqtt5::protocol::publish>> batches;
+    p0443_v2::submit(stream.receive_many(8), batch_receiver{&batches});
+    peer.send({make_publish("a/1"), make_publish("a/2"), make_publish("a/3")});
+    REQUIRE(run_until(io, [&] { return !batches.empty(); }));
+    // Held back until the last packet of the read was decoded
+    REQUIRE(batches.size() == 1);
+    REQUIRE(batches[0].size() == 3);
+    REQUIRE(batches[0][0].topic == "a/1");
+    REQUIRE(batches[0][2].topic == "a/3");
+    client.close();
+}
+
+TEST_CASE("subscription_stream: a receive completes when the read buffer runs dry") {
+    boost::asio::io_context io;
+    client_peer peer(io);
+    client_type client(io.get_executor());
+    connect_client(io, client, peer);
+    auto stream = client.stream_subscriber("a/#", 16);
+
+    std::vector<std::vector<mqtt5::protocol::publish>> batches;
+    p0443_v2::submit(stream.receive_many(8), batch_receiver{&batches});
+    peer.send(make_publish("a/1"));
+    // Completes with what it has instead of waiting for the socket
+    REQUIRE(run_until(io, [&] { return !batches.empty(); }));
+    REQUIRE(batches[0].size() == 1);
+
+    p0443_v2::submit(stream.receive_many(8), batch_receiver{&batches});
+    peer.send(make_publish("a/2"));
+    REQUIRE(run_until(io, [&] { return batches.size() == 2; }));
+    REQUIRE(batches[1].size() == 1);
+    REQUIRE(batches[1][0].topic == "a/2");
+    client.close();
+}
@@ -0,0 +1,100 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include <mqtt5/detail/timer_wheel.hpp>
+
+#include <doctest/doctest.h>
+
+#include <vector>
+
+namespace
+{
+struct item : mqtt5::detail::timer_wheel_entry
+{
+    int value;
+    explicit item(int v) : value(v) {
+    }
+};
+
+std::vector<int> advance(mqtt5::detail::timer_wheel &wheel, std::uint64_t now) {
+    std::vector<int> retval;
+    wheel.advance(now, [&](mqtt5::detail::timer_wheel_entry &entry) {
+        retval.push_back(static_cast<item &>(entry).value);
+    });
+    return retval;
+}
+} // namespace
+
+TEST_CASE("timer_wheel: expires in deadline order") {
+    mqtt5::detail::timer_wheel wheel;
+    item a(1), b(2), c(3);
+    wheel.schedule(a, 10);
+    wheel.schedule(b, 5);
+    wheel.schedule(c, 70);
+    REQUIRE(wheel.size() == 3);
+
+    REQUIRE(advance(wheel, 4).empty());
+    REQUIRE(advance(wheel, 5) == std::vector<int>{2});
+    REQUIRE_FALSE(b.is_scheduled());
+    REQUIRE(advance(wheel, 69) == std::vector<int>{1});
+    REQUIRE(advance(wheel, 70) == std::vector<int>{3});
+    REQUIRE(wheel.empty());
+}
+
+TEST_CASE("timer_wheel: cancel and reschedule") {
+    mqtt5::detail::timer_wheel wheel;
+    item a(1), b(2);
+    wheel.schedule(a, 3);
+    wheel.schedule(b, 3);
+    wheel.cancel(a);
+    REQUIRE_FALSE(a.is_scheduled());
+    wheel.schedule(b, 8);
+    REQUIRE(wheel.size() == 1);
+    REQUIRE(advance(wheel, 7).empty());
+    REQUIRE(advance(wheel, 8) == std::vector<int>{2});
+
+    // Deadlines already passed expire on the next advance
+    wheel.schedule(a, 2);
+    REQUIRE(advance(wheel, 8) == std::vector<int>{1});
+}
+
+TEST_CASE("timer_wheel: cascades distant deadlines") {
+    mqtt5::detail::timer_wheel wheel(100);
+    std::vector<item> items;
+    const std::vector<std::uint64_t> deadlines{4200, 300000, 20000000, 100000000};
+    for (std::size_t i = 0; i < deadlines.size(); i++) {
+        items.emplace_back(static_cast<int>(i));
+    }
+    for (std::size_t i = 0; i < deadlines.size(); i++) {
+        wheel.schedule(items[i], deadlines[i]);
+    }
+
+    for (std::size_t i = 0; i < deadlines.size(); i++) {
+        REQUIRE(advance(wheel, deadlines[i] - 1).empty());
+        REQUIRE(advance(wheel, deadlines[i]) == std::vector<int>{static_cast<int>(i)});
+    }
+    REQUIRE(wheel.empty());
+}
+
+TEST_CASE("timer_wheel: destroyed entries cancel themselves") {
+    mqtt5::detail::timer_wheel wheel;
+    item a(1);
+    wheel.schedule(a, 3);
+    {
+        item b(2);
+        wheel.schedule(b, 3);
+        REQUIRE(wheel.size() == 2);
+    }
+    REQUIRE(wheel.size() == 1);
+    REQUIRE(advance(wheel, 3) == std::vector<int>{1});
+
+    // Entries outliving their wheel are left unscheduled
+    item c(3);
+    {
+        mqtt5::detail::timer_wheel other;
+        other.schedule(c, 100000);
+    }
+    REQUIRE_FALSE(c.is_scheduled());
+}
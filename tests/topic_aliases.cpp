@@ -0,0 +1,212 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include <mqtt5/client.hpp>
+#include <mqtt5/detail/inbound_topic_aliases.hpp>
+#include <mqtt5/detail/outbound_topic_aliases.hpp>
+
+#include <doctest/doctest.h>
+
+#include "client_peer.hpp"
+
+#include <vector>
+
+namespace
+{
+mqtt5::protocol::publish make_publish(std::string topic) {
+    mqtt5::protocol::publish retval;
+    retval.topic = std::move(topic);
+    return retval;
+}
+
+mqtt5::protocol::publish make_aliased(std::string topic, std::uint16_t alias) {
+    auto retval = make_publish(std::move(topic));
+    retval.properties.topic_alias = alias;
+    return retval;
+}
+
+struct connect_receiver
+{
+    bool *connected_;
+
+    void set_value() {
+        *connected_ = true;
+    }
+    void set_done() {
+    }
+    void set_error(std::exception_ptr) {
+    }
+};
+
+struct batch_receiver
+{
+    std::vector<mqtt5::protocol::publish> *received_;
+
+    void set_value(std::vector<mqtt5::protocol::publish> pubs) {
+        received_->insert(received_->end(), pubs.begin(), pubs.end());
+    }
+    void set_done() {
+    }
+    void set_error(std::exception_ptr) {
+    }
+};
+} // namespace
+
+TEST_CASE("outbound_topic_aliases: disabled without maximum") {
+    mqtt5::detail::outbound_topic_aliases aliases;
+    auto pub = make_publish("a/b");
+    REQUIRE_FALSE(aliases.apply(pub));
+    REQUIRE(pub.topic == "a/b");
+    REQUIRE(pub.properties.topic_alias == 0);
+}
+
+TEST_CASE("outbound_topic_aliases: full topic only sent on first use") {
+    mqtt5::detail::outbound_topic_aliases aliases;
+    aliases.reset(2);
+
+    auto first = make_publish("a/b");
+    REQUIRE(aliases.apply(first));
+    REQUIRE(first.topic == "a/b");
+    REQUIRE(first.properties.topic_alias == 1);
+
+    auto second = make_publish("a/b");
+    REQUIRE(aliases.apply(second));
+    REQUIRE(second.topic.empty());
+    REQUIRE(second.properties.topic_alias == 1);
+
+    auto other = make_publish("c/d");
+    REQUIRE(aliases.apply(other));
+    REQUIRE(other.topic == "c/d");
+    REQUIRE(other.properties.topic_alias == 2);
+}
+
+TEST_CASE("outbound_topic_aliases: least recently used alias is reused") {
+    mqtt5::detail::outbound_topic_aliases aliases;
+    aliases.reset(2);
+
+    auto a = make_publish("a");
+    auto b = make_publish("b");
+    auto a_again = make_publish("a");
+    aliases.apply(a);
+    aliases.apply(b);
+    aliases.apply(a_again);
+
+    // "b" is least recently used and gets evicted
+    auto c = make_publish("c");
+    REQUIRE(aliases.apply(c));
+    REQUIRE(c.topic == "c");
+    REQUIRE(c.properties.topic_alias == 2);
+    REQUIRE(aliases.size() == 2);
+
+    auto b_again = make_publish("b");
+    REQUIRE(aliases.apply(b_again));
+    REQUIRE(b_again.topic == "b");
+    REQUIRE(b_again.properties.topic_alias == 1);
+}
+
+TEST_CASE("outbound_topic_aliases: explicit aliases are left alone") {
+    mqtt5::detail::outbound_topic_aliases aliases;
+    aliases.reset(2);
+
+    auto explicit_alias = make_publish("x");
+    explicit_alias.properties.topic_alias = 1;
+    REQUIRE_FALSE(aliases.apply(explicit_alias));
+    REQUIRE(explicit_alias.topic == "x");
+
+    auto automatic = make_publish("y");
+    REQUIRE(aliases.apply(automatic));
+    REQUIRE(automatic.properties.topic_alias == 2);
+
+    aliases.reset(2);
+    REQUIRE(aliases.size() == 0);
+}
+
+TEST_CASE("inbound_topic_aliases: aliases are resolved") {
+    mqtt5::detail::inbound_topic_aliases aliases;
+    aliases.reset(2);
+
+    auto first = make_publish("a/b");
+    first.properties.topic_alias = 2;
+    REQUIRE(aliases.resolve(first));
+    REQUIRE(first.topic == "a/b");
+
+    auto aliased = make_publish("");
+    aliased.properties.topic_alias = 2;
+    REQUIRE(aliases.resolve(aliased));
+    REQUIRE(aliased.topic == "a/b");
+
+    auto remapped = make_publish("c/d");
+    remapped.properties.topic_alias = 2;
+    REQUIRE(aliases.resolve(remapped));
+    aliased.topic.clear();
+    REQUIRE(aliases.resolve(aliased));
+    REQUIRE(aliased.topic == "c/d");
+}
+
+TEST_CASE("inbound_topic_aliases: invalid aliases are rejected") {
+    mqtt5::detail::inbound_topic_aliases aliases;
+    aliases.reset(2);
+
+    auto unknown = make_publish("");
+    unknown.properties.topic_alias = 1;
+    REQUIRE_FALSE(aliases.resolve(unknown));
+
+    auto out_of_range = make_publish("a");
+    out_of_range.properties.topic_alias = 3;
+    REQUIRE_FALSE(aliases.resolve(out_of_range));
+
+    auto no_topic = make_publish("");
+    REQUIRE_FALSE(aliases.resolve(no_topic));
+}
+
+TEST_CASE("inbound_topic_aliases: aliases resolve to interned topics") {
+    mqtt5::detail::topic_intern_table topics(1);
+    mqtt5::detail::inbound_topic_aliases aliases;
+    aliases.reset(2);
+
+    auto first = make_aliased("a/b", 1);
+    auto *interned = aliases.resolve(first, topics);
+    REQUIRE(interned == &topics.intern("a/b"));
+
+    auto aliased = make_aliased("", 1);
+    REQUIRE(aliases.resolve(aliased, topics) == interned);
+    // Not copied, the interned topic has the name
+    REQUIRE(aliased.topic.empty());
+
+    // The alias keeps its topic when the full table starts over
+    REQUIRE(aliases.resolve(make_publish("c/d"), topics) == &topics.intern("c/d"));
+    REQUIRE(aliases.resolve(aliased, topics) == interned);
+    REQUIRE(interned->name == "a/b");
+
+    REQUIRE_FALSE(aliases.resolve(make_aliased("", 2), topics));
+    REQUIRE_FALSE(aliases.resolve(make_publish(""), topics));
+}
+
+TEST_CASE("inbound_topic_aliases: a client delivers aliased publishes with their topic") {
+    using client_type = mqtt5::client<boost::asio::ip::tcp::socket>;
+    boost::asio::io_context io;
+    client_peer peer(io);
+    client_type client(io.get_executor());
+    mqtt5::connect_options opts;
+    opts.topic_alias_maximum = 4;
+    bool connected = false;
+    p0443_v2::submit(client.supervisor("127.0.0.1", peer.port(), opts),
+                     connect_receiver{&connected});
+    REQUIRE(peer.accept());
+    REQUIRE(peer.receive_as<mqtt5::protocol::connect>());
+    peer.send(mqtt5::protocol::connack{});
+    REQUIRE(run_until(io, [&] { return connected; }));
+
+    auto stream = client.stream_subscriber("a/#", 16);
+    std::vector<mqtt5::protocol::publish> received;
+    p0443_v2::submit(stream.receive_many(8), batch_receiver{&received});
+    peer.send({make_aliased("a/b", 1), make_aliased("", 1), make_aliased("x/y", 2),
+               make_aliased("", 2), make_aliased("", 1)});
+    REQUIRE(run_until(io, [&] { return received.size() == 3; }));
+    for (auto &publish : received) {
+        REQUIRE(publish.topic == "a/b");
+    }
+    client.close();
+}
@@ -76,4 +76,41 @@ TEST_CASE("topic_filter: single level wildcard")
     REQUIRE(filter.matches("/hello"));
     REQUIRE(filter.matches("/"));
     REQUIRE_FALSE(filter.matches("hello"));
-}
\ No newline at end of file
+}
+TEST_CASE("topic_filter: split topic levels")
+{
+    auto levels = mqtt5::split_topic_levels("sport/tennis/player1");
+    REQUIRE(levels.size() == 3);
+    REQUIRE(levels[0] == "sport");
+    REQUIRE(levels[2] == "player1");
+
+    REQUIRE(mqtt5::split_topic_levels("/").size() == 2);
+    REQUIRE(mqtt5::split_topic_levels("a/").size() == 2);
+
+    auto filter = mqtt5::topic_filter::from_string("sport/+/player1");
+    REQUIRE(filter.matches(levels));
+}
+
+TEST_CASE("topic_filter: overlaps")
+{
+    auto overlaps = [](const char *lhs, const char *rhs) {
+        auto left = mqtt5::topic_filter::from_string(lhs);
+        auto right = mqtt5::topic_filter::from_string(rhs);
+        REQUIRE(left.overlaps(right) == right.overlaps(left));
+        return left.overlaps(right);
+    };
+    REQUIRE(overlaps("a/b", "a/b"));
+    REQUIRE(overlaps("a/#", "a/b"));
+    REQUIRE(overlaps("a/#", "a"));
+    REQUIRE(overlaps("a/+", "+/b"));
+    REQUIRE(overlaps("#", "a/b/c"));
+    REQUIRE(overlaps("a/+/c", "a/#"));
+
+    REQUIRE_FALSE(overlaps("a/b", "a/c"));
+    REQUIRE_FALSE(overlaps("a/+", "a/b/c"));
+    REQUIRE_FALSE(overlaps("a/b/#", "a/c/#"));
+    REQUIRE_FALSE(overlaps("a/+", "a"));
+    REQUIRE_FALSE(overlaps("#", "$SYS/uptime"));
+    REQUIRE_FALSE(overlaps("+/uptime", "$SYS/uptime"));
+    REQUIRE(overlaps("$SYS/#", "$SYS/uptime"));
+}
@@ -0,0 +1,54 @@
+//          Copyright Andreas Wass 2004 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include <mqtt5/detail/topic_intern_table.hpp>
+
+#include <doctest/doctest.h>
+
+TEST_CASE("topic_intern_table: same topic gives same handle") {
+    mqtt5::detail::topic_intern_table table;
+    std::string name = "sensors/1/temp";
+    auto &first = table.intern(name);
+    auto &second = table.intern("sensors/1/temp");
+    REQUIRE(&first == &second);
+    REQUIRE(first.name == name);
+    REQUIRE(first.levels.size() == 3);
+    REQUIRE(first.levels[1] == "1");
+    REQUIRE(table.size() == 1);
+}
+
+TEST_CASE("topic_intern_table: matches are cached until invalidated") {
+    mqtt5::detail::topic_intern_table table;
+    std::vector<mqtt5::topic_filter> filters{"sensors/+/temp", "other/#", "sensors/#"};
+    int predicate_calls = 0;
+    auto is_match = [&](std::size_t i) {
+        predicate_calls++;
+        return filters[i].matches(table.intern("sensors/1/temp").levels);
+    };
+
+    auto &topic = table.intern("sensors/1/temp");
+    auto matches = table.matching(topic, filters.size(), is_match);
+    REQUIRE(matches == std::vector<std::size_t>{0, 2});
+    REQUIRE(predicate_calls == 3);
+
+    matches = table.matching(topic, filters.size(), is_match);
+    REQUIRE(matches == std::vector<std::size_t>{0, 2});
+    REQUIRE(predicate_calls == 3);
+
+    filters.erase(filters.begin());
+    table.invalidate();
+    matches = table.matching(topic, filters.size(), is_match);
+    REQUIRE(matches == std::vector<std::size_t>{1});
+    REQUIRE(predicate_calls == 5);
+}
+
+TEST_CASE("topic_intern_table: bounded size") {
+    mqtt5::detail::topic_intern_table table(2);
+    table.intern("a");
+    table.intern("b");
+    REQUIRE(table.size() == 2);
+    table.intern("c");
+    REQUIRE(table.size() == 1);
+}